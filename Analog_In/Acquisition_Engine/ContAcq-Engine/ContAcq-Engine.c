@@ -0,0 +1,109 @@
+/*********************************************************************
+*
+* ANSI C Example program:
+*    ContAcq-Engine.c
+*
+* Example Category:
+*    AI
+*
+* Description:
+*    This example demonstrates how to acquire a continuous amount of
+*    data from any of the analog input channel types with the
+*    acquisition engine in ContAcqEngine.c. The channel, timing and
+*    read settings come from a configuration file, so they can be
+*    changed without compiling the example again.
+*
+* Instructions for Running:
+*    1. Edit ContAcq-Engine.cfg. Set ChannelType to Voltage, Current,
+*       Thermocouple, RTD, Strain, Accel or Microphone, and set the
+*       other keys of that channel type. Keys that are not set keep
+*       the values of the single channel example of the channel type.
+*    2. Set configFilePath to where the configuration file is.
+*    3. Set summaryIntervalSeconds. The example prints the minimum,
+*       maximum and mean of each channel once per interval.
+*    4. Set outputFilePath to also write the acquired data to a file
+*       of native float64 values, or leave it empty.
+*    Note: Build ContAcq-Engine.c together with ContAcqEngine.c. On
+*          Linux, link the example with -pthread.
+*
+* Steps:
+*    1. Load the configuration file.
+*    2. Create the engine. This creates a task, the channel of the
+*       configured type and the sample clock timing, and allocates
+*       the blocks the reads go into.
+*    3. Add the summary consumer, and the file consumer if an output
+*       file is set.
+*    4. Start the engine. Each Every N Samples event reads into a
+*       free block, and the consumers process the block on a thread
+*       of the engine.
+*    5. Stop the engine when the user presses Enter or an error
+*       occurs, and let the consumers finish the waiting blocks.
+*    6. Destroy the engine to clear the task.
+*    7. Display an error if any.
+*
+* I/O Connections Overview:
+*    Make sure your signal input terminal matches the PhysicalChannel
+*    of the configuration file. For further connection information,
+*    refer to your hardware reference manual.
+*
+*********************************************************************/
+
+#include <stdio.h>
+#include <NIDAQmx.h>
+#include "ContAcqEngine.h"
+
+/*********************************************/
+// Example Options
+/*********************************************/
+const char *configFilePath = "ContAcq-Engine.cfg"; // The configuration file that describes the channel, timing and read settings.
+const float64 summaryIntervalSeconds = 1.0; // The acquisition time each printed summary covers.
+const char *outputFilePath = ""; // The file the acquired data is written to. Leave it empty to only print the summaries.
+
+int main(void)
+{
+	int32               error=0;
+	AcqConfig           config;
+	AcqEngine           *engine=NULL;
+	AcqSummaryConsumer  summary;
+	AcqFileConsumer     file;
+	char                errBuff[2048]={'\0'};
+
+	if( !AcqLoadConfig(configFilePath,&config) )
+		goto Error;
+
+	/*********************************************/
+	// Engine Configure Code
+	/*********************************************/
+	if( DAQmxFailed(error=AcqCreateEngine(&config,&engine)) )
+		goto Error;
+	AcqInitSummaryConsumer(&summary,summaryIntervalSeconds);
+	AcqAddConsumer(engine,&summary.consumer);
+	if( *outputFilePath ) {
+		AcqInitFileConsumer(&file,outputFilePath);
+		AcqAddConsumer(engine,&file.consumer);
+	}
+
+	/*********************************************/
+	// Engine Start Code
+	/*********************************************/
+	if( DAQmxFailed(error=AcqStartEngine(engine)) )
+		goto Error;
+
+	printf("Acquiring samples continuously. Press Enter to interrupt\n");
+	getchar();
+
+	/*********************************************/
+	// Engine Stop Code
+	/*********************************************/
+	AcqStopEngine(engine);
+
+Error:
+	if( DAQmxFailed(error) )
+		AcqGetEngineError(engine,errBuff,2048);
+	AcqDestroyEngine(engine);
+	if( DAQmxFailed(error) )
+		printf("DAQmx Error: %s\n",errBuff);
+	printf("End of program, press Enter key to quit\n");
+	getchar();
+	return 0;
+}
@@ -0,0 +1,760 @@
+/*********************************************************************
+*
+* ANSI C Library:
+*    ContAcqEngine.c
+*
+* Description:
+*    The continuous analog input acquisition declared in
+*    ContAcqEngine.h. See the header for how the blocks are shared
+*    with the consumers.
+*
+*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include "ContAcqEngine.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
+#define DAQmxErrChk(functionCall) if( DAQmxFailed(error=(functionCall)) ) goto Error; else
+
+#ifdef _WIN32
+typedef HANDLE		AcqThread;
+typedef HANDLE		AcqSemaphore;
+typedef DWORD		AcqThreadResult;
+#define AcqThreadCall						WINAPI
+#define AcqThreadCreate(thread,func,arg)	((*(thread)=CreateThread(NULL,0,(func),(arg),0,NULL))!=NULL)
+#define AcqThreadJoin(thread)				(WaitForSingleObject((thread),INFINITE),CloseHandle(thread))
+#define AcqSemaphoreInit(sem)				((*(sem)=CreateSemaphore(NULL,0,0x7FFFFFFF,NULL))!=NULL)
+#define AcqSemaphoreDestroy(sem)			CloseHandle(*(sem))
+#define AcqSemaphoreWait(sem)				WaitForSingleObject(*(sem),INFINITE)
+#define AcqSemaphorePost(sem)				ReleaseSemaphore(*(sem),1,NULL)
+#define RingLoadAcquire(ptr)				(MemoryBarrier(),*(ptr))
+#define RingStoreRelease(ptr,val)			(MemoryBarrier(),*(ptr)=(val))
+#else
+typedef pthread_t	AcqThread;
+typedef sem_t		AcqSemaphore;
+typedef void		*AcqThreadResult;
+#define AcqThreadCall
+#define AcqThreadCreate(thread,func,arg)	(pthread_create((thread),NULL,(func),(arg))==0)
+#define AcqThreadJoin(thread)				pthread_join((thread),NULL)
+#define AcqSemaphoreInit(sem)				(sem_init((sem),0,0)==0)
+#define AcqSemaphoreDestroy(sem)			sem_destroy(sem)
+#define AcqSemaphoreWait(sem)				while( sem_wait(sem) )
+#define AcqSemaphorePost(sem)				sem_post(sem)
+#define RingLoadAcquire(ptr)				__atomic_load_n((ptr),__ATOMIC_ACQUIRE)
+#define RingStoreRelease(ptr,val)			__atomic_store_n((ptr),(val),__ATOMIC_RELEASE)
+#endif
+
+// The Every N Samples event owns the fields up to head, the consumer thread
+// the fields from tail on. They sit on separate cache lines so neither side
+// invalidates the line the other one writes.
+struct _AcqEngine {
+	AcqConfig		config;
+	TaskHandle		taskHandle;
+	uInt32			numChannels;
+	uInt32			mask;				// numBlocks-1, numBlocks being a power of two
+	uInt32			blockValues;		// sampsPerChan*numChannels
+	size_t			slotValues;			// Between the starts of two blocks, a whole number of cache lines
+	void			*memory;			// As allocated, blocks points into it
+	float64			*blocks;			// numBlocks blocks and the scratch block
+	int32			*numRead;			// Samples per channel read into each block
+	uInt64			*firstSample;		// Of each block
+	AcqConsumer		*consumers[AcqMaxConsumers];
+	uInt32			numConsumers;
+	AcqSemaphore	ready;
+	AcqThread		thread;
+	bool32			threadRunning;
+	bool32			taskRunning;
+	int32			error;				// First error of the task, recorded by the callbacks
+	char			errBuff[2048];
+	uInt64			totalRead;
+	uInt32			skipped;
+	char			headLine[AcqCacheLineSize];
+	uInt32			head;
+	char			tailLine[AcqCacheLineSize];
+	uInt32			tail;
+	int				quit;
+};
+
+typedef enum {
+	AcqKeyString,
+	AcqKeyFloat,
+	AcqKeyInt,
+	AcqKeyUInt
+} AcqKeyType;
+
+// A key of the configuration file and the AcqConfig field it sets
+typedef struct {
+	const char	*name;
+	AcqKeyType	type;
+	size_t		offset;
+} AcqConfigKey;
+
+// A DAQmx_Val_ constant a configuration file may name instead of its value
+typedef struct {
+	const char	*name;
+	int32		value;
+} AcqConfigValue;
+
+#define AcqKey(name,type,field)	{ name, type, offsetof(AcqConfig,field) }
+#define AcqValue(value)			{ #value, value }
+
+static const AcqConfigKey acqConfigKeys[]={
+	AcqKey("PhysicalChannel",AcqKeyString,physicalChannel),
+	AcqKey("MinVal",AcqKeyFloat,minVal),
+	AcqKey("MaxVal",AcqKeyFloat,maxVal),
+	AcqKey("Units",AcqKeyInt,units),
+	AcqKey("TerminalConfig",AcqKeyInt,terminalConfig),
+	AcqKey("ShuntResistorLoc",AcqKeyInt,shuntResistorLoc),
+	AcqKey("ExtShuntResistorVal",AcqKeyFloat,extShuntResistorVal),
+	AcqKey("ThermocoupleType",AcqKeyInt,thermocoupleType),
+	AcqKey("CJCSource",AcqKeyInt,cjcSource),
+	AcqKey("CJCVal",AcqKeyFloat,cjcVal),
+	AcqKey("CJCChannel",AcqKeyString,cjcChannel),
+	AcqKey("RTDType",AcqKeyInt,rtdType),
+	AcqKey("ResistanceConfig",AcqKeyInt,resistanceConfig),
+	AcqKey("R0",AcqKeyFloat,r0),
+	AcqKey("CurrentExcitSource",AcqKeyInt,currentExcitSource),
+	AcqKey("CurrentExcitVal",AcqKeyFloat,currentExcitVal),
+	AcqKey("StrainConfig",AcqKeyInt,strainConfig),
+	AcqKey("VoltageExcitSource",AcqKeyInt,voltageExcitSource),
+	AcqKey("VoltageExcitVal",AcqKeyFloat,voltageExcitVal),
+	AcqKey("GageFactor",AcqKeyFloat,gageFactor),
+	AcqKey("InitialBridgeVoltage",AcqKeyFloat,initialBridgeVoltage),
+	AcqKey("NominalGageResistance",AcqKeyFloat,nominalGageResistance),
+	AcqKey("PoissonRatio",AcqKeyFloat,poissonRatio),
+	AcqKey("LeadWireResistance",AcqKeyFloat,leadWireResistance),
+	AcqKey("Sensitivity",AcqKeyFloat,sensitivity),
+	AcqKey("SensitivityUnits",AcqKeyInt,sensitivityUnits),
+	AcqKey("MicSensitivity",AcqKeyFloat,micSensitivity),
+	AcqKey("MaxSndPressLevel",AcqKeyFloat,maxSndPressLevel),
+	AcqKey("ClockSource",AcqKeyString,clockSource),
+	AcqKey("SampleRate",AcqKeyFloat,sampleRate),
+	AcqKey("ActiveEdge",AcqKeyInt,activeEdge),
+	AcqKey("SampsPerChan",AcqKeyUInt,sampsPerChan),
+	AcqKey("Timeout",AcqKeyFloat,timeout),
+	AcqKey("FillMode",AcqKeyInt,fillMode),
+	AcqKey("NumBlocks",AcqKeyUInt,numBlocks)
+};
+
+static const AcqConfigValue acqConfigValues[]={
+	AcqValue(DAQmx_Val_Cfg_Default), AcqValue(DAQmx_Val_RSE), AcqValue(DAQmx_Val_NRSE), AcqValue(DAQmx_Val_Diff), AcqValue(DAQmx_Val_PseudoDiff),
+	AcqValue(DAQmx_Val_Volts), AcqValue(DAQmx_Val_Amps), AcqValue(DAQmx_Val_DegC), AcqValue(DAQmx_Val_DegF), AcqValue(DAQmx_Val_Kelvins), AcqValue(DAQmx_Val_DegR),
+	AcqValue(DAQmx_Val_Strain), AcqValue(DAQmx_Val_AccelUnit_g), AcqValue(DAQmx_Val_Pascals), AcqValue(DAQmx_Val_FromCustomScale),
+	AcqValue(DAQmx_Val_Default), AcqValue(DAQmx_Val_Internal), AcqValue(DAQmx_Val_External), AcqValue(DAQmx_Val_None),
+	AcqValue(DAQmx_Val_J_Type_TC), AcqValue(DAQmx_Val_K_Type_TC), AcqValue(DAQmx_Val_N_Type_TC), AcqValue(DAQmx_Val_R_Type_TC),
+	AcqValue(DAQmx_Val_S_Type_TC), AcqValue(DAQmx_Val_T_Type_TC), AcqValue(DAQmx_Val_B_Type_TC), AcqValue(DAQmx_Val_E_Type_TC),
+	AcqValue(DAQmx_Val_BuiltIn), AcqValue(DAQmx_Val_ConstVal), AcqValue(DAQmx_Val_Chan),
+	AcqValue(DAQmx_Val_Pt3750), AcqValue(DAQmx_Val_Pt3851), AcqValue(DAQmx_Val_Pt3911), AcqValue(DAQmx_Val_Pt3916), AcqValue(DAQmx_Val_Pt3920), AcqValue(DAQmx_Val_Pt3928),
+	AcqValue(DAQmx_Val_2Wire), AcqValue(DAQmx_Val_3Wire), AcqValue(DAQmx_Val_4Wire),
+	AcqValue(DAQmx_Val_FullBridgeI), AcqValue(DAQmx_Val_FullBridgeII), AcqValue(DAQmx_Val_FullBridgeIII),
+	AcqValue(DAQmx_Val_HalfBridgeI), AcqValue(DAQmx_Val_HalfBridgeII), AcqValue(DAQmx_Val_QuarterBridgeI), AcqValue(DAQmx_Val_QuarterBridgeII),
+	AcqValue(DAQmx_Val_mVoltsPerG), AcqValue(DAQmx_Val_VoltsPerG),
+	AcqValue(DAQmx_Val_Rising), AcqValue(DAQmx_Val_Falling),
+	AcqValue(DAQmx_Val_GroupByChannel), AcqValue(DAQmx_Val_GroupByScanNumber)
+};
+
+static const char *acqChannelTypeNames[]={ "Voltage", "Current", "Thermocouple", "RTD", "Strain", "Accel", "Microphone" };
+
+static int32 CreateEngineChannel(TaskHandle taskHandle, const AcqConfig *config);
+static bool32 ParseConfigValue(const char value[], int32 *result);
+static char *TrimConfigText(char text[]);
+static int32 EngineEveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData);
+static int32 EngineDoneCallback(TaskHandle taskHandle, int32 status, void *callbackData);
+static void RecordEngineError(AcqEngine *engine, int32 error);
+static AcqThreadResult AcqThreadCall EngineConsumerThread(void *arg);
+static bool32 StartSummaryConsumer(AcqConsumer *consumer, const AcqConfig *config, uInt32 numChannels);
+static void ConsumeSummaryBlock(AcqConsumer *consumer, const AcqBlock *block);
+static void StopSummaryConsumer(AcqConsumer *consumer);
+static void PrintSummary(AcqSummaryConsumer *summary);
+static bool32 StartFileConsumer(AcqConsumer *consumer, const AcqConfig *config, uInt32 numChannels);
+static void ConsumeFileBlock(AcqConsumer *consumer, const AcqBlock *block);
+static void StopFileConsumer(AcqConsumer *consumer);
+
+/*********************************************/
+// Configuration
+/*********************************************/
+// The values of the single channel example of each channel type
+void AcqSetConfigDefaults(AcqConfig *config, AcqChannelType channelType)
+{
+	memset(config,0,sizeof(AcqConfig));
+	config->channelType = channelType;
+	strcpy(config->physicalChannel,"Dev1/ai0");
+	config->terminalConfig = DAQmx_Val_Cfg_Default;
+	config->shuntResistorLoc = DAQmx_Val_Default;
+	config->extShuntResistorVal = 249.0;
+	config->thermocoupleType = DAQmx_Val_J_Type_TC;
+	config->cjcSource = DAQmx_Val_BuiltIn;
+	config->cjcVal = 25.0;
+	config->rtdType = DAQmx_Val_Pt3750;
+	config->resistanceConfig = DAQmx_Val_4Wire;
+	config->r0 = 100.0;
+	config->currentExcitSource = DAQmx_Val_Internal;
+	config->currentExcitVal = 0.004;
+	config->strainConfig = DAQmx_Val_FullBridgeI;
+	config->voltageExcitSource = DAQmx_Val_Internal;
+	config->voltageExcitVal = 2.5;
+	config->gageFactor = 2.0;
+	config->nominalGageResistance = 120.0;
+	config->poissonRatio = 0.285;
+	config->sensitivity = 175.0;
+	config->sensitivityUnits = DAQmx_Val_mVoltsPerG;
+	config->micSensitivity = 50.0;
+	config->maxSndPressLevel = 120.0;
+	strcpy(config->clockSource,"OnboardClock");
+	config->sampleRate = 1000.0;
+	config->activeEdge = DAQmx_Val_Rising;
+	config->sampsPerChan = 1000;
+	config->timeout = 10.0;
+	config->fillMode = DAQmx_Val_GroupByScanNumber;
+	config->numBlocks = 16;
+	switch( channelType ) {
+		case AcqChanVoltage:
+			config->minVal = -10.0;
+			config->maxVal = 10.0;
+			config->units = DAQmx_Val_Volts;
+			break;
+		case AcqChanCurrent:
+			config->minVal = 0.0;
+			config->maxVal = 0.02;
+			config->units = DAQmx_Val_Amps;
+			break;
+		case AcqChanThermocouple:
+			config->minVal = 0.0;
+			config->maxVal = 100.0;
+			config->units = DAQmx_Val_DegC;
+			config->sampleRate = 10.0;
+			config->sampsPerChan = 10;
+			break;
+		case AcqChanRTD:
+			config->minVal = 0.0;
+			config->maxVal = 100.0;
+			config->units = DAQmx_Val_DegC;
+			config->currentExcitSource = DAQmx_Val_External;
+			config->currentExcitVal = 0.00015;
+			config->sampleRate = 10.0;
+			config->sampsPerChan = 10;
+			break;
+		case AcqChanStrain:
+			config->minVal = -0.001;
+			config->maxVal = 0.001;
+			config->units = DAQmx_Val_Strain;
+			config->sampleRate = 10.0;
+			config->sampsPerChan = 10;
+			break;
+		case AcqChanAccel:
+			config->minVal = -50.0;
+			config->maxVal = 50.0;
+			config->units = DAQmx_Val_AccelUnit_g;
+			config->terminalConfig = DAQmx_Val_PseudoDiff;
+			break;
+		case AcqChanMicrophone:
+			config->units = DAQmx_Val_Pascals;
+			config->terminalConfig = DAQmx_Val_PseudoDiff;
+			break;
+	}
+}
+
+// Reads Key=Value lines into config. ChannelType must come first, because it
+// sets the defaults of its channel type that the other keys override. Blank
+// lines and lines starting with # are ignored.
+bool32 AcqLoadConfig(const char filePath[], AcqConfig *config)
+{
+	FILE		*file;
+	char		line[2*AcqMaxNameLength],*key,*value,*separator;
+	int			lineNum=0;
+	size_t		i;
+	bool32		success=TRUE;
+	void		*field;
+
+	AcqSetConfigDefaults(config,AcqChanVoltage);
+	if( (file=fopen(filePath,"r"))==NULL ) {
+		printf("Error: Could not open the configuration file %s.\n",filePath);
+		return FALSE;
+	}
+	while( success && fgets(line,sizeof(line),file) ) {
+		++lineNum;
+		key = TrimConfigText(line);
+		if( *key=='\0' || *key=='#' )
+			continue;
+		if( (separator=strchr(key,'='))==NULL ) {
+			printf("Error: Line %d of %s is not a Key=Value pair.\n",lineNum,filePath);
+			success = FALSE;
+			break;
+		}
+		*separator = '\0';
+		key = TrimConfigText(key);
+		value = TrimConfigText(separator+1);
+		if( strcmp(key,"ChannelType")==0 ) {
+			for(i=0;i<sizeof(acqChannelTypeNames)/sizeof(acqChannelTypeNames[0]);++i)
+				if( strcmp(value,acqChannelTypeNames[i])==0 )
+					break;
+			if( i==sizeof(acqChannelTypeNames)/sizeof(acqChannelTypeNames[0]) ) {
+				printf("Error: Unknown ChannelType %s on line %d of %s.\n",value,lineNum,filePath);
+				success = FALSE;
+			}
+			else
+				AcqSetConfigDefaults(config,(AcqChannelType)i);
+			continue;
+		}
+		for(i=0;i<sizeof(acqConfigKeys)/sizeof(acqConfigKeys[0]);++i)
+			if( strcmp(key,acqConfigKeys[i].name)==0 )
+				break;
+		if( i==sizeof(acqConfigKeys)/sizeof(acqConfigKeys[0]) ) {
+			printf("Error: Unknown key %s on line %d of %s.\n",key,lineNum,filePath);
+			success = FALSE;
+			break;
+		}
+		field = (char*)config + acqConfigKeys[i].offset;
+		switch( acqConfigKeys[i].type ) {
+			case AcqKeyString:
+				if( strlen(value)>=AcqMaxNameLength )
+					success = FALSE;
+				else
+					strcpy((char*)field,value);
+				break;
+			case AcqKeyFloat:
+				success = sscanf(value,"%lf",(float64*)field)==1;
+				break;
+			case AcqKeyInt:
+				success = ParseConfigValue(value,(int32*)field);
+				break;
+			case AcqKeyUInt:
+				success = sscanf(value,"%u",(uInt32*)field)==1;
+				break;
+		}
+		if( !success )
+			printf("Error: The value of %s on line %d of %s is not valid.\n",key,lineNum,filePath);
+	}
+	fclose(file);
+	return success;
+}
+
+// Accepts a DAQmx_Val_ constant by name or by value
+static bool32 ParseConfigValue(const char value[], int32 *result)
+{
+	size_t	i;
+	int		numChars;
+
+	for(i=0;i<sizeof(acqConfigValues)/sizeof(acqConfigValues[0]);++i)
+		if( strcmp(value,acqConfigValues[i].name)==0 ) {
+			*result = acqConfigValues[i].value;
+			return TRUE;
+		}
+	return sscanf(value,"%d%n",result,&numChars)==1 && value[numChars]=='\0';
+}
+
+static char *TrimConfigText(char text[])
+{
+	char	*end;
+
+	while( isspace((unsigned char)*text) )
+		++text;
+	end = text + strlen(text);
+	while( end>text && isspace((unsigned char)end[-1]) )
+		--end;
+	*end = '\0';
+	return text;
+}
+
+/*********************************************/
+// Engine
+/*********************************************/
+// Creates the task and allocates the blocks. *engine is set even when this
+// fails, so that AcqGetEngineError can describe the failure. Destroy it
+// either way.
+int32 AcqCreateEngine(const AcqConfig *config, AcqEngine **engine)
+{
+	int32		error=0;
+	AcqEngine	*eng;
+	size_t		numBytes;
+
+	if( (*engine=eng=(AcqEngine*)calloc(1,sizeof(AcqEngine)))==NULL )
+		return AcqErrorOutOfMemory;
+	eng->config = *config;
+	if( eng->config.numBlocks<1 )
+		eng->config.numBlocks = 1;
+	if( eng->config.numBlocks>0x80000000 )
+		eng->config.numBlocks = 0x80000000;
+	// Adding the lowest set bit until one is left gives the next power of
+	// two, which the head and tail counters can mask through their wrap
+	while( eng->config.numBlocks&(eng->config.numBlocks-1) )
+		eng->config.numBlocks += eng->config.numBlocks&(~eng->config.numBlocks+1);
+	eng->mask = eng->config.numBlocks - 1;
+
+	/*********************************************/
+	// DAQmx Configure Code
+	/*********************************************/
+	DAQmxErrChk (DAQmxCreateTask("",&eng->taskHandle));
+	DAQmxErrChk (CreateEngineChannel(eng->taskHandle,&eng->config));
+	DAQmxErrChk (DAQmxCfgSampClkTiming(eng->taskHandle,eng->config.clockSource,eng->config.sampleRate,eng->config.activeEdge,DAQmx_Val_ContSamps,eng->config.sampsPerChan));
+	DAQmxErrChk (DAQmxGetTaskNumChans(eng->taskHandle,&eng->numChannels));
+
+	DAQmxErrChk (DAQmxRegisterEveryNSamplesEvent(eng->taskHandle,DAQmx_Val_Acquired_Into_Buffer,eng->config.sampsPerChan,0,EngineEveryNCallback,eng));
+	DAQmxErrChk (DAQmxRegisterDoneEvent(eng->taskHandle,0,EngineDoneCallback,eng));
+
+	// Every block starts on a cache line, and the scratch block follows the last one
+	eng->blockValues = eng->config.sampsPerChan*eng->numChannels;
+	eng->slotValues = (eng->blockValues*sizeof(float64)+AcqCacheLineSize-1)/AcqCacheLineSize*AcqCacheLineSize/sizeof(float64);
+	numBytes = sizeof(float64)*eng->slotValues*(eng->config.numBlocks+1) + AcqCacheLineSize-1;
+	if( (eng->memory=malloc(numBytes))==NULL
+	 || (eng->numRead=(int32*)malloc(sizeof(int32)*eng->config.numBlocks))==NULL
+	 || (eng->firstSample=(uInt64*)malloc(sizeof(uInt64)*eng->config.numBlocks))==NULL ) {
+		error = AcqErrorOutOfMemory;
+		goto Error;
+	}
+	eng->blocks = (float64*)(((size_t)eng->memory+AcqCacheLineSize-1)/AcqCacheLineSize*AcqCacheLineSize);
+
+Error:
+	if( DAQmxFailed(error) )
+		RecordEngineError(eng,error);
+	return error;
+}
+
+static int32 CreateEngineChannel(TaskHandle taskHandle, const AcqConfig *config)
+{
+	switch( config->channelType ) {
+		case AcqChanVoltage:
+			return DAQmxCreateAIVoltageChan(taskHandle,config->physicalChannel,"",config->terminalConfig,config->minVal,config->maxVal,config->units,NULL);
+		case AcqChanCurrent:
+			return DAQmxCreateAICurrentChan(taskHandle,config->physicalChannel,"",config->terminalConfig,config->minVal,config->maxVal,config->units,config->shuntResistorLoc,config->extShuntResistorVal,NULL);
+		case AcqChanThermocouple:
+			return DAQmxCreateAIThrmcplChan(taskHandle,config->physicalChannel,"",config->minVal,config->maxVal,config->units,config->thermocoupleType,config->cjcSource,config->cjcVal,config->cjcChannel);
+		case AcqChanRTD:
+			return DAQmxCreateAIRTDChan(taskHandle,config->physicalChannel,"",config->minVal,config->maxVal,config->units,config->rtdType,config->resistanceConfig,config->currentExcitSource,config->currentExcitVal,config->r0);
+		case AcqChanStrain:
+			return DAQmxCreateAIStrainGageChan(taskHandle,config->physicalChannel,"",config->minVal,config->maxVal,config->units,config->strainConfig,config->voltageExcitSource,config->voltageExcitVal,config->gageFactor,config->initialBridgeVoltage,config->nominalGageResistance,config->poissonRatio,config->leadWireResistance,NULL);
+		case AcqChanAccel:
+			return DAQmxCreateAIAccelChan(taskHandle,config->physicalChannel,"",config->terminalConfig,config->minVal,config->maxVal,config->units,config->sensitivity,config->sensitivityUnits,config->currentExcitSource,config->currentExcitVal,NULL);
+		case AcqChanMicrophone:
+			return DAQmxCreateAIMicrophoneChan(taskHandle,config->physicalChannel,"",config->terminalConfig,config->units,config->micSensitivity,config->maxSndPressLevel,config->currentExcitSource,config->currentExcitVal,NULL);
+	}
+	return 0;
+}
+
+// Consumers are called in the order they were added. The engine does not own
+// them, so they must outlive it.
+bool32 AcqAddConsumer(AcqEngine *engine, AcqConsumer *consumer)
+{
+	if( engine->numConsumers==AcqMaxConsumers || engine->threadRunning )
+		return FALSE;
+	engine->consumers[engine->numConsumers++] = consumer;
+	return TRUE;
+}
+
+int32 AcqStartEngine(AcqEngine *engine)
+{
+	int32	error=0;
+	uInt32	i;
+
+	for(i=0;i<engine->numConsumers;++i)
+		if( engine->consumers[i]->start && !engine->consumers[i]->start(engine->consumers[i],&engine->config,engine->numChannels) ) {
+			// Stop the consumers that did start
+			while( i-- )
+				if( engine->consumers[i]->stop )
+					engine->consumers[i]->stop(engine->consumers[i]);
+			error = AcqErrorConsumerFailed;
+			goto Error;
+		}
+	if( !AcqSemaphoreInit(&engine->ready) ) {
+		error = AcqErrorThreadFailed;
+		goto Error;
+	}
+	if( !AcqThreadCreate(&engine->thread,EngineConsumerThread,engine) ) {
+		AcqSemaphoreDestroy(&engine->ready);
+		error = AcqErrorThreadFailed;
+		goto Error;
+	}
+	engine->threadRunning = TRUE;
+
+	/*********************************************/
+	// DAQmx Start Code
+	/*********************************************/
+	DAQmxErrChk (DAQmxStartTask(engine->taskHandle));
+	engine->taskRunning = TRUE;
+
+Error:
+	if( DAQmxFailed(error) ) {
+		RecordEngineError(engine,error);
+		if( engine->threadRunning )
+			AcqStopEngine(engine);
+	}
+	return error;
+}
+
+// Stops the task, lets the consumers finish the blocks still waiting and
+// stops them. Returns the first error the task reported while it ran.
+int32 AcqStopEngine(AcqEngine *engine)
+{
+	uInt32	i;
+
+	/*********************************************/
+	// DAQmx Stop Code
+	/*********************************************/
+	if( engine->taskRunning ) {
+		DAQmxStopTask(engine->taskHandle);
+		engine->taskRunning = FALSE;
+	}
+	if( engine->threadRunning ) {
+		RingStoreRelease(&engine->quit,1);
+		AcqSemaphorePost(&engine->ready);
+		AcqThreadJoin(engine->thread);
+		AcqSemaphoreDestroy(&engine->ready);
+		engine->threadRunning = FALSE;
+		for(i=0;i<engine->numConsumers;++i)
+			if( engine->consumers[i]->stop )
+				engine->consumers[i]->stop(engine->consumers[i]);
+	}
+	return engine->error;
+}
+
+void AcqDestroyEngine(AcqEngine *engine)
+{
+	if( engine==NULL )
+		return;
+	AcqStopEngine(engine);
+	if( engine->taskHandle!=0 )
+		DAQmxClearTask(engine->taskHandle);
+	free(engine->memory);
+	free(engine->numRead);
+	free(engine->firstSample);
+	free(engine);
+}
+
+void AcqGetEngineError(AcqEngine *engine, char errBuff[], uInt32 bufferSize)
+{
+	if( engine==NULL )
+		snprintf(errBuff,bufferSize,"Not enough memory for the acquisition engine.");
+	else
+		snprintf(errBuff,bufferSize,"%s",engine->errBuff);
+}
+
+// Keeps the first error, since the ones after it are usually caused by it
+static void RecordEngineError(AcqEngine *engine, int32 error)
+{
+	if( DAQmxFailed(engine->error) )
+		return;
+	engine->error = error;
+	if( error==AcqErrorOutOfMemory )
+		strcpy(engine->errBuff,"Not enough memory for the acquisition engine.");
+	else if( error==AcqErrorThreadFailed )
+		strcpy(engine->errBuff,"The consumer thread could not be started.");
+	else if( error==AcqErrorConsumerFailed )
+		strcpy(engine->errBuff,"A consumer could not be started.");
+	else
+		DAQmxGetExtendedErrorInfo(engine->errBuff,sizeof(engine->errBuff));
+}
+
+// Reads into the next free block and hands it to the consumer thread. When
+// every block still waits, the read goes into the scratch block and is left
+// out, so this never waits for a consumer.
+static int32 EngineEveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData)
+{
+	int32		error=0;
+	AcqEngine	*engine=(AcqEngine*)callbackData;
+	uInt32		head=engine->head,slot=engine->config.numBlocks;
+	int32		read=0;
+
+	if( head-RingLoadAcquire(&engine->tail)<engine->config.numBlocks )
+		slot = head&engine->mask;
+
+	/*********************************************/
+	// DAQmx Read Code
+	/*********************************************/
+	DAQmxErrChk (DAQmxReadAnalogF64(taskHandle,engine->config.sampsPerChan,engine->config.timeout,engine->config.fillMode,engine->blocks+slot*engine->slotValues,engine->blockValues,&read,NULL));
+	if( read>0 && slot==engine->config.numBlocks )
+		RingStoreRelease(&engine->skipped,engine->skipped+1);
+	else if( read>0 ) {
+		engine->numRead[slot] = read;
+		engine->firstSample[slot] = engine->totalRead;
+		RingStoreRelease(&engine->head,head+1);
+		AcqSemaphorePost(&engine->ready);
+	}
+	engine->totalRead += read;
+
+Error:
+	if( DAQmxFailed(error) ) {
+		RecordEngineError(engine,error);
+		/*********************************************/
+		// DAQmx Stop Code
+		/*********************************************/
+		DAQmxStopTask(taskHandle);
+		printf("DAQmx Error: %s\n",engine->errBuff);
+	}
+	return 0;
+}
+
+static int32 EngineDoneCallback(TaskHandle taskHandle, int32 status, void *callbackData)
+{
+	int32		error=0;
+	AcqEngine	*engine=(AcqEngine*)callbackData;
+
+	// Check to see if an error stopped the task.
+	DAQmxErrChk (status);
+
+Error:
+	if( DAQmxFailed(error) ) {
+		RecordEngineError(engine,error);
+		printf("DAQmx Error: %s\n",engine->errBuff);
+	}
+	return 0;
+}
+
+// Hands each block to every consumer in turn, then frees it for the next read
+static AcqThreadResult AcqThreadCall EngineConsumerThread(void *arg)
+{
+	AcqEngine	*engine=(AcqEngine*)arg;
+	AcqBlock	block;
+	uInt32		tail,slot,i;
+
+	block.numChannels = engine->numChannels;
+	block.fillMode = engine->config.fillMode;
+	for(;;) {
+		AcqSemaphoreWait(&engine->ready);
+		tail = engine->tail;
+		if( tail!=RingLoadAcquire(&engine->head) ) {
+			slot = tail&engine->mask;
+			block.data = engine->blocks + slot*engine->slotValues;
+			block.numRead = engine->numRead[slot];
+			block.firstSample = engine->firstSample[slot];
+			block.skipped = RingLoadAcquire(&engine->skipped);
+			for(i=0;i<engine->numConsumers;++i)
+				engine->consumers[i]->consume(engine->consumers[i],&block);
+			RingStoreRelease(&engine->tail,tail+1);
+		}
+		else if( RingLoadAcquire(&engine->quit) )
+			break;
+	}
+	return 0;
+}
+
+/*********************************************/
+// Summary Consumer
+/*********************************************/
+void AcqInitSummaryConsumer(AcqSummaryConsumer *summary, float64 intervalSeconds)
+{
+	memset(summary,0,sizeof(AcqSummaryConsumer));
+	summary->consumer.start = StartSummaryConsumer;
+	summary->consumer.consume = ConsumeSummaryBlock;
+	summary->consumer.stop = StopSummaryConsumer;
+	summary->intervalSeconds = intervalSeconds;
+}
+
+static bool32 StartSummaryConsumer(AcqConsumer *consumer, const AcqConfig *config, uInt32 numChannels)
+{
+	AcqSummaryConsumer	*summary=(AcqSummaryConsumer*)consumer;
+
+	summary->intervalSamples = (uInt64)(summary->intervalSeconds*config->sampleRate);
+	if( summary->intervalSamples<1 )
+		summary->intervalSamples = 1;
+	summary->count = summary->total = 0;
+	summary->skipped = 0;
+	summary->numChannels = numChannels;
+	summary->min = (float64*)malloc(sizeof(float64)*numChannels);
+	summary->max = (float64*)malloc(sizeof(float64)*numChannels);
+	summary->sum = (float64*)malloc(sizeof(float64)*numChannels);
+	if( summary->min==NULL || summary->max==NULL || summary->sum==NULL ) {
+		StopSummaryConsumer(consumer);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void ConsumeSummaryBlock(AcqConsumer *consumer, const AcqBlock *block)
+{
+	AcqSummaryConsumer	*summary=(AcqSummaryConsumer*)consumer;
+	uInt32				numChannels=summary->numChannels,iChan;
+	int32				iSamp;
+	float64				value;
+
+	for(iSamp=0;iSamp<block->numRead;++iSamp) {
+		for(iChan=0;iChan<numChannels;++iChan) {
+			value = block->fillMode==DAQmx_Val_GroupByScanNumber ? block->data[iSamp*numChannels+iChan] : block->data[iChan*block->numRead+iSamp];
+			if( summary->count==0 || value<summary->min[iChan] )
+				summary->min[iChan] = value;
+			if( summary->count==0 || value>summary->max[iChan] )
+				summary->max[iChan] = value;
+			summary->sum[iChan] = (summary->count?summary->sum[iChan]:0.0) + value;
+		}
+		++summary->total;
+		if( ++summary->count==summary->intervalSamples ) {
+			PrintSummary(summary);
+			if( block->skipped!=summary->skipped ) {
+				printf("  %u reads left out while the consumers were busy\n",(unsigned)(block->skipped-summary->skipped));
+				summary->skipped = block->skipped;
+			}
+			fflush(stdout);
+			summary->count = 0;
+		}
+	}
+}
+
+static void StopSummaryConsumer(AcqConsumer *consumer)
+{
+	AcqSummaryConsumer	*summary=(AcqSummaryConsumer*)consumer;
+
+	if( summary->count ) {
+		PrintSummary(summary);
+		fflush(stdout);
+		summary->count = 0;
+	}
+	free(summary->min);
+	free(summary->max);
+	free(summary->sum);
+	summary->min = summary->max = summary->sum = NULL;
+}
+
+static void PrintSummary(AcqSummaryConsumer *summary)
+{
+	uInt32	iChan;
+
+	printf("Acquired %lu samples\n",(unsigned long)summary->total);
+	for(iChan=0;iChan<summary->numChannels;++iChan)
+		printf("  Channel %u: min %.2f  max %.2f  mean %.2f\n",(unsigned)iChan,summary->min[iChan],summary->max[iChan],summary->sum[iChan]/summary->count);
+}
+
+/*********************************************/
+// File Consumer
+/*********************************************/
+void AcqInitFileConsumer(AcqFileConsumer *file, const char filePath[])
+{
+	memset(file,0,sizeof(AcqFileConsumer));
+	file->consumer.start = StartFileConsumer;
+	file->consumer.consume = ConsumeFileBlock;
+	file->consumer.stop = StopFileConsumer;
+	snprintf(file->filePath,sizeof(file->filePath),"%s",filePath);
+}
+
+static bool32 StartFileConsumer(AcqConsumer *consumer, const AcqConfig *config, uInt32 numChannels)
+{
+	AcqFileConsumer	*file=(AcqFileConsumer*)consumer;
+
+	if( (file->file=fopen(file->filePath,"wb"))==NULL ) {
+		printf("Error: Could not create the file %s.\n",file->filePath);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void ConsumeFileBlock(AcqConsumer *consumer, const AcqBlock *block)
+{
+	AcqFileConsumer	*file=(AcqFileConsumer*)consumer;
+
+	fwrite(block->data,sizeof(float64)*block->numChannels,block->numRead,file->file);
+}
+
+static void StopFileConsumer(AcqConsumer *consumer)
+{
+	AcqFileConsumer	*file=(AcqFileConsumer*)consumer;
+
+	fclose(file->file);
+	file->file = NULL;
+}
@@ -0,0 +1,161 @@
+/*********************************************************************
+*
+* ANSI C Library:
+*    ContAcqEngine.h
+*
+* Description:
+*    A continuous analog input acquisition shared by examples that
+*    only differ in the channel they create and in what they do with
+*    the data. The engine creates the channel from an AcqConfig, reads
+*    each Every N Samples event into a preallocated block and hands
+*    the block to the consumers on a thread of its own.
+*
+* Notes:
+*    The blocks are allocated once when the engine is created. They
+*    start on a cache line and are reused, so reading a block does not
+*    allocate memory or use stack space in proportion to
+*    sampsPerChan. The consumers allocate what they need in their
+*    start function.
+*    When every block still waits for the consumers, the read goes
+*    into a scratch block and is left out, so the Every N Samples
+*    event never waits for a slow consumer.
+*    On Linux, link with -pthread.
+*
+*********************************************************************/
+
+#ifndef _CONTACQENGINE_H_
+#define _CONTACQENGINE_H_
+
+#include <stdio.h>
+#include <NIDAQmx.h>
+
+#define AcqMaxNameLength	256
+#define AcqMaxConsumers		8
+#define AcqCacheLineSize	64
+
+// Returned by AcqCreateEngine and AcqStartEngine for failures that are not
+// DAQmx errors. AcqGetEngineError describes them.
+#define AcqErrorOutOfMemory		(-1)
+#define AcqErrorThreadFailed	(-2)
+#define AcqErrorConsumerFailed	(-3)
+
+typedef enum {
+	AcqChanVoltage,
+	AcqChanCurrent,
+	AcqChanThermocouple,
+	AcqChanRTD,
+	AcqChanStrain,
+	AcqChanAccel,
+	AcqChanMicrophone
+} AcqChannelType;
+
+// Everything the engine needs to create and run the task. AcqSetConfigDefaults
+// fills in the values the single channel examples use, and AcqLoadConfig
+// overrides them from a file. Only the fields of the channel type are used.
+typedef struct {
+	AcqChannelType	channelType;
+	char			physicalChannel[AcqMaxNameLength];
+	float64			minVal;
+	float64			maxVal;
+	int32			units;
+	int32			terminalConfig;			// Voltage, Current, Accel and Microphone
+	// Current
+	int32			shuntResistorLoc;
+	float64			extShuntResistorVal;
+	// Thermocouple
+	int32			thermocoupleType;
+	int32			cjcSource;
+	float64			cjcVal;
+	char			cjcChannel[AcqMaxNameLength];
+	// RTD
+	int32			rtdType;
+	int32			resistanceConfig;
+	float64			r0;
+	// RTD, Accel and Microphone
+	int32			currentExcitSource;
+	float64			currentExcitVal;
+	// Strain
+	int32			strainConfig;
+	int32			voltageExcitSource;
+	float64			voltageExcitVal;
+	float64			gageFactor;
+	float64			initialBridgeVoltage;
+	float64			nominalGageResistance;
+	float64			poissonRatio;
+	float64			leadWireResistance;
+	// Accel
+	float64			sensitivity;
+	int32			sensitivityUnits;
+	// Microphone
+	float64			micSensitivity;
+	float64			maxSndPressLevel;
+	// Timing
+	char			clockSource[AcqMaxNameLength];
+	float64			sampleRate;
+	int32			activeEdge;
+	uInt32			sampsPerChan;			// Read by each Every N Samples event
+	// Read
+	float64			timeout;
+	bool32			fillMode;
+	uInt32			numBlocks;				// Blocks that can wait for the consumers, rounded up to a power of two
+} AcqConfig;
+
+// One read handed to the consumers. The data belongs to the engine and is
+// reused once every consumer returns.
+typedef struct {
+	const float64	*data;
+	int32			numRead;				// Samples per channel
+	uInt32			numChannels;
+	bool32			fillMode;
+	uInt64			firstSample;			// Of the block, counted per channel from the start
+	uInt32			skipped;				// Reads left out since the start
+} AcqBlock;
+
+// A consumer embeds this as its first member. consume runs on the consumer
+// thread of the engine, one block at a time. start runs in AcqStartEngine
+// before the task starts and stop in AcqStopEngine after the last block.
+// Either may be NULL.
+typedef struct _AcqConsumer {
+	bool32	(*start)(struct _AcqConsumer *consumer, const AcqConfig *config, uInt32 numChannels);
+	void	(*consume)(struct _AcqConsumer *consumer, const AcqBlock *block);
+	void	(*stop)(struct _AcqConsumer *consumer);
+} AcqConsumer;
+
+// Prints the minimum, maximum and mean of each channel once per interval.
+typedef struct {
+	AcqConsumer		consumer;
+	float64			intervalSeconds;
+	uInt64			intervalSamples;
+	uInt64			count;
+	uInt64			total;
+	uInt32			numChannels;
+	uInt32			skipped;
+	float64			*min;
+	float64			*max;
+	float64			*sum;
+} AcqSummaryConsumer;
+
+// Appends each block to a file as native float64 values in the fill mode of
+// the read.
+typedef struct {
+	AcqConsumer		consumer;
+	char			filePath[AcqMaxNameLength];
+	FILE			*file;
+} AcqFileConsumer;
+
+typedef struct _AcqEngine AcqEngine;
+
+void AcqSetConfigDefaults(AcqConfig *config, AcqChannelType channelType);
+bool32 AcqLoadConfig(const char filePath[], AcqConfig *config);
+
+int32 AcqCreateEngine(const AcqConfig *config, AcqEngine **engine);
+bool32 AcqAddConsumer(AcqEngine *engine, AcqConsumer *consumer);
+int32 AcqStartEngine(AcqEngine *engine);
+int32 AcqStopEngine(AcqEngine *engine);
+void AcqDestroyEngine(AcqEngine *engine);
+void AcqGetEngineError(AcqEngine *engine, char errBuff[], uInt32 bufferSize);
+
+void AcqInitSummaryConsumer(AcqSummaryConsumer *summary, float64 intervalSeconds);
+void AcqInitFileConsumer(AcqFileConsumer *file, const char filePath[]);
+
+#endif // _CONTACQENGINE_H_
@@ -34,6 +34,12 @@
 *    7. Set the slope and level of desired analog edge condition.
 *    8. Set the Hysteresis Level.
 *    9. Input the sensitivity and units for your accelerometer.
+*    10. Set telemetryIntervalSeconds. Rather than printing every
+*        sample, a telemetry thread prints the minimum, maximum and
+*        mean of each channel once per interval of acquired data.
+*    11. Set telemetryBlocks. This determines how many read blocks
+*        can wait for the telemetry thread while the console is slow.
+*    Note: On Linux, link the example with -pthread.
 *
 * Steps:
 *    1. Create a task.
@@ -43,11 +49,16 @@
 *    3. Set the sample rate and define a continuous acquisition.
 *    4. Define the trigger channel, trigger level, rising/falling
 *       edge, and hysteresis window for an analog start trigger.
-*    5. Call the Start function to start the acquisition.
+*    5. Start the telemetry thread and call the Start function to
+*       start the acquisition.
 *    6. Read the waveform data in the EveryNCallback function until
-*       the user hits the stop button or an error occurs.
-*    7. Check for overloaded channels.
-*    8. Call the Clear Task function to clear the Task.
+*       the user hits the stop button or an error occurs. Each read
+*       goes into a free block of a ring the telemetry thread
+*       summarizes, so the callback never waits for the console.
+*    7. Check for overloaded channels, and pass them to the telemetry
+*       thread with the block.
+*    8. Call the Clear Task function to clear the Task, and stop the
+*       telemetry thread once it has printed the last summary.
 *    9. Display an error if any.
 *
 * I/O Connections Overview:
@@ -60,15 +71,75 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <NIDAQmx.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#endif
 
 #define DAQmxErrChk(functionCall)            \
     if (DAQmxFailed(error = (functionCall))) \
         goto Error;                          \
     else
 
+#ifdef _WIN32
+typedef HANDLE TelemetryThread;
+typedef HANDLE TelemetrySemaphore;
+typedef DWORD TelemetryThreadResult;
+#define TelemetryThreadCall WINAPI
+#define TelemetryThreadCreate(thread, func, arg) ((*(thread) = CreateThread(NULL, 0, (func), (arg), 0, NULL)) != NULL)
+#define TelemetryThreadJoin(thread) (WaitForSingleObject((thread), INFINITE), CloseHandle(thread))
+#define TelemetrySemaphoreInit(sem) ((*(sem) = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL)) != NULL)
+#define TelemetrySemaphoreDestroy(sem) CloseHandle(*(sem))
+#define TelemetrySemaphoreWait(sem) WaitForSingleObject(*(sem), INFINITE)
+#define TelemetrySemaphorePost(sem) ReleaseSemaphore(*(sem), 1, NULL)
+#define RingLoadAcquire(ptr) (MemoryBarrier(), *(ptr))
+#define RingStoreRelease(ptr, val) (MemoryBarrier(), *(ptr) = (val))
+#else
+typedef pthread_t TelemetryThread;
+typedef sem_t TelemetrySemaphore;
+typedef void* TelemetryThreadResult;
+#define TelemetryThreadCall
+#define TelemetryThreadCreate(thread, func, arg) (pthread_create((thread), NULL, (func), (arg)) == 0)
+#define TelemetryThreadJoin(thread) pthread_join((thread), NULL)
+#define TelemetrySemaphoreInit(sem) (sem_init((sem), 0, 0) == 0)
+#define TelemetrySemaphoreDestroy(sem) sem_destroy(sem)
+#define TelemetrySemaphoreWait(sem) while (sem_wait(sem))
+#define TelemetrySemaphorePost(sem) sem_post(sem)
+#define RingLoadAcquire(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define RingStoreRelease(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#endif
+
+#define OverloadedChannelsSize 1000
+
+// Ring of read blocks between EveryNCallback, at head, and the telemetry
+// thread, at tail.
+typedef struct
+{
+    float64* blocks;
+    int32* numRead; // Samples per channel read into each slot
+    char* overloadedChannels; // Overloaded channels reported with each slot, empty if none
+    float64* scratch; // Read into while every slot waits
+    uInt32 numBlocks;
+    uInt32 mask; // numBlocks-1, numBlocks being a power of two
+    uInt32 numChannels;
+    uInt32 head;
+    uInt32 tail;
+    uInt32 skipped; // Reads left out of the summaries
+    TelemetrySemaphore ready;
+    TelemetryThread thread;
+    int running;
+    int quit;
+} TelemetrySink;
+
 int32 EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void* callbackData);
 int32 DoneCallback(TaskHandle taskHandle, int32 status, void* callbackData);
+int StartTelemetrySink(TelemetrySink* sink, uInt32 numChannels, uInt32 numBlocks);
+void StopTelemetrySink(TelemetrySink* sink);
+TelemetryThreadResult TelemetryThreadCall TelemetrySinkThread(void* arg);
 
 /*********************************************/
 // DAQmx Configuration Options
@@ -109,10 +180,18 @@ const uInt32 options = 0; // Use this parameter to set certain options. Pass a v
 const float64 timeout = 10; // The amount of time, in seconds, to wait for the function to read the sample(s).
 const bool32 fillMode = DAQmx_Val_GroupByScanNumber; // Specifies whether or not the samples are interleaved. Options: DAQmx_Val_GroupByChannel, DAQmx_Val_GroupByScanNumber
 
+/*********************************************/
+// Telemetry Options
+/*********************************************/
+const float64 telemetryIntervalSeconds = 1.0; // Seconds of acceleration per summary line of each channel.
+const uInt32 telemetryBlocks = 16; // Ring slots between the callback and the telemetry thread, rounded up to a power of two. Reads that find every slot waiting are dropped from the summaries.
+
 int main(void)
 {
     int32 error = 0;
     TaskHandle taskHandle = 0;
+    uInt32 numChannels;
+    TelemetrySink sink = { 0 };
     char errBuff[2048] = { '\0' };
 
     /*********************************************/
@@ -123,10 +202,17 @@ int main(void)
     DAQmxErrChk(DAQmxCfgSampClkTiming(taskHandle, clockSource, sampleRate, activeEdge, sampleMode, sampsPerChan));
     DAQmxErrChk(DAQmxCfgAnlgEdgeStartTrig(taskHandle, startTriggerSource, startTriggerSlope, startTriggerLevel));
     DAQmxErrChk(DAQmxSetAnlgEdgeStartTrigHyst(taskHandle, hystLevel));
+    DAQmxErrChk(DAQmxGetTaskNumChans(taskHandle, &numChannels));
 
-    DAQmxErrChk(DAQmxRegisterEveryNSamplesEvent(taskHandle, everyNsamplesEventType, sampsPerChan, options, EveryNCallback, NULL));
+    DAQmxErrChk(DAQmxRegisterEveryNSamplesEvent(taskHandle, everyNsamplesEventType, sampsPerChan, options, EveryNCallback, &sink));
     DAQmxErrChk(DAQmxRegisterDoneEvent(taskHandle, 0, DoneCallback, NULL));
 
+    if (!StartTelemetrySink(&sink, numChannels, telemetryBlocks))
+    {
+        puts("Error: The telemetry thread could not be started.");
+        goto Error;
+    }
+
     /*********************************************/
     // DAQmx Start Code
     /*********************************************/
@@ -146,6 +232,7 @@ Error:
         DAQmxStopTask(taskHandle);
         DAQmxClearTask(taskHandle);
     }
+    StopTelemetrySink(&sink);
     if (DAQmxFailed(error))
         printf("DAQmx Error: %s\n", errBuff);
     printf("End of program, press Enter key to quit\n");
@@ -153,39 +240,49 @@ Error:
     return 0;
 }
 
+// Reads into a free ring slot, or into the scratch block when none is
+// free, and leaves the printing to the telemetry thread.
 int32 EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void* callbackData)
 {
     int32 error = 0;
     char errBuff[2048] = { '\0' };
-    static int totalRead = 0;
+    TelemetrySink* sink = (TelemetrySink*)callbackData;
+    uInt32 head = sink->head, slot = head & sink->mask, blockValues = (uInt32)sampsPerChan * sink->numChannels;
     int32 read = 0;
-    float64 data[sampsPerChan];
+    float64* data = sink->scratch;
     /* Change this variable to 1 if you are using a DSA device and want to check for Overloads. */
     int32 overloadDetectionEnabled = 0;
     bool32 overloaded = 0;
-    char overloadedChannels[1000];
+    char* overloadedChannels = sink->overloadedChannels + (size_t)sink->numBlocks * OverloadedChannelsSize;
+
+    if (head - RingLoadAcquire(&sink->tail) < sink->numBlocks)
+    {
+        data = sink->blocks + (size_t)slot * blockValues;
+        overloadedChannels = sink->overloadedChannels + (size_t)slot * OverloadedChannelsSize;
+    }
+    overloadedChannels[0] = '\0';
 
     /*********************************************/
     // DAQmx Read Code
     /*********************************************/
-    DAQmxErrChk(DAQmxReadAnalogF64(taskHandle, sampsPerChan, timeout, fillMode, data, sampsPerChan, &read, NULL));
+    DAQmxErrChk(DAQmxReadAnalogF64(taskHandle, sampsPerChan, timeout, fillMode, data, blockValues, &read, NULL));
     if (overloadDetectionEnabled)
     {
         DAQmxErrChk(DAQmxGetReadOverloadedChansExist(taskHandle, &overloaded));
     }
-
-    if (read > 0)
-        printf("Acquired %d samples. Total %d\n", (int)read, (int)(totalRead += read));
-    for (int i = 0; i < sampsPerChan; i++)
+    if (overloaded)
     {
-        printf("%.2f\n", data[i]);
+        DAQmxErrChk(DAQmxGetReadOverloadedChans(taskHandle, overloadedChannels, OverloadedChannelsSize));
     }
-    if (overloaded)
+
+    if (read > 0 && data == sink->scratch)
+        RingStoreRelease(&sink->skipped, sink->skipped + 1);
+    else if (read > 0)
     {
-        DAQmxErrChk(DAQmxGetReadOverloadedChans(taskHandle, overloadedChannels, 1000));
-        printf("Overloaded channels: %s\n", overloadedChannels);
+        sink->numRead[slot] = read;
+        RingStoreRelease(&sink->head, head + 1);
+        TelemetrySemaphorePost(&sink->ready);
     }
-    fflush(stdout);
 
 Error:
     if (DAQmxFailed(error))
@@ -218,3 +315,131 @@ Error:
     }
     return 0;
 }
+
+/*********************************************/
+// Telemetry Sink
+/*********************************************/
+int StartTelemetrySink(TelemetrySink* sink, uInt32 numChannels, uInt32 numBlocks)
+{
+    if (numBlocks < 1 || numBlocks > 0x80000000)
+        return 0;
+    // Round up to a power of two, so that head & mask survives the uInt32 wrap
+    while (numBlocks & (numBlocks - 1))
+        numBlocks += numBlocks & (~numBlocks + 1);
+    sink->numBlocks = numBlocks;
+    sink->mask = numBlocks - 1;
+    sink->numChannels = numChannels;
+    sink->blocks = (float64*)malloc(sizeof(float64) * (size_t)(numBlocks + 1) * sampsPerChan * numChannels);
+    sink->numRead = (int32*)malloc(sizeof(int32) * numBlocks);
+    sink->overloadedChannels = (char*)malloc((size_t)(numBlocks + 1) * OverloadedChannelsSize);
+    if (sink->blocks == NULL || sink->numRead == NULL || sink->overloadedChannels == NULL || !TelemetrySemaphoreInit(&sink->ready))
+        return 0;
+    sink->scratch = sink->blocks + (size_t)numBlocks * sampsPerChan * numChannels;
+    if (!TelemetryThreadCreate(&sink->thread, TelemetrySinkThread, sink))
+    {
+        TelemetrySemaphoreDestroy(&sink->ready);
+        return 0;
+    }
+    sink->running = 1;
+    return 1;
+}
+
+// Summarizes what is left in the ring and frees it. Stop the task first.
+void StopTelemetrySink(TelemetrySink* sink)
+{
+    if (sink->running)
+    {
+        RingStoreRelease(&sink->quit, 1);
+        TelemetrySemaphorePost(&sink->ready);
+        TelemetryThreadJoin(sink->thread);
+        TelemetrySemaphoreDestroy(&sink->ready);
+        sink->running = 0;
+    }
+    free(sink->blocks);
+    free(sink->numRead);
+    free(sink->overloadedChannels);
+    sink->blocks = sink->scratch = NULL;
+    sink->numRead = NULL;
+    sink->overloadedChannels = NULL;
+}
+
+// Accumulates the minimum, maximum and mean of each channel and prints
+// them every telemetryIntervalSeconds of acquired samples, along with the
+// channels last reported overloaded during the interval.
+TelemetryThreadResult TelemetryThreadCall TelemetrySinkThread(void* arg)
+{
+    TelemetrySink* sink = (TelemetrySink*)arg;
+    uInt32 numChannels = sink->numChannels, iChan, tail, slot, skipped = 0;
+    uInt64 intervalSamples = (uInt64)(telemetryIntervalSeconds * sampleRate), count = 0, total = 0;
+    int32 iSamp, numRead;
+    float64 *block, *min, *max, *sum, value;
+    char overloadedChannels[OverloadedChannelsSize] = { '\0' };
+
+    min = (float64*)malloc(sizeof(float64) * numChannels);
+    max = (float64*)malloc(sizeof(float64) * numChannels);
+    sum = (float64*)malloc(sizeof(float64) * numChannels);
+    if (intervalSamples < 1)
+        intervalSamples = 1;
+    for (;;)
+    {
+        TelemetrySemaphoreWait(&sink->ready);
+        tail = sink->tail;
+        slot = tail & sink->mask;
+        if (tail != RingLoadAcquire(&sink->head) && min && max && sum)
+        {
+            block = sink->blocks + (size_t)slot * sampsPerChan * numChannels;
+            numRead = sink->numRead[slot];
+            if (sink->overloadedChannels[(size_t)slot * OverloadedChannelsSize] != '\0')
+                strcpy(overloadedChannels, sink->overloadedChannels + (size_t)slot * OverloadedChannelsSize);
+            for (iSamp = 0; iSamp < numRead; ++iSamp)
+            {
+                for (iChan = 0; iChan < numChannels; ++iChan)
+                {
+                    value = fillMode == DAQmx_Val_GroupByScanNumber ? block[iSamp * numChannels + iChan] : block[iChan * numRead + iSamp];
+                    if (count == 0 || value < min[iChan])
+                        min[iChan] = value;
+                    if (count == 0 || value > max[iChan])
+                        max[iChan] = value;
+                    sum[iChan] = (count ? sum[iChan] : 0.0) + value;
+                }
+                ++total;
+                if (++count == intervalSamples)
+                {
+                    printf("Acquired %lu samples\n", (unsigned long)total);
+                    for (iChan = 0; iChan < numChannels; ++iChan)
+                        printf("  Channel %u: min %.2f  max %.2f  mean %.2f\n", (unsigned)iChan, min[iChan], max[iChan], sum[iChan] / count);
+                    if (overloadedChannels[0] != '\0')
+                    {
+                        printf("  Overloaded channels: %s\n", overloadedChannels);
+                        overloadedChannels[0] = '\0';
+                    }
+                    if (RingLoadAcquire(&sink->skipped) != skipped)
+                    {
+                        printf("  %u reads left out while the console was busy\n", (unsigned)(sink->skipped - skipped));
+                        skipped = sink->skipped;
+                    }
+                    fflush(stdout);
+                    count = 0;
+                }
+            }
+            RingStoreRelease(&sink->tail, tail + 1);
+        }
+        else if (tail != RingLoadAcquire(&sink->head))
+            RingStoreRelease(&sink->tail, tail + 1);
+        else if (RingLoadAcquire(&sink->quit))
+            break;
+    }
+    if (count)
+    {
+        printf("Acquired %lu samples\n", (unsigned long)total);
+        for (iChan = 0; iChan < numChannels; ++iChan)
+            printf("  Channel %u: min %.2f  max %.2f  mean %.2f\n", (unsigned)iChan, min[iChan], max[iChan], sum[iChan] / count);
+        if (overloadedChannels[0] != '\0')
+            printf("  Overloaded channels: %s\n", overloadedChannels);
+        fflush(stdout);
+    }
+    free(min);
+    free(max);
+    free(sum);
+    return 0;
+}
@@ -29,6 +29,12 @@
 *    9. Specify the appropriate Auto Zero Mode. See your device's
 *       hardware manual to find out if your device supports this
 *       attribute.
+*    10. Set telemetryIntervalSeconds. Rather than printing every
+*        sample, a telemetry thread prints the minimum, maximum and
+*        mean of each channel once per interval of acquired data.
+*    11. Set telemetryBlocks. This determines how many read blocks
+*        can wait for the telemetry thread while the console is slow.
+*    Note: On Linux, link the example with -pthread.
 *
 * Steps:
 *    1. Create a task.
@@ -38,13 +44,16 @@
 *    4. Call the Timing function to specify the hardware timing
 *       parameters. Use device's internal clock, continuous mode
 *       acquisition and the sample rate specified by the user.
-*    5. Call the Start function to program and start the acquisition.
-*    6. Read N samples and plot it. By default, the Read function
-*       reads all available samples, but you can specify how many
-*       samples to read at a time and the timeout value. Continue
-*       reading data until the stop button is pressed or an error
-*       occurs.
-*    7. Call the Clear Task function to clear the Task.
+*    5. Start the telemetry thread and call the Start function to
+*       program and start the acquisition.
+*    6. Read N samples into a free block of the telemetry ring. By
+*       default, the Read function reads all available samples, but
+*       you can specify how many samples to read at a time and the
+*       timeout value. The telemetry thread summarizes each block, so
+*       the callback never waits for the console. Continue reading
+*       data until the stop button is pressed or an error occurs.
+*    7. Call the Clear Task function to clear the Task, and stop the
+*       telemetry thread once it has printed the last summary.
 *    8. Display an error if any.
 *
 * I/O Connections Overview:
@@ -54,12 +63,69 @@
 *********************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <NIDAQmx.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#endif
 
 #define DAQmxErrChk(functionCall) if( DAQmxFailed(error=(functionCall)) ) goto Error; else
 
+#ifdef _WIN32
+typedef HANDLE		TelemetryThread;
+typedef HANDLE		TelemetrySemaphore;
+typedef DWORD		TelemetryThreadResult;
+#define TelemetryThreadCall						WINAPI
+#define TelemetryThreadCreate(thread,func,arg)	((*(thread)=CreateThread(NULL,0,(func),(arg),0,NULL))!=NULL)
+#define TelemetryThreadJoin(thread)				(WaitForSingleObject((thread),INFINITE),CloseHandle(thread))
+#define TelemetrySemaphoreInit(sem)				((*(sem)=CreateSemaphore(NULL,0,0x7FFFFFFF,NULL))!=NULL)
+#define TelemetrySemaphoreDestroy(sem)			CloseHandle(*(sem))
+#define TelemetrySemaphoreWait(sem)				WaitForSingleObject(*(sem),INFINITE)
+#define TelemetrySemaphorePost(sem)				ReleaseSemaphore(*(sem),1,NULL)
+#define RingLoadAcquire(ptr)					(MemoryBarrier(),*(ptr))
+#define RingStoreRelease(ptr,val)				(MemoryBarrier(),*(ptr)=(val))
+#else
+typedef pthread_t	TelemetryThread;
+typedef sem_t		TelemetrySemaphore;
+typedef void		*TelemetryThreadResult;
+#define TelemetryThreadCall
+#define TelemetryThreadCreate(thread,func,arg)	(pthread_create((thread),NULL,(func),(arg))==0)
+#define TelemetryThreadJoin(thread)				pthread_join((thread),NULL)
+#define TelemetrySemaphoreInit(sem)				(sem_init((sem),0,0)==0)
+#define TelemetrySemaphoreDestroy(sem)			sem_destroy(sem)
+#define TelemetrySemaphoreWait(sem)				while( sem_wait(sem) )
+#define TelemetrySemaphorePost(sem)				sem_post(sem)
+#define RingLoadAcquire(ptr)					__atomic_load_n((ptr),__ATOMIC_ACQUIRE)
+#define RingStoreRelease(ptr,val)				__atomic_store_n((ptr),(val),__ATOMIC_RELEASE)
+#endif
+
+// The ring of read blocks: EveryNCallback fills the slot at head and the
+// telemetry thread empties the slot at tail.
+typedef struct {
+	float64				*blocks;
+	int32				*numRead;		// Samples per channel read into each slot
+	float64				*scratch;		// Read into while every slot waits
+	uInt32				numBlocks;
+	uInt32				mask;			// numBlocks-1, numBlocks being a power of two
+	uInt32				numChannels;
+	uInt32				head;
+	uInt32				tail;
+	uInt32				skipped;		// Reads left out of the summaries
+	TelemetrySemaphore	ready;
+	TelemetryThread		thread;
+	int					running;
+	int					quit;
+} TelemetrySink;
+
 int32 EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData);
 int32 DoneCallback(TaskHandle taskHandle, int32 status, void *callbackData);
+int StartTelemetrySink(TelemetrySink *sink, uInt32 numChannels, uInt32 numBlocks);
+void StopTelemetrySink(TelemetrySink *sink);
+TelemetryThreadResult TelemetryThreadCall TelemetrySinkThread(void *arg);
+
 
 /*********************************************/
 // DAQmx Configuration Options
@@ -88,11 +154,19 @@ const uInt32 options = 0; // Use this parameter to set certain options. Pass a v
 const float64 timeout = 10.0; // The amount of time, in seconds, to wait for the function to read the sample(s).
 const bool32 fillMode = DAQmx_Val_GroupByScanNumber; // Specifies whether or not the samples are interleaved. Options: DAQmx_Val_GroupByChannel, DAQmx_Val_GroupByScanNumber
 
+/*********************************************/
+// Telemetry Options
+/*********************************************/
+const float64 telemetryIntervalSeconds = 5.0; // Seconds of temperatures per printed minimum, maximum and mean.
+const uInt32 telemetryBlocks = 4; // Read blocks queued for the telemetry thread, rounded up to a power of two. A read that finds the queue full is not summarized.
+
 int main(void)
 {
-	int32       error=0;
-	TaskHandle  taskHandle=0;
-	char        errBuff[2048]={'\0'};
+	int32           error=0;
+	TaskHandle      taskHandle=0;
+	uInt32          numChannels;
+	TelemetrySink   sink={0};
+	char            errBuff[2048]={'\0'};
 
 	/*********************************************/
 	// DAQmx Configure Code
@@ -100,10 +174,16 @@ int main(void)
 	DAQmxErrChk (DAQmxCreateTask("",&taskHandle));
 	DAQmxErrChk (DAQmxCreateAIThrmcplChan(taskHandle,physicalChannel,"",minVal,maxVal,units,thermocoupleType,cjcSource,cjcVal,cjcChannel));
 	DAQmxErrChk (DAQmxCfgSampClkTiming(taskHandle,clockSource,sampleRate,activeEdge,sampleMode,sampsPerChan));
+	DAQmxErrChk (DAQmxGetTaskNumChans(taskHandle,&numChannels));
 
-	DAQmxErrChk (DAQmxRegisterEveryNSamplesEvent(taskHandle,everyNsamplesEventType,nSamples,options,EveryNCallback,NULL));
+	DAQmxErrChk (DAQmxRegisterEveryNSamplesEvent(taskHandle,everyNsamplesEventType,nSamples,options,EveryNCallback,&sink));
 	DAQmxErrChk (DAQmxRegisterDoneEvent(taskHandle,0,DoneCallback,NULL));
 
+	if( !StartTelemetrySink(&sink,numChannels,telemetryBlocks) ) {
+		puts("Error: The telemetry thread could not be started.");
+		goto Error;
+	}
+
 	/*********************************************/
 	// DAQmx Start Code
 	/*********************************************/
@@ -122,6 +202,7 @@ Error:
 		DAQmxStopTask(taskHandle);
 		DAQmxClearTask(taskHandle);
 	}
+	StopTelemetrySink(&sink);
 	if( DAQmxFailed(error) )
 		printf("DAQmx Error: %s\n",errBuff);
 	printf("End of program, press Enter key to quit\n");
@@ -129,25 +210,29 @@ Error:
 	return 0;
 }
 
+// Queues each read for the telemetry thread and prints nothing itself.
 int32 EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData)
 {
-	int32       error=0;
-	char        errBuff[2048]={'\0'};
-	static int  totalRead=0;
-	int32       read=0;
-	float64     data[sampsPerChan];
+	int32           error=0;
+	char            errBuff[2048]={'\0'};
+	TelemetrySink   *sink=(TelemetrySink*)callbackData;
+	uInt32          head=sink->head,blockValues=(uInt32)sampsPerChan*sink->numChannels;
+	int32           read=0;
+	float64         *data=sink->scratch;
+
+	if( head-RingLoadAcquire(&sink->tail)<sink->numBlocks )
+		data = sink->blocks + (size_t)(head&sink->mask)*blockValues;
 
 	/*********************************************/
 	// DAQmx Read Code
 	/*********************************************/
-	DAQmxErrChk (DAQmxReadAnalogF64(taskHandle,sampsPerChan,timeout,fillMode,data,sampsPerChan,&read,NULL));
-	if( read>0 ) {
-		printf("Acquired %d samples. Total %d\n",(int)read,(int)(totalRead+=read));
-		for (int i = 0; i < sampsPerChan; i++)
-		{
-			printf("%.2f\n", data[i]);
-		}
-		fflush(stdout);
+	DAQmxErrChk (DAQmxReadAnalogF64(taskHandle,sampsPerChan,timeout,fillMode,data,blockValues,&read,NULL));
+	if( read>0 && data==sink->scratch )
+		RingStoreRelease(&sink->skipped,sink->skipped+1);
+	else if( read>0 ) {
+		sink->numRead[head&sink->mask] = read;
+		RingStoreRelease(&sink->head,head+1);
+		TelemetrySemaphorePost(&sink->ready);
 	}
 
 Error:
@@ -179,3 +264,108 @@ Error:
 	}
 	return 0;
 }
+
+/*********************************************/
+// Telemetry Sink
+/*********************************************/
+int StartTelemetrySink(TelemetrySink *sink, uInt32 numChannels, uInt32 numBlocks)
+{
+	if( numBlocks<1 || numBlocks>0x80000000 )
+		return 0;
+	// A power of two keeps the masked slots in order across the counter wrap
+	while( numBlocks&(numBlocks-1) )
+		numBlocks += numBlocks&(~numBlocks+1);
+	sink->numBlocks = numBlocks;
+	sink->mask = numBlocks - 1;
+	sink->numChannels = numChannels;
+	sink->blocks = (float64*)malloc(sizeof(float64)*(size_t)(numBlocks+1)*sampsPerChan*numChannels);
+	sink->numRead = (int32*)malloc(sizeof(int32)*numBlocks);
+	if( sink->blocks==NULL || sink->numRead==NULL || !TelemetrySemaphoreInit(&sink->ready) )
+		return 0;
+	sink->scratch = sink->blocks + (size_t)numBlocks*sampsPerChan*numChannels;
+	if( !TelemetryThreadCreate(&sink->thread,TelemetrySinkThread,sink) ) {
+		TelemetrySemaphoreDestroy(&sink->ready);
+		return 0;
+	}
+	sink->running = 1;
+	return 1;
+}
+
+// Drains and frees the ring once EveryNCallback can no longer run.
+void StopTelemetrySink(TelemetrySink *sink)
+{
+	if( sink->running ) {
+		RingStoreRelease(&sink->quit,1);
+		TelemetrySemaphorePost(&sink->ready);
+		TelemetryThreadJoin(sink->thread);
+		TelemetrySemaphoreDestroy(&sink->ready);
+		sink->running = 0;
+	}
+	free(sink->blocks);
+	free(sink->numRead);
+	sink->blocks = sink->scratch = NULL;
+	sink->numRead = NULL;
+}
+
+// Accumulates the minimum, maximum and mean of each channel and prints
+// them every telemetryIntervalSeconds of acquired samples, and once more
+// for the samples left when the sink stops.
+TelemetryThreadResult TelemetryThreadCall TelemetrySinkThread(void *arg)
+{
+	TelemetrySink   *sink=(TelemetrySink*)arg;
+	uInt32          numChannels=sink->numChannels,iChan,tail,skipped=0;
+	uInt64          intervalSamples=(uInt64)(telemetryIntervalSeconds*sampleRate),count=0,total=0;
+	int32           iSamp,numRead;
+	float64         *block,*min,*max,*sum,value;
+
+	min = (float64*)malloc(sizeof(float64)*numChannels);
+	max = (float64*)malloc(sizeof(float64)*numChannels);
+	sum = (float64*)malloc(sizeof(float64)*numChannels);
+	if( intervalSamples<1 )
+		intervalSamples = 1;
+	for(;;) {
+		TelemetrySemaphoreWait(&sink->ready);
+		tail = sink->tail;
+		if( tail!=RingLoadAcquire(&sink->head) && min && max && sum ) {
+			block = sink->blocks + (size_t)(tail&sink->mask)*sampsPerChan*numChannels;
+			numRead = sink->numRead[tail&sink->mask];
+			for(iSamp=0;iSamp<numRead;++iSamp) {
+				for(iChan=0;iChan<numChannels;++iChan) {
+					value = fillMode==DAQmx_Val_GroupByScanNumber ? block[iSamp*numChannels+iChan] : block[iChan*numRead+iSamp];
+					if( count==0 || value<min[iChan] )
+						min[iChan] = value;
+					if( count==0 || value>max[iChan] )
+						max[iChan] = value;
+					sum[iChan] = (count?sum[iChan]:0.0) + value;
+				}
+				++total;
+				if( ++count==intervalSamples ) {
+					printf("Acquired %lu samples\n",(unsigned long)total);
+					for(iChan=0;iChan<numChannels;++iChan)
+						printf("  Channel %u: min %.2f  max %.2f  mean %.2f\n",(unsigned)iChan,min[iChan],max[iChan],sum[iChan]/count);
+					if( RingLoadAcquire(&sink->skipped)!=skipped ) {
+						printf("  %u reads left out while the console was busy\n",(unsigned)(sink->skipped-skipped));
+						skipped = sink->skipped;
+					}
+					fflush(stdout);
+					count = 0;
+				}
+			}
+			RingStoreRelease(&sink->tail,tail+1);
+		}
+		else if( tail!=RingLoadAcquire(&sink->head) )
+			RingStoreRelease(&sink->tail,tail+1);
+		else if( RingLoadAcquire(&sink->quit) )
+			break;
+	}
+	if( count ) {
+		printf("Acquired %lu samples\n",(unsigned long)total);
+		for(iChan=0;iChan<numChannels;++iChan)
+			printf("  Channel %u: min %.2f  max %.2f  mean %.2f\n",(unsigned)iChan,min[iChan],max[iChan],sum[iChan]/count);
+		fflush(stdout);
+	}
+	free(min);
+	free(max);
+	free(sum);
+	return 0;
+}
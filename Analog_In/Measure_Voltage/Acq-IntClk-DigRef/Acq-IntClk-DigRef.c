@@ -22,6 +22,9 @@
 *          frequency component of the signal being acquired.
 *    5. Select the Source and Edge of the Digital Reference Trigger
 *       for the acquisition.
+*    6. Set telemetryIntervalSeconds. Rather than printing every
+*       sample, the example prints the minimum, maximum and mean of
+*       each channel once per interval of the acquired waveform.
 *
 * Steps:
 *    1. Create a task.
@@ -32,7 +35,8 @@
 *    5. Call the Start function to begin the acquisition.
 *    6. Use the Read function to retrieve the waveform. Set a timeout
 *       so an error is returned if the samples are not returned in
-*       the specified time limit.
+*       the specified time limit. Summarize the waveform one interval
+*       at a time.
 *    7. Call the Clear Task function to clear the Task.
 *    8. Display an error if any.
 *
@@ -45,10 +49,13 @@
 *********************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <NIDAQmx.h>
 
 #define DAQmxErrChk(functionCall) if( DAQmxFailed(error=(functionCall)) ) goto Error; else
 
+void PrintWaveformSummary(const float64 data[], int32 numRead, uInt32 numChannels);
+
 /*********************************************/
 // DAQmx Configuration Options
 /*********************************************/
@@ -77,12 +84,18 @@ const uInt32 pretriggerSamples = 5; // The minimum number of samples per channel
 const float64 timeout = 10; // The amount of time, in seconds, to wait for the function to read the sample(s).
 const bool32 fillMode = DAQmx_Val_GroupByScanNumber; // Specifies whether or not the samples are interleaved. Options: DAQmx_Val_GroupByChannel, DAQmx_Val_GroupByScanNumber
 
+/*********************************************/
+// Telemetry Options
+/*********************************************/
+const float64 telemetryIntervalSeconds = 0.1; // The acquisition time each printed summary covers. Each summary holds the minimum, maximum and mean of every channel.
+
 int main(void)
 {
 	int32       error=0;
 	TaskHandle  taskHandle=0;
 	int32       read;
-	float64     data[sampsPerChan];
+	uInt32      numChannels;
+	float64     *data=NULL;
 	char        errBuff[2048]={'\0'};
 
 	/*********************************************/
@@ -92,6 +105,12 @@ int main(void)
 	DAQmxErrChk (DAQmxCreateAIVoltageChan(taskHandle,physicalChannel,"",terminalConfig,minVal,maxVal,units,NULL));
 	DAQmxErrChk (DAQmxCfgSampClkTiming(taskHandle,clockSource,sampleRate,activeEdge,sampleMode,sampsPerChan));
 	DAQmxErrChk (DAQmxCfgDigEdgeRefTrig(taskHandle,refTriggerSource,refTriggerEdge,pretriggerSamples));
+	DAQmxErrChk (DAQmxGetTaskNumChans(taskHandle,&numChannels));
+	// Every channel of the task reads sampsPerChan samples
+	if( (data=(float64*)malloc(sizeof(float64)*(size_t)sampsPerChan*numChannels))==NULL ) {
+		puts("Error: Not enough memory for the samples.");
+		goto Error;
+	}
 
 	/*********************************************/
 	// DAQmx Start Code
@@ -101,15 +120,12 @@ int main(void)
 	/*********************************************/
 	// DAQmx Read Code
 	/*********************************************/
-	DAQmxErrChk (DAQmxReadAnalogF64(taskHandle,sampsPerChan,timeout,fillMode,data,sampsPerChan,&read,NULL));
+	DAQmxErrChk (DAQmxReadAnalogF64(taskHandle,sampsPerChan,timeout,fillMode,data,(uInt32)(sampsPerChan*numChannels),&read,NULL));
 
 	printf("Acquired %d points\n",(int)read);
 
 	// Display acquisition results
-	for (int i = 0; i < sampsPerChan; i++)
-	{
-		printf("%.2f\n", data[i]);
-	}
+	PrintWaveformSummary(data,read,numChannels);
 	printf("Press Enter key to end program.\n");
 
 Error:
@@ -122,9 +138,38 @@ Error:
 		DAQmxStopTask(taskHandle);
 		DAQmxClearTask(taskHandle);
 	}
+	free(data);
 	if( DAQmxFailed(error) )
 		printf("DAQmx Error: %s\n",errBuff);
 	printf("End of program, press Enter key to quit\n");
 	getchar();
 	return 0;
 }
+
+// Prints the minimum, maximum and mean of each channel for every
+// telemetryIntervalSeconds of the waveform, instead of every sample.
+void PrintWaveformSummary(const float64 data[], int32 numRead, uInt32 numChannels)
+{
+	int32       intervalSamples=(int32)(telemetryIntervalSeconds*sampleRate),first,count,iSamp;
+	uInt32      iChan;
+	float64     min,max,sum,value;
+
+	if( intervalSamples<1 )
+		intervalSamples = 1;
+	for(first=0;first<numRead;first+=intervalSamples) {
+		count = numRead-first<intervalSamples ? numRead-first : intervalSamples;
+		printf("Samples %d to %d\n",(int)first,(int)(first+count-1));
+		for(iChan=0;iChan<numChannels;++iChan) {
+			min = max = sum = 0.0;
+			for(iSamp=first;iSamp<first+count;++iSamp) {
+				value = fillMode==DAQmx_Val_GroupByScanNumber ? data[iSamp*numChannels+iChan] : data[iChan*numRead+iSamp];
+				if( iSamp==first || value<min )
+					min = value;
+				if( iSamp==first || value>max )
+					max = value;
+				sum += value;
+			}
+			printf("  Channel %u: min %.2f  max %.2f  mean %.2f\n",(unsigned)iChan,min,max,sum/count);
+		}
+	}
+}
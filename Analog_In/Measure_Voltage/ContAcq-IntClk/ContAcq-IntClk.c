@@ -22,16 +22,47 @@
 *       plotted on the graph each time.
 *    Note: The rate should be at least twice as fast as the maximum
 *          frequency component of the signal being acquired.
+*    4. Set telemetryIntervalSeconds. Rather than printing every
+*       sample, a telemetry thread prints the minimum, maximum and
+*       mean of each channel once per interval of acquired data.
+*    5. Set telemetryBlocks. This determines how many read blocks can
+*       wait for the telemetry thread while the console is slow.
+*    6. Set readRawCodes for high rates. The callback then reads the
+*       unscaled 16-bit codes, and the telemetry thread scales them
+*       with the device scaling polynomial of each channel.
+*    7. Set adaptiveReadSize to let the example choose how many
+*       samples to read at a time instead of using Samples per
+*       Channel. The read size stays between the sizes that
+*       maxLatencySeconds and maxReadsPerSecond allow, and grows when
+*       reading takes more than cpuBudget of the time or samples pile
+*       up in the buffer. Set tuningLogPath to record each read.
+*    8. Set latencyLogPath to record how close the acquisition comes
+*       to overflowing the buffer. Every latencyIntervalSeconds, the
+*       median, 99th and 99.9th percentile and maximum of the time
+*       between callbacks, the read time and the samples left in the
+*       buffer after a read are written to the file.
+*    Note: On Linux, link the example with -pthread.
 *
 * Steps:
 *    1. Create a task.
 *    2. Create an analog input voltage channel.
 *    3. Set the rate for the sample clock. Additionally, define the
 *       sample mode to be continuous.
-*    4. Call the Start function to start the acquistion.
+*    4. Start the telemetry thread and call the Start function to
+*       start the acquistion.
 *    5. Read the data in the EveryNCallback function until the stop
-*       button is pressed or an error occurs.
-*    6. Call the Clear Task function to clear the task.
+*       button is pressed or an error occurs. With adaptiveReadSize,
+*       the event comes every quantum of samples, and the callback
+*       only reads once the read size is available. Each read goes
+*       into a free block of a ring the telemetry thread summarizes,
+*       so the callback never waits for the console. With
+*       latencyLogPath, the callback also records its timing in
+*       histograms the telemetry thread writes out. When every block
+*       is still waiting, the read is left out of the summaries. With
+*       readRawCodes, the telemetry thread scales each block before
+*       it summarizes it.
+*    6. Call the Clear Task function to clear the task, and stop the
+*       telemetry thread once it has printed the last summary.
 *    7. Display an error if any.
 *
 * I/O Connections Overview:
@@ -39,15 +70,148 @@
 *    Channel I/O control. For further connection information, refer
 *    to your hardware reference manual.
 *
+* Limitations:
+*    readRawCodes requires a device whose raw samples are at most 16
+*    bits wide and units of DAQmx_Val_Volts, since the device scaling
+*    polynomial does not apply custom scales.
+*
 *********************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include <NIDAQmx.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SCALE_KERNELS
+#include <immintrin.h>
+#endif
 
 #define DAQmxErrChk(functionCall) if( DAQmxFailed(error=(functionCall)) ) goto Error; else
 
+#ifdef _WIN32
+typedef HANDLE		TelemetryThread;
+typedef HANDLE		TelemetrySemaphore;
+typedef DWORD		TelemetryThreadResult;
+#define TelemetryThreadCall						WINAPI
+#define TelemetryThreadCreate(thread,func,arg)	((*(thread)=CreateThread(NULL,0,(func),(arg),0,NULL))!=NULL)
+#define TelemetryThreadJoin(thread)				(WaitForSingleObject((thread),INFINITE),CloseHandle(thread))
+#define TelemetrySemaphoreInit(sem)				((*(sem)=CreateSemaphore(NULL,0,0x7FFFFFFF,NULL))!=NULL)
+#define TelemetrySemaphoreDestroy(sem)			CloseHandle(*(sem))
+#define TelemetrySemaphoreWait(sem)				WaitForSingleObject(*(sem),INFINITE)
+#define TelemetrySemaphorePost(sem)				ReleaseSemaphore(*(sem),1,NULL)
+#define RingLoadAcquire(ptr)					(MemoryBarrier(),*(ptr))
+#define RingStoreRelease(ptr,val)				(MemoryBarrier(),*(ptr)=(val))
+#else
+typedef pthread_t	TelemetryThread;
+typedef sem_t		TelemetrySemaphore;
+typedef void		*TelemetryThreadResult;
+#define TelemetryThreadCall
+#define TelemetryThreadCreate(thread,func,arg)	(pthread_create((thread),NULL,(func),(arg))==0)
+#define TelemetryThreadJoin(thread)				pthread_join((thread),NULL)
+#define TelemetrySemaphoreInit(sem)				(sem_init((sem),0,0)==0)
+#define TelemetrySemaphoreDestroy(sem)			sem_destroy(sem)
+#define TelemetrySemaphoreWait(sem)				while( sem_wait(sem) )
+#define TelemetrySemaphorePost(sem)				sem_post(sem)
+#define RingLoadAcquire(ptr)					__atomic_load_n((ptr),__ATOMIC_ACQUIRE)
+#define RingStoreRelease(ptr,val)				__atomic_store_n((ptr),(val),__ATOMIC_RELEASE)
+#endif
+
+// Scales numRead samples per channel of raw codes laid out in fillMode.
+// coeffs holds coefficient k of channel c at k*numChannels+c.
+typedef void (*ScaleCodesFunc)(const int16 *codes, int32 numRead, uInt32 numChannels, const float64 *coeffs, uInt32 numCoeffs, float64 *dst);
+
+// The read size of adaptiveReadSize. The sizes are samples per channel and
+// whole multiples of the quantum, the size of the Every N Samples event.
+typedef struct {
+	uInt32				quantum;
+	uInt32				minSize;		// From maxReadsPerSecond
+	uInt32				maxSize;		// From maxLatencySeconds
+	uInt32				size;			// Read once this many samples are available
+	float64				serviceTime;	// Smoothed seconds one read takes
+} ReadSizeTuner;
+
+// How the read of a block went, for the tuning log
+typedef struct {
+	float64				time;			// Of the read, in seconds since the sink started
+	uInt32				size;			// The read size after the read
+	uInt32				backlog;		// Samples per channel left in the buffer
+	float64				serviceTime;	// Seconds the read took
+} ReadStats;
+
+// A log-linear histogram in the manner of HdrHistogram. Values below 64 have a
+// bucket each, and each power of two above that is split into 32 buckets, so
+// a bucket is within 1/32 of the values it holds. One thread records into it
+// without locks while another writes summaries of it.
+#define LatencySubBuckets	32
+#define LatencyNumBuckets	(28*LatencySubBuckets)	// Up to the largest uInt32
+
+typedef struct {
+	const char			*name;
+	uInt32				limit;			// Where the buffer overflows, in the units of the values
+	uInt32				counts[LatencyNumBuckets];
+	uInt32				reported[LatencyNumBuckets];	// The counts at the last summary
+} LatencyHistogram;
+
+// Read blocks handed from EveryNCallback to the telemetry thread. The
+// callback reads into the slot at head, the thread summarizes the slot at
+// tail, and the slots between them wait. The blocks hold float64 values, or
+// int16 codes with readRawCodes.
+typedef struct {
+	void				*blocks;
+	int32				*numRead;		// Samples per channel read into each slot
+	void				*scratch;		// Read into while every slot waits
+	uInt32				numBlocks;
+	uInt32				mask;			// numBlocks-1, numBlocks being a power of two
+	uInt32				numChannels;
+	uInt32				blockSamps;		// Samples per channel a block holds
+	size_t				sampleBytes;
+	float64				*coeffs;		// Device scaling polynomials, with readRawCodes
+	uInt32				numCoeffs;
+	float64				*scaled;		// The block being summarized, scaled from the codes
+	ScaleCodesFunc		scale;
+	ReadSizeTuner		tuner;			// Used by EveryNCallback only
+	ReadStats			*stats;			// Of the read of each slot, with adaptiveReadSize
+	FILE				*tuningLog;
+	float64				startTime;
+	LatencyHistogram	interval;		// Microseconds between callbacks
+	LatencyHistogram	readTime;		// Microseconds a read takes
+	LatencyHistogram	backlog;		// Samples per channel left after a read
+	float64				lastCallback;
+	FILE				*latencyLog;
+	int					stopped;		// Set by DoneCallback when an error stops the task
+	uInt32				head;
+	uInt32				tail;
+	uInt32				skipped;		// Reads left out of the summaries
+	TelemetrySemaphore	ready;
+	TelemetryThread		thread;
+	int					running;
+	int					quit;
+} TelemetrySink;
+
 int32 EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData);
 int32 DoneCallback(TaskHandle taskHandle, int32 status, void *callbackData);
+int StartTelemetrySink(TelemetrySink *sink, uInt32 numChannels, uInt32 numBlocks);
+void StopTelemetrySink(TelemetrySink *sink);
+TelemetryThreadResult TelemetryThreadCall TelemetrySinkThread(void *arg);
+int GetScalingCoeffs(TaskHandle taskHandle, TelemetrySink *sink);
+float64 ScaleCode(int16 code, const float64 *coeffs, uInt32 numCoeffs, uInt32 numChannels, uInt32 iChan);
+void ScaleCodes(const int16 *codes, int32 numRead, uInt32 numChannels, const float64 *coeffs, uInt32 numCoeffs, float64 *dst);
+#ifdef HAVE_X86_SCALE_KERNELS
+void ScaleCodesAVX2(const int16 *codes, int32 numRead, uInt32 numChannels, const float64 *coeffs, uInt32 numCoeffs, float64 *dst);
+#endif
+ScaleCodesFunc SelectScaleCodesKernel(void);
+void InitReadSizeTuner(ReadSizeTuner *tuner);
+void TuneReadSize(ReadSizeTuner *tuner, uInt32 backlog, float64 serviceTime);
+double GetTimeInSeconds(void);
+void RecordLatency(LatencyHistogram *histogram, uInt32 value);
+uInt32 LatencyBucketValue(uInt32 bucket);
+void WriteLatencySummary(FILE *file, float64 time, LatencyHistogram *histogram);
 
 /*********************************************/
 // DAQmx Configuration Options
@@ -76,21 +240,69 @@ const uInt32 options = 0; // Use this parameter to set certain options. Pass a v
 const float64 timeout = 10; // The amount of time, in seconds, to wait for the function to read the sample(s).
 const bool32 fillMode = DAQmx_Val_GroupByScanNumber; // Specifies whether or not the samples are interleaved. Options: DAQmx_Val_GroupByChannel, DAQmx_Val_GroupByScanNumber
 
+/*********************************************/
+// Telemetry Options
+/*********************************************/
+const float64 telemetryIntervalSeconds = 1.0; // The acquisition time each printed summary covers. Each summary holds the minimum, maximum and mean of every channel.
+const uInt32 telemetryBlocks = 16; // The number of read blocks that can wait for the telemetry thread. Reads that arrive while all of them wait are left out of the summaries rather than delaying the acquisition. Rounded up to a power of two.
+
+/*********************************************/
+// Raw Read Options
+/*********************************************/
+const bool32 readRawCodes = FALSE; // Whether the callback reads unscaled 16-bit codes with DAQmxReadBinaryI16 instead of volts with DAQmxReadAnalogF64. The codes are a quarter of the size, and the telemetry thread scales them instead of the driver thread.
+
+/*********************************************/
+// Adaptive Read Options
+/*********************************************/
+const bool32 adaptiveReadSize = FALSE; // Whether the callback chooses how many samples to read at a time from the measured backlog and read time, instead of reading sampsPerChan samples.
+const float64 maxLatencySeconds = 0.1; // The longest a sample waits in the buffer before the read size is reached. This sets the largest read size.
+const float64 maxReadsPerSecond = 100.0; // The most Every N Samples events per second. This sets the smallest read size, and the quantum the read size is a multiple of.
+const float64 cpuBudget = 0.05; // The fraction of the time reads may take. The read size grows above it, and shrinks again below a quarter of it.
+const char *tuningLogPath = ""; // A CSV file to record the time, read size, backlog and read time of each read in. Leave it empty to record nothing.
+
+/*********************************************/
+// Latency Histogram Options
+/*********************************************/
+const char *latencyLogPath = ""; // A CSV file to write the percentiles of the time between callbacks, the read time and the backlog in. The Limit column holds the time the buffer lasts, or its size for the backlog, so Limit minus P99.9 is the margin before an overflow. Leave it empty to record nothing.
+const float64 latencyIntervalSeconds = 10.0; // How often the percentiles are written. Each line covers the callbacks since the line before.
+
 int main(void)
 {
-	int32       error=0;
-	TaskHandle  taskHandle=0;
-	char        errBuff[2048]={'\0'};
+	int32           error=0;
+	TaskHandle      taskHandle=0;
+	uInt32          numChannels,bufferSize;
+	TelemetrySink   sink={0};
+	char            errBuff[2048]={'\0'};
+
+	// The buffer holds a few reads of the largest size
+	if( adaptiveReadSize )
+		InitReadSizeTuner(&sink.tuner);
+	sink.blockSamps = adaptiveReadSize ? sink.tuner.maxSize : (uInt32)sampsPerChan;
 
 	/*********************************************/
 	// DAQmx Configure Code
 	/*********************************************/
 	DAQmxErrChk (DAQmxCreateTask("",&taskHandle));
 	DAQmxErrChk (DAQmxCreateAIVoltageChan(taskHandle,physicalChannel,"",terminalConfig,minVal,maxVal,units,NULL));
-	DAQmxErrChk (DAQmxCfgSampClkTiming(taskHandle,clockSource,sampleRate,activeEdge,sampleMode,sampsPerChan));
+	DAQmxErrChk (DAQmxCfgSampClkTiming(taskHandle,clockSource,sampleRate,activeEdge,sampleMode,adaptiveReadSize?4*(uInt64)sink.blockSamps:sampsPerChan));
+	DAQmxErrChk (DAQmxGetTaskNumChans(taskHandle,&numChannels));
 
-	DAQmxErrChk (DAQmxRegisterEveryNSamplesEvent(taskHandle,everyNsamplesEventType,sampsPerChan,options,EveryNCallback,NULL));
-	DAQmxErrChk (DAQmxRegisterDoneEvent(taskHandle,0,DoneCallback,NULL));
+	DAQmxErrChk (DAQmxRegisterEveryNSamplesEvent(taskHandle,everyNsamplesEventType,adaptiveReadSize?sink.tuner.quantum:(uInt32)sampsPerChan,options,EveryNCallback,&sink));
+	DAQmxErrChk (DAQmxRegisterDoneEvent(taskHandle,0,DoneCallback,&sink));
+
+	DAQmxErrChk (DAQmxGetBufInputBufSize(taskHandle,&bufferSize));
+	sink.interval.name = "CallbackIntervalMicroseconds";
+	sink.readTime.name = "ReadMicroseconds";
+	sink.backlog.name = "BacklogSamples";
+	sink.interval.limit = sink.readTime.limit = (uInt32)(1e6*bufferSize/sampleRate);
+	sink.backlog.limit = bufferSize;
+
+	if( !StartTelemetrySink(&sink,numChannels,telemetryBlocks) ) {
+		puts("Error: The telemetry thread could not be started.");
+		goto Error;
+	}
+	if( readRawCodes && !GetScalingCoeffs(taskHandle,&sink) )
+		goto Error;
 
 	/*********************************************/
 	// DAQmx Start Code
@@ -110,6 +322,7 @@ Error:
 		DAQmxStopTask(taskHandle);
 		DAQmxClearTask(taskHandle);
 	}
+	StopTelemetrySink(&sink);
 	if( DAQmxFailed(error) )
 		printf("DAQmx Error: %s\n",errBuff);
 	printf("End of program, press Enter key to quit\n");
@@ -117,25 +330,77 @@ Error:
 	return 0;
 }
 
+// Reads into the next free block of the telemetry ring and hands it to the
+// telemetry thread. Nothing is printed here, so a slow console cannot delay
+// the next read.
 int32 EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData)
 {
-	int32       error=0;
-	char        errBuff[2048]={'\0'};
-	static int  totalRead=0;
-	int32       read=0;
-	float64     data[sampsPerChan];
+	int32           error=0;
+	char            errBuff[2048]={'\0'};
+	TelemetrySink   *sink=(TelemetrySink*)callbackData;
+	ReadSizeTuner   *tuner=&sink->tuner;
+	uInt32          head=sink->head,slot=head&sink->mask,blockValues=sink->blockSamps*sink->numChannels;
+	uInt32          avail=0,backlog=0,toRead=(uInt32)sampsPerChan;
+	int32           read=0;
+	void            *data=sink->scratch;
+	float64         start,serviceTime;
+
+	start = GetTimeInSeconds();
+	if( sink->latencyLog ) {
+		if( sink->lastCallback>0.0 )
+			RecordLatency(&sink->interval,(uInt32)(1e6*(start-sink->lastCallback)));
+		sink->lastCallback = start;
+	}
+
+	// Leave the samples in the buffer until there are enough for the read
+	// size, then read the whole quanta that are there to catch up
+	if( adaptiveReadSize ) {
+		DAQmxErrChk (DAQmxGetReadAvailSampPerChan(taskHandle,&avail));
+		if( avail<tuner->size )
+			return 0;
+		toRead = avail/tuner->quantum*tuner->quantum;
+		if( toRead>tuner->maxSize )
+			toRead = tuner->maxSize;
+	}
+	if( head-RingLoadAcquire(&sink->tail)<sink->numBlocks )
+		data = (char*)sink->blocks + (size_t)slot*blockValues*sink->sampleBytes;
 
 	/*********************************************/
 	// DAQmx Read Code
 	/*********************************************/
-	DAQmxErrChk (DAQmxReadAnalogF64(taskHandle,sampsPerChan,fillMode,fillMode,data,sampsPerChan,&read,NULL));
-	if( read>0 ) {
-		printf("Acquired %d samples. Total %d\n",(int)read,(int)(totalRead+=read));
-		for (int i = 0; i < sampsPerChan; i++)
-		{
-			printf("%.2f\n", data[i]);
+	start = GetTimeInSeconds();
+	if( readRawCodes ) {
+		DAQmxErrChk (DAQmxReadBinaryI16(taskHandle,toRead,timeout,fillMode,(int16*)data,blockValues,&read,NULL));
+	}
+	else {
+		DAQmxErrChk (DAQmxReadAnalogF64(taskHandle,toRead,timeout,fillMode,(float64*)data,blockValues,&read,NULL));
+	}
+	serviceTime = GetTimeInSeconds() - start;
+
+	// The samples left in the buffer after the read
+	if( adaptiveReadSize )
+		backlog = avail>(uInt32)read ? avail-read : 0;
+	else if( sink->latencyLog ) {
+		DAQmxErrChk (DAQmxGetReadAvailSampPerChan(taskHandle,&backlog));
+	}
+	if( adaptiveReadSize && read>0 )
+		TuneReadSize(tuner,backlog,serviceTime);
+	if( sink->latencyLog ) {
+		RecordLatency(&sink->readTime,(uInt32)(1e6*serviceTime));
+		RecordLatency(&sink->backlog,backlog);
+	}
+	if( read>0 && data==sink->scratch )
+		RingStoreRelease(&sink->skipped,sink->skipped+1);
+	else if( read>0 ) {
+		sink->numRead[slot] = read;
+		if( adaptiveReadSize ) {
+			sink->stats[slot].time = start - sink->startTime;
+			sink->stats[slot].size = tuner->size;
+			sink->stats[slot].backlog = backlog;
+			sink->stats[slot].serviceTime = serviceTime;
 		}
-		fflush(stdout);
+		RingStoreRelease(&sink->head,head+1);
+		TelemetrySemaphorePost(&sink->ready);
 	}
 
 Error:
@@ -151,19 +416,427 @@ Error:
 	return 0;
 }
 
+// When an error stops the task, has the telemetry thread write the latency
+// histograms right away, so the file shows the callbacks that led up to it.
 int32 DoneCallback(TaskHandle taskHandle, int32 status, void *callbackData)
 {
-	int32   error=0;
-	char    errBuff[2048]={'\0'};
+	int32           error=0;
+	char            errBuff[2048]={'\0'};
+	TelemetrySink   *sink=(TelemetrySink*)callbackData;
 
 	// Check to see if an error stopped the task.
 	DAQmxErrChk (status);
 
 Error:
 	if( DAQmxFailed(error) ) {
+		if( sink->running ) {
+			RingStoreRelease(&sink->stopped,1);
+			TelemetrySemaphorePost(&sink->ready);
+		}
 		DAQmxGetExtendedErrorInfo(errBuff,2048);
 		DAQmxClearTask(taskHandle);
 		printf("DAQmx Error: %s\n",errBuff);
 	}
 	return 0;
 }
+
+/*********************************************/
+// Telemetry Sink
+/*********************************************/
+int StartTelemetrySink(TelemetrySink *sink, uInt32 numChannels, uInt32 numBlocks)
+{
+	if( numBlocks<1 || numBlocks>0x80000000 )
+		return 0;
+	// Rounded up to a power of two by carrying its lowest bit, so that the
+	// free-running head and tail still map onto the slots when they wrap
+	while( numBlocks&(numBlocks-1) )
+		numBlocks += numBlocks&(~numBlocks+1);
+	sink->numBlocks = numBlocks;
+	sink->mask = numBlocks - 1;
+	sink->numChannels = numChannels;
+	sink->sampleBytes = readRawCodes ? sizeof(int16) : sizeof(float64);
+	sink->blocks = malloc(sink->sampleBytes*(size_t)(numBlocks+1)*sink->blockSamps*numChannels);
+	sink->numRead = (int32*)malloc(sizeof(int32)*numBlocks);
+	if( sink->blocks==NULL || sink->numRead==NULL )
+		return 0;
+	if( readRawCodes ) {
+		if( (sink->scaled=(float64*)malloc(sizeof(float64)*sink->blockSamps*numChannels))==NULL )
+			return 0;
+		sink->scale = SelectScaleCodesKernel();
+	}
+	if( adaptiveReadSize ) {
+		if( (sink->stats=(ReadStats*)malloc(sizeof(ReadStats)*numBlocks))==NULL )
+			return 0;
+		if( *tuningLogPath ) {
+			if( (sink->tuningLog=fopen(tuningLogPath,"w"))==NULL ) {
+				printf("Error: Could not create the tuning log %s.\n",tuningLogPath);
+				return 0;
+			}
+			fprintf(sink->tuningLog,"Seconds,SamplesRead,ReadSize,Backlog,ReadMicroseconds\n");
+		}
+	}
+	if( *latencyLogPath ) {
+		if( (sink->latencyLog=fopen(latencyLogPath,"w"))==NULL ) {
+			printf("Error: Could not create the latency log %s.\n",latencyLogPath);
+			return 0;
+		}
+		fprintf(sink->latencyLog,"Seconds,Histogram,Count,P50,P99,P99.9,Max,Limit\n");
+	}
+	if( !TelemetrySemaphoreInit(&sink->ready) )
+		return 0;
+	sink->startTime = GetTimeInSeconds();
+	sink->scratch = (char*)sink->blocks + sink->sampleBytes*numBlocks*sink->blockSamps*numChannels;
+	if( !TelemetryThreadCreate(&sink->thread,TelemetrySinkThread,sink) ) {
+		TelemetrySemaphoreDestroy(&sink->ready);
+		return 0;
+	}
+	sink->running = 1;
+	return 1;
+}
+
+// Lets the telemetry thread summarize the blocks still waiting, then frees
+// the ring. Call it once the task no longer calls EveryNCallback.
+void StopTelemetrySink(TelemetrySink *sink)
+{
+	if( sink->running ) {
+		RingStoreRelease(&sink->quit,1);
+		TelemetrySemaphorePost(&sink->ready);
+		TelemetryThreadJoin(sink->thread);
+		TelemetrySemaphoreDestroy(&sink->ready);
+		sink->running = 0;
+	}
+	free(sink->blocks);
+	free(sink->numRead);
+	free(sink->coeffs);
+	free(sink->scaled);
+	free(sink->stats);
+	if( sink->tuningLog )
+		fclose(sink->tuningLog);
+	if( sink->latencyLog )
+		fclose(sink->latencyLog);
+	sink->blocks = sink->scratch = NULL;
+	sink->numRead = NULL;
+	sink->coeffs = sink->scaled = NULL;
+	sink->stats = NULL;
+	sink->tuningLog = sink->latencyLog = NULL;
+}
+
+// Accumulates the minimum, maximum and mean of each channel and prints
+// them every telemetryIntervalSeconds of acquired samples, and once more
+// for the samples left when the sink stops. Also writes the latency
+// histograms every latencyIntervalSeconds, after an error and at the end.
+TelemetryThreadResult TelemetryThreadCall TelemetrySinkThread(void *arg)
+{
+	TelemetrySink   *sink=(TelemetrySink*)arg;
+	uInt32          numChannels=sink->numChannels,iChan,tail,slot,skipped=0;
+	ReadStats       stats={0};
+	uInt64          intervalSamples=(uInt64)(telemetryIntervalSeconds*sampleRate),count=0,total=0;
+	int32           iSamp,numRead;
+	float64         *block,*min,*max,*sum,value,now,nextLatency=sink->startTime+latencyIntervalSeconds;
+	int             last=0;
+
+	min = (float64*)malloc(sizeof(float64)*numChannels);
+	max = (float64*)malloc(sizeof(float64)*numChannels);
+	sum = (float64*)malloc(sizeof(float64)*numChannels);
+	if( intervalSamples<1 )
+		intervalSamples = 1;
+	while( !last ) {
+		TelemetrySemaphoreWait(&sink->ready);
+		tail = sink->tail;
+		if( tail!=RingLoadAcquire(&sink->head) && min && max && sum ) {
+			slot = tail&sink->mask;
+			block = (float64*)((char*)sink->blocks + (size_t)slot*sink->blockSamps*numChannels*sink->sampleBytes);
+			numRead = sink->numRead[slot];
+			if( adaptiveReadSize ) {
+				stats = sink->stats[slot];
+				if( sink->tuningLog )
+					fprintf(sink->tuningLog,"%.6f,%d,%u,%u,%.1f\n",stats.time,(int)numRead,(unsigned)stats.size,(unsigned)stats.backlog,stats.serviceTime*1e6);
+			}
+			if( readRawCodes ) {
+				sink->scale((const int16*)block,numRead,numChannels,sink->coeffs,sink->numCoeffs,sink->scaled);
+				block = sink->scaled;
+			}
+			for(iSamp=0;iSamp<numRead;++iSamp) {
+				for(iChan=0;iChan<numChannels;++iChan) {
+					value = fillMode==DAQmx_Val_GroupByScanNumber ? block[iSamp*numChannels+iChan] : block[iChan*numRead+iSamp];
+					if( count==0 || value<min[iChan] )
+						min[iChan] = value;
+					if( count==0 || value>max[iChan] )
+						max[iChan] = value;
+					sum[iChan] = (count?sum[iChan]:0.0) + value;
+				}
+				++total;
+				if( ++count==intervalSamples ) {
+					printf("Acquired %lu samples\n",(unsigned long)total);
+					for(iChan=0;iChan<numChannels;++iChan)
+						printf("  Channel %u: min %.2f  max %.2f  mean %.2f\n",(unsigned)iChan,min[iChan],max[iChan],sum[iChan]/count);
+					if( adaptiveReadSize )
+						printf("  Read size %u samples, %u samples left in the buffer\n",(unsigned)stats.size,(unsigned)stats.backlog);
+					if( RingLoadAcquire(&sink->skipped)!=skipped ) {
+						printf("  %u reads left out while the console was busy\n",(unsigned)(sink->skipped-skipped));
+						skipped = sink->skipped;
+					}
+					fflush(stdout);
+					count = 0;
+				}
+			}
+			RingStoreRelease(&sink->tail,tail+1);
+		}
+		else if( tail!=RingLoadAcquire(&sink->head) )
+			RingStoreRelease(&sink->tail,tail+1);
+		else if( RingLoadAcquire(&sink->quit) )
+			last = 1;
+		now = GetTimeInSeconds();
+		if( sink->latencyLog && (now>=nextLatency || RingLoadAcquire(&sink->stopped) || last) ) {
+			WriteLatencySummary(sink->latencyLog,now-sink->startTime,&sink->interval);
+			WriteLatencySummary(sink->latencyLog,now-sink->startTime,&sink->readTime);
+			WriteLatencySummary(sink->latencyLog,now-sink->startTime,&sink->backlog);
+			fflush(sink->latencyLog);
+			RingStoreRelease(&sink->stopped,0);
+			while( nextLatency<=now )
+				nextLatency += latencyIntervalSeconds;
+		}
+	}
+	if( count ) {
+		printf("Acquired %lu samples\n",(unsigned long)total);
+		for(iChan=0;iChan<numChannels;++iChan)
+			printf("  Channel %u: min %.2f  max %.2f  mean %.2f\n",(unsigned)iChan,min[iChan],max[iChan],sum[iChan]/count);
+		fflush(stdout);
+	}
+	free(min);
+	free(max);
+	free(sum);
+	return 0;
+}
+
+/*********************************************/
+// Raw Code Scaling
+/*********************************************/
+// Gets the device scaling polynomial of each channel, which turns the codes
+// DAQmxReadBinaryI16 returns into volts. Channels with fewer coefficients
+// than the others get zeros for the missing ones.
+int GetScalingCoeffs(TaskHandle taskHandle, TelemetrySink *sink)
+{
+	int32       error=0,numCoeffs;
+	uInt32      iChan,iCoeff,rawSampSize,numChannels=sink->numChannels;
+	char        channelName[256],errBuff[2048]={'\0'};
+	float64     chanCoeffs[16];
+
+	if( units!=DAQmx_Val_Volts ) {
+		puts("Error: readRawCodes requires units of DAQmx_Val_Volts.");
+		return 0;
+	}
+	sink->numCoeffs = 0;
+	for(iChan=0;iChan<numChannels;++iChan) {
+		DAQmxErrChk (DAQmxGetNthTaskChannel(taskHandle,iChan+1,channelName,256));
+		DAQmxErrChk (DAQmxGetAIRawSampSize(taskHandle,channelName,&rawSampSize));
+		DAQmxErrChk (numCoeffs=DAQmxGetAIDevScalingCoeff(taskHandle,channelName,NULL,0));
+		if( rawSampSize>16 || numCoeffs>16 ) {
+			printf("Error: The raw samples of %s do not fit the 16-bit codes of readRawCodes.\n",channelName);
+			return 0;
+		}
+		if( (uInt32)numCoeffs>sink->numCoeffs )
+			sink->numCoeffs = numCoeffs;
+	}
+	if( (sink->coeffs=(float64*)calloc((size_t)sink->numCoeffs*numChannels,sizeof(float64)))==NULL ) {
+		puts("Error: Not enough memory for the scaling coefficients.");
+		return 0;
+	}
+	for(iChan=0;iChan<numChannels;++iChan) {
+		DAQmxErrChk (DAQmxGetNthTaskChannel(taskHandle,iChan+1,channelName,256));
+		DAQmxErrChk (numCoeffs=DAQmxGetAIDevScalingCoeff(taskHandle,channelName,NULL,0));
+		DAQmxErrChk (DAQmxGetAIDevScalingCoeff(taskHandle,channelName,chanCoeffs,numCoeffs));
+		for(iCoeff=0;iCoeff<(uInt32)numCoeffs;++iCoeff)
+			sink->coeffs[iCoeff*numChannels+iChan] = chanCoeffs[iCoeff];
+	}
+
+Error:
+	if( DAQmxFailed(error) ) {
+		DAQmxGetExtendedErrorInfo(errBuff,2048);
+		printf("DAQmx Error: %s\n",errBuff);
+		return 0;
+	}
+	return 1;
+}
+
+// Evaluates the polynomial of channel iChan at code by Horner's rule
+float64 ScaleCode(int16 code, const float64 *coeffs, uInt32 numCoeffs, uInt32 numChannels, uInt32 iChan)
+{
+	float64     scaled=0.0;
+
+	while( numCoeffs>0 )
+		scaled = scaled*code + coeffs[--numCoeffs*numChannels+iChan];
+	return scaled;
+}
+
+void ScaleCodes(const int16 *codes, int32 numRead, uInt32 numChannels, const float64 *coeffs, uInt32 numCoeffs, float64 *dst)
+{
+	size_t      numValues=(size_t)numRead*numChannels,i;
+	uInt32      iChan;
+
+	for(i=0;i<numValues;++i) {
+		iChan = fillMode==DAQmx_Val_GroupByScanNumber ? (uInt32)(i%numChannels) : (uInt32)(i/numRead);
+		dst[i] = ScaleCode(codes[i],coeffs,numCoeffs,numChannels,iChan);
+	}
+}
+
+#ifdef HAVE_X86_SCALE_KERNELS
+// Widens 4 codes at a time to doubles and runs Horner's rule in every lane.
+// Interleaved scans take the coefficients of 4 neighbouring channels, and
+// the samples of one channel broadcast its coefficients. The multiply and
+// add are kept apart so every lane rounds like ScaleCodes.
+__attribute__((target("avx2")))
+void ScaleCodesAVX2(const int16 *codes, int32 numRead, uInt32 numChannels, const float64 *coeffs, uInt32 numCoeffs, float64 *dst)
+{
+	const int16     *src;
+	float64         *out;
+	__m256d         val,scaled;
+	int32           iSamp;
+	uInt32          iChan,iCoeff;
+
+	if( fillMode==DAQmx_Val_GroupByScanNumber ) {
+		for(iSamp=0;iSamp<numRead;++iSamp) {
+			src = codes + (size_t)iSamp*numChannels;
+			out = dst + (size_t)iSamp*numChannels;
+			for(iChan=0;iChan+4<=numChannels;iChan+=4) {
+				val = _mm256_cvtepi32_pd(_mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)(src+iChan))));
+				for(scaled=_mm256_setzero_pd(),iCoeff=numCoeffs;iCoeff>0;--iCoeff)
+					scaled = _mm256_add_pd(_mm256_mul_pd(scaled,val),_mm256_loadu_pd(coeffs+(iCoeff-1)*numChannels+iChan));
+				_mm256_storeu_pd(out+iChan,scaled);
+			}
+			for(;iChan<numChannels;++iChan)
+				out[iChan] = ScaleCode(src[iChan],coeffs,numCoeffs,numChannels,iChan);
+		}
+	}
+	else {
+		for(iChan=0;iChan<numChannels;++iChan) {
+			src = codes + (size_t)iChan*numRead;
+			out = dst + (size_t)iChan*numRead;
+			for(iSamp=0;iSamp+4<=numRead;iSamp+=4) {
+				val = _mm256_cvtepi32_pd(_mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)(src+iSamp))));
+				for(scaled=_mm256_setzero_pd(),iCoeff=numCoeffs;iCoeff>0;--iCoeff)
+					scaled = _mm256_add_pd(_mm256_mul_pd(scaled,val),_mm256_broadcast_sd(coeffs+(iCoeff-1)*numChannels+iChan));
+				_mm256_storeu_pd(out+iSamp,scaled);
+			}
+			for(;iSamp<numRead;++iSamp)
+				out[iSamp] = ScaleCode(src[iSamp],coeffs,numCoeffs,numChannels,iChan);
+		}
+	}
+}
+#endif
+
+ScaleCodesFunc SelectScaleCodesKernel(void)
+{
+#ifdef HAVE_X86_SCALE_KERNELS
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx2") )
+		return ScaleCodesAVX2;
+#endif
+	return ScaleCodes;
+}
+
+/*********************************************/
+// Adaptive Read Size
+/*********************************************/
+// Starts at the smallest size, which has the least latency. When the two
+// targets conflict, the latency target wins.
+void InitReadSizeTuner(ReadSizeTuner *tuner)
+{
+	tuner->quantum = (uInt32)(sampleRate/maxReadsPerSecond);
+	if( tuner->quantum<1 )
+		tuner->quantum = 1;
+	tuner->maxSize = (uInt32)(sampleRate*maxLatencySeconds)/tuner->quantum*tuner->quantum;
+	if( tuner->maxSize<tuner->quantum ) {
+		tuner->quantum = (uInt32)(sampleRate*maxLatencySeconds);
+		if( tuner->quantum<1 )
+			tuner->quantum = 1;
+		tuner->maxSize = tuner->quantum;
+	}
+	tuner->minSize = tuner->size = tuner->quantum;
+	tuner->serviceTime = 0.0;
+}
+
+// Doubles the read size while reads take more than cpuBudget of the time or
+// fall behind, and halves it once they take less than a quarter of it with
+// the buffer drained. The gap between the two keeps the size from
+// alternating.
+void TuneReadSize(ReadSizeTuner *tuner, uInt32 backlog, float64 serviceTime)
+{
+	float64     load;
+	uInt32      size=tuner->size;
+
+	tuner->serviceTime = tuner->serviceTime>0.0 ? tuner->serviceTime+(serviceTime-tuner->serviceTime)/8 : serviceTime;
+	load = tuner->serviceTime*sampleRate/size;
+	if( (load>cpuBudget || backlog>=size) && size<tuner->maxSize )
+		size = 2*size<tuner->maxSize ? 2*size : tuner->maxSize;
+	else if( load<cpuBudget/4 && backlog<tuner->quantum && size>tuner->minSize )
+		size = size/2>tuner->minSize ? size/2 : tuner->minSize;
+	tuner->size = size/tuner->quantum*tuner->quantum;
+}
+
+/*********************************************/
+// Latency Histograms
+/*********************************************/
+// Called by the one thread that records into the histogram. The reading
+// thread sees each count either before or after the increment.
+void RecordLatency(LatencyHistogram *histogram, uInt32 value)
+{
+	uInt32      shift=0,bucket;
+
+	while( (value>>shift)>=2*LatencySubBuckets )
+		++shift;
+	bucket = shift*LatencySubBuckets + (value>>shift);
+	RingStoreRelease(&histogram->counts[bucket],histogram->counts[bucket]+1);
+}
+
+// The largest value that falls into the bucket
+uInt32 LatencyBucketValue(uInt32 bucket)
+{
+	uInt32      shift=bucket<2*LatencySubBuckets ? 0 : bucket/LatencySubBuckets-1;
+
+	return (uInt32)(((uInt64)(bucket-shift*LatencySubBuckets+1)<<shift)-1);
+}
+
+// Writes the percentiles of the values recorded since the last summary.
+// Each is the largest value of its bucket, so it errs on the side of less
+// margin. Nothing is written when there are no new values.
+void WriteLatencySummary(FILE *file, float64 time, LatencyHistogram *histogram)
+{
+	static const uInt32	perMille[3]={500,990,999};
+	uInt32				delta[LatencyNumBuckets],bucket,i=0,maxBucket=0;
+	uInt32				values[3]={0};
+	uInt64				total=0,count=0;
+
+	for(bucket=0;bucket<LatencyNumBuckets;++bucket) {
+		delta[bucket] = RingLoadAcquire(&histogram->counts[bucket]) - histogram->reported[bucket];
+		histogram->reported[bucket] += delta[bucket];
+		if( delta[bucket] ) {
+			total += delta[bucket];
+			maxBucket = bucket;
+		}
+	}
+	if( total==0 )
+		return;
+	for(bucket=0;bucket<=maxBucket && i<3;++bucket) {
+		count += delta[bucket];
+		while( i<3 && count*1000>=total*perMille[i] )
+			values[i++] = LatencyBucketValue(bucket);
+	}
+	fprintf(file,"%.3f,%s,%lu,%lu,%lu,%lu,%lu,%lu\n",time,histogram->name,(unsigned long)total,(unsigned long)values[0],(unsigned long)values[1],(unsigned long)values[2],(unsigned long)LatencyBucketValue(maxBucket),(unsigned long)histogram->limit);
+}
+
+double GetTimeInSeconds(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER	frequency,counter;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart/frequency.QuadPart;
+#else
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return now.tv_sec + now.tv_nsec*1e-9;
+#endif
+}
@@ -14,7 +14,10 @@
 *
 * Instructions for Running:
 *    1. Select the physical channel to correspond to where your
-*       signal is input on the DAQ device.
+*       signal is input on the DAQ device. Add an entry to
+*       taskChannels for every device to stream, for example one per
+*       DSA device or cDAQ chassis. Each entry becomes a task, and the
+*       blocks of all tasks are interleaved into the same file.
 *    2. Enter the minimum and maximum voltage ranges.
 *    Note: For better accuracy try to match the input range to the
 *          expected voltage level of the measured signal.
@@ -25,22 +28,81 @@
 *       signal being acquired.
 *    Note: The rate should be at least twice as fast as the maximum
 *          frequency component of the signal being acquired.
-*    4. Select the raw compression configuration.
+*    4. Select the raw compression configuration. Optionally set
+*       calibrateLossySampleSize to pick the LossyLSBRemoval sample
+*       size from the noise measured on each channel before streaming.
+*       Every channel keeps the bits whose removal adds at most
+*       lossyErrorBudget of its noise floor in RMS. The noise floor and
+*       the largest error of every channel are written to the header.
 *    5. Select the File Properties.
+*    6. Set numRingBlocks. This determines how many read blocks can
+*       wait in memory for the disk writer thread during a disk stall.
+*    7. Select the write engine. The default engine writes through the
+*       C library. On Linux, the pwrite and io_uring engines bypass the
+*       page cache with aligned O_DIRECT writes into a preallocated
+*       file. Their files are marked UnorderedWrites in the header, and
+*       a block is only added to the block index once every byte up to
+*       its end is in the file, so the Graph Acquired Compacted Data
+*       example can follow them. On other platforms the C library
+*       engine is the only one.
+*    8. Optionally set benchmarkWriteMegabytes to compare the write
+*       engines on the data file path instead of acquiring data.
+*    9. Set writeBlockIndex to write a block index next to the data
+*       file. The Graph Acquired Compacted Data example uses it to
+*       decode a sample or time range without reading the blocks
+*       before it.
+*    10. Optionally set segmentMegabytes or segmentSeconds to rotate
+*       the stream through numbered segment files, for example
+*       stream-00000.cfg, stream-00001.cfg and so on. Each segment is
+*       a complete data file with its own header and block index.
+*       When the next segment cannot be opened, the current one keeps
+*       growing and the open is retried every second.
+*    11. Optionally set deltaEncodeBlocks to shrink slowly varying
+*       signals further than the hardware compression does. The disk
+*       writer thread stores each channel of a block as the
+*       differences between its samples, at the width the largest
+*       difference needs. The compression ratio and the encoder
+*       throughput are displayed at the end.
+*    12. Optionally set readAvailableSamples to read every sample
+*       acquired so far in each callback, up to maxSamplesPerRead,
+*       rather than exactly 1000. The Every N Samples event then fires
+*       every readEventSeconds of samples instead of every 1000
+*       samples, so at high rates the callbacks are fewer and each
+*       reads a larger block. Every block then starts with its own number of
+*       samples per channel, so the blocks of a file may differ in size.
+*       Without it, a read that returns fewer than 1000 samples is
+*       dropped rather than written as a full block.
+*    13. Optionally set writeBlockChecksums to end every block with a
+*       CRC32C of the block and the fields before it. The Graph
+*       Acquired Compacted Data example then reports corrupt blocks
+*       and resumes at the next good one instead of stopping. The
+*       checksum is computed with the SSE4.2 crc32 instruction where
+*       the processor has it.
+*    Note: On Linux, link the example with -pthread.
 *
 * Steps:
-*    1. Create a task.
+*    1. Create a task for each entry of taskChannels.
 *    2. Create an analog input voltage channel.
-*    3. Set the compression attributes.
+*    3. Set the compression attributes. If requested, acquire a short
+*       burst to measure the noise floor of each channel and set the
+*       compressed sample size from it.
 *    4. Set the rate for the sample clock. Additionally, define the
 *       sample mode to be continuous.
-*    5. Create a header and write it to the binary file.
-*    6. Call the Start function to start the acquistion.
-*    7. Read the raw data and write the data to the file in a loop
-*       until the stop button is pressed or an error occurs.
-*    8. Close the File.
-*    9. Call the Clear Task function to clear the task.
-*    10. Display an error if any.
+*    5. Create a header and write it to the binary file. When the
+*       stream rotates, start the thread that opens the next segment
+*       ahead of time.
+*    6. Start the disk writer thread and call the Start function to
+*       start the acquistion.
+*    7. Read the raw data into a ring of preallocated blocks in a loop
+*       until the stop button is pressed or an error occurs. Each task
+*       has its own ring, and each slot holds the samples of one read. The disk writer thread drains the rings to
+*       the file oldest block first, so a slow disk does not delay the
+*       next read, and delta encodes them first if requested. When a
+*       segment is full, the disk writer thread switches to the
+*       segment opened ahead of time.
+*    8. Drain the rings and close the File and the block index.
+*    9. Call the Clear Task function to clear the tasks.
+*    10. Display the ring and encoding statistics and an error if any.
 *
 * I/O Connections Overview:
 *    Make sure your signal input terminal matches the Physical
@@ -55,35 +117,389 @@
 *    The example does not handle tasks containing channels from
 *    multiple DSA devices with a compression type of "None". The
 *    decompaction examples will not extract the samples from the file
-*    correctly.
+*    correctly. Create one task per DSA device instead.
 *
 *    For cDAQ, the order of channels in the raw data is likely to not
-*    be the same as the order specified in the task. The example does
-*    not handle this case and the scaled data returned by the
-*    decompaction example will not be correct.
+*    be the same as the order specified in the task. The example
+*    writes the channels of a multi-task file in task order in the
+*    ChannelMap of each task. Correct the ChannelMap if the raw data
+*    of a task is in a different order.
+*
+*    The noise floor is estimated from the differences between
+*    consecutive samples of the calibration burst. A signal that changes
+*    quickly at the sample rate raises the estimate, so calibrate on a
+*    quiet or slowly varying input. LSB removal truncates rather than
+*    rounds, so the removed bits also shift every sample down by half
+*    the error bound on average. Delta encoding needs one compressed
+*    sample size for all channels of a task.
 *
 *********************************************************************/
 
+#ifndef _WIN32
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 #include <NIDAQmx.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#if defined(__linux__) && defined(O_DIRECT)
+#define HAVE_DIRECT_WRITE_ENGINES
+#endif
+#if defined(HAVE_DIRECT_WRITE_ENGINES) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#ifdef __NR_io_uring_setup
+#define HAVE_IO_URING
+#endif
+#endif
+#endif
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_CRC32C
+#include <nmmintrin.h>
+#endif
 #define DAQmxErrChk(functionCall) if( DAQmxFailed(error=(functionCall)) ) goto Error; else
 
-static bool32 CreateDataFileHeader(char filePath[], TaskHandle taskHandle, uInt32 numChannels, uInt32 sampsPerChan);
+#ifdef _WIN32
+typedef HANDLE		WriterThread;
+typedef DWORD		WriterThreadResult;
+typedef HANDLE		WriterSemaphore;
+#define WriterThreadCall						WINAPI
+#define WriterThreadCreate(thread,func,arg)		((*(thread)=CreateThread(NULL,0,(func),(arg),0,NULL))!=NULL)
+#define WriterThreadJoin(thread)				(WaitForSingleObject((thread),INFINITE),CloseHandle(thread))
+#define WriterSemaphoreInit(sem)				((*(sem)=CreateSemaphore(NULL,0,0x7FFFFFFF,NULL))!=NULL)
+#define WriterSemaphoreDestroy(sem)				CloseHandle(*(sem))
+#define WriterSemaphoreWait(sem)				WaitForSingleObject(*(sem),INFINITE)
+#define WriterSemaphoreTryWait(sem)				(WaitForSingleObject(*(sem),0)==WAIT_OBJECT_0)
+#define WriterSemaphorePost(sem)				ReleaseSemaphore(*(sem),1,NULL)
+#define RingLoadAcquire(ptr)					(MemoryBarrier(),*(ptr))
+#define RingStoreRelease(ptr,val)				(MemoryBarrier(),*(ptr)=(val))
+#else
+typedef pthread_t	WriterThread;
+typedef void		*WriterThreadResult;
+typedef sem_t		WriterSemaphore;
+#define WriterThreadCall
+#define WriterThreadCreate(thread,func,arg)		(pthread_create((thread),NULL,(func),(arg))==0)
+#define WriterThreadJoin(thread)				pthread_join((thread),NULL)
+#define WriterSemaphoreInit(sem)				(sem_init((sem),0,0)==0)
+#define WriterSemaphoreDestroy(sem)				sem_destroy(sem)
+#define WriterSemaphoreWait(sem)				while( sem_wait(sem) )
+#define WriterSemaphoreTryWait(sem)				(sem_trywait(sem)==0)
+#define WriterSemaphorePost(sem)				sem_post(sem)
+#define RingLoadAcquire(ptr)					__atomic_load_n((ptr),__ATOMIC_ACQUIRE)
+#define RingStoreRelease(ptr,val)				__atomic_store_n((ptr),(val),__ATOMIC_RELEASE)
+#endif
+
+#define MaxTasks				16
+#define BlockTagBytes			4
+#define BlockSampleCountBytes	4
+#define BlockLengthBytes		4
+#define BlockChecksumBytes		4
+#define Crc32cPolynomial		0x82F63B78	// Castagnoli, bit reversed
+#define MinLossySampleSize		8
+
+// Acquisition position of a read block, taken by the EveryNCallback
+typedef struct {
+	uInt64	firstSample;	// Samples per channel acquired before the block, dropped blocks included
+	uInt64	timestamp;		// Host time the block was read, in ns since 1970-01-01 UTC
+	uInt32	numSamples;		// Samples per channel in the block
+} BlockStamp;
+
+// Single producer, single consumer ring of preallocated read blocks, one
+// per task. The EveryNCallback of the task fills the slot at head and the
+// disk writer thread drains the slot at tail. head and tail count blocks
+// and are each written by one thread only, so no lock is taken on the
+// acquisition path. They wrap at 2^32, so the ring holds a power of two
+// blocks and the slot of a block is its count masked by numBlocks-1.
+typedef struct {
+	uInt8			*blocks;
+	BlockStamp		*stamps;
+	uInt32			numBlocks;
+	uInt32			mask;
+	uInt32			slotBytes;
+	uInt32			blockBytes;		// ReadBlockSizeInBytes of the task
+	volatile uInt32	head;
+	volatile uInt32	tail;
+	uInt32			highWaterMark;
+	uInt32			droppedBlocks;
+	uInt64			samplesAcquired;
+	uInt32			*codes;			// Scratch of the block encoder, NULL if the task is not encoded
+	uInt8			*encoded;
+	uInt64			rawBytes;
+	uInt64			encodedBytes;
+	double			encodeSeconds;
+} BlockRing;
+
+// The rings of all tasks drain through one disk writer thread
+typedef struct {
+	BlockRing		rings[MaxTasks];
+	uInt32			numRings;
+	volatile bool32	quit;
+	WriterSemaphore	filled;
+	WriterThread	writer;
+	bool32			running;
+} BlockRings;
+
+typedef enum {
+	StdioWriteEngine,		// fwrite through the C library and the page cache
+	PwriteWriteEngine,		// Aligned O_DIRECT pwrite of staged chunks into a preallocated file
+	IoUringWriteEngine		// Same chunks, with several writes in flight through io_uring
+} WriteEngine;
+
+#define WriteAlignment	4096
+#define MaxWriteChunks	16
+
+#ifdef HAVE_IO_URING
+typedef struct {
+	int					fd;
+	void				*sqRing;
+	void				*cqRing;
+	struct io_uring_sqe	*sqes;
+	size_t				sqRingBytes;
+	size_t				cqRingBytes;
+	size_t				sqesBytes;
+	uInt32				*sqHead;
+	uInt32				*sqTail;
+	uInt32				*sqMask;
+	uInt32				*sqArray;
+	uInt32				*cqHead;
+	uInt32				*cqTail;
+	uInt32				*cqMask;
+	struct io_uring_cqe	*cqes;
+	struct iovec		iovecs[MaxWriteChunks];
+} IoUring;
+#endif
+
+// The direct engines stage the stream in aligned chunks. A full chunk is
+// written at its aligned file offset while the next one fills.
+typedef struct {
+	WriteEngine	engine;
+	FILE		*file;
+	uInt64		size;
+	bool32		failed;
+#ifdef HAVE_DIRECT_WRITE_ENGINES
+	int			fd;
+	uInt8		*chunks[MaxWriteChunks];
+	uInt32		numChunks;
+	uInt32		chunkBytes;
+	uInt32		current;
+	uInt32		fill;
+	uInt64		chunkOffset;
+	uInt64		preallocated;
+#endif
+#ifdef HAVE_IO_URING
+	IoUring		ring;
+	uInt32		pending[MaxWriteChunks];
+	uInt64		pendingOffsets[MaxWriteChunks];
+	uInt32		inFlight;
+#endif
+} DataFileWriter;
+
+// The block index is a sidecar file named after the data file with .idx
+// appended. A BlockIndexHeader is followed by one BlockIndexEntry per
+// block written to the data file, in file order. The entries are in the
+// byte order of the host that wrote them. Version 1 entries have no task
+// number.
+#define BlockIndexMagic		"DAQCBIDX"
+#define BlockIndexVersion	2
+
+typedef struct {
+	char	magic[8];
+	uInt32	version;
+	uInt32	entryBytes;
+	uInt64	dataHeaderSize;		// HeaderSize of the data file
+	uInt32	readBlockSizeInBytes;	// Of task 0. The data file header has those of the other tasks.
+	uInt32	readBlockSize;		// Samples per channel in a block of task 0
+} BlockIndexHeader;
+
+typedef struct {
+	uInt64	byteOffset;			// Offset of the block in the data file, at its task tag in multi-task files
+	uInt64	firstSample;		// Counted per task
+	uInt64	timestamp;
+	uInt32	task;
+	uInt32	recordBytes;		// Length of the record at byteOffset
+} BlockIndexEntry;
+
+// One file of the stream. When the stream rotates, every segment is a
+// complete data file with its own header and block index. The direct
+// engines hold the index entries of the records whose bytes are not all
+// in the file yet.
+typedef struct {
+	DataFileWriter	writer;
+	FILE			*indexHandle;
+	BlockIndexEntry	*heldEntries;
+	uInt32			numHeld;
+	uInt32			maxHeld;
+	uInt32			number;
+	double			startTime;
+	bool32			open;
+} DataFileSegment;
+
+// Opens the next segment ahead of time and closes the previous one on its
+// own thread, so a rotation costs the disk writer thread a pointer swap.
+// pending and the fields after it belong to the disk writer thread.
+#define SegmentRetrySeconds	1.0
+
+typedef struct {
+	DataFileSegment	*next;
+	DataFileSegment	*retired;
+	bool32			nextOpened;
+	bool32			pending;		// An open was requested and ready is yet to be posted for it
+	bool32			retrying;		// The pending open follows a failed one, so its result is polled
+	double			retryTime;		// When a failed open may be requested again
+	uInt32			failures;		// Failed opens in a row
+	volatile bool32	quit;
+	WriterSemaphore	request;
+	WriterSemaphore	ready;
+	WriterThread	opener;
+	bool32			running;
+} SegmentRotation;
+
+// Header text, grown geometrically so building it stays linear in the
+// number of channels
+typedef struct {
+	char	*text;
+	size_t	length;
+	size_t	capacity;
+	bool32	failed;		// An append ran out of memory
+} HeaderBuilder;
+
+/*********************************************/
+// Task Options
+/*********************************************/
+const char *const taskChannels[] = {"Dev1/ai0"}; // One task is created for each entry, for example {"Dev1/ai0:3","Dev2/ai0:3"}. The blocks of several tasks are tagged with their task number and interleaved into one file.
+
+/*********************************************/
+// Compression Options
+/*********************************************/
+const bool32 calibrateLossySampleSize = FALSE; // Set to TRUE to measure the noise floor of every channel on a short burst before streaming, and store LossyLSBRemoval samples of the smallest size whose removed bits stay within lossyErrorBudget of the noise.
+const uInt32 calibrationSamples = 2000; // The samples per channel of the calibration burst.
+const float64 lossyErrorBudget = 0.5; // The largest RMS error the removed bits may add, as a fraction of the noise floor of the channel. 0.5 raises the total noise by at most 12%.
+
+/*********************************************/
+// Read Options
+/*********************************************/
+const bool32 readAvailableSamples = FALSE; // Set to TRUE to read every sample available in each callback, up to maxSamplesPerRead, instead of 1000. Every block is then preceded by its number of samples per channel.
+const uInt32 maxSamplesPerRead = 10000; // The most samples per channel one callback reads when readAvailableSamples is TRUE. The slots of the ring hold that many.
+const float64 readEventSeconds = 0.05; // The acquisition time between two callbacks when readAvailableSamples is TRUE. The event fires every that many seconds of samples, but never more often than every 1000 samples nor less often than every half of maxSamplesPerRead, which leaves a late callback room to catch up.
+
+/*********************************************/
+// Ring Buffer Options
+/*********************************************/
+const uInt32 numRingBlocks = 256; // The number of read blocks the ring between the acquisition callback of each task and the disk writer thread holds. Size it for the longest disk stall at your sustained rate. Rounded up to a power of two.
+
+/*********************************************/
+// File Write Options
+/*********************************************/
+const WriteEngine writeEngine = StdioWriteEngine; // Options: StdioWriteEngine, PwriteWriteEngine, IoUringWriteEngine. Engines the platform or kernel does not support fall back to the next simpler one.
+const uInt32 writeChunkBytes = 1048576; // The size of the aligned chunks the direct engines write.
+const uInt32 numWriteChunks = 4; // The number of chunks the direct engines stage. io_uring keeps all but one of them in flight.
+const uInt64 preallocateBytes = 268435456; // How far ahead of the data the direct engines reserve file space with fallocate.
+const bool32 writeBlockChecksums = FALSE; // Set to TRUE to end every block with the CRC32C of the block and the fields before it, so the reader can detect a corrupt block and resume at the next good one.
+const bool32 writeBlockIndex = TRUE; // Write the byte offset, first sample and host timestamp of every block to a .idx file next to the data file. Rotating streams always write it, as the reader stitches the segments with it.
+
+/*********************************************/
+// File Rotation Options
+/*********************************************/
+const uInt32 segmentMegabytes = 0; // Start the next segment file when the current one would grow past this size. Each segment is preallocated to this size. 0 disables rotation by size.
+const uInt32 segmentSeconds = 0; // Start the next segment file this many seconds after the first block of the current one. 0 disables rotation by time.
+
+/*********************************************/
+// Block Encoding Options
+/*********************************************/
+const bool32 deltaEncodeBlocks = FALSE; // Set to TRUE to delta encode every block on the disk writer thread. Each channel stores the zigzag differences between its samples at the width of the largest one in the block. Blocks that would not shrink are stored as they are.
+
+/*********************************************/
+// Benchmark Options
+/*********************************************/
+const uInt32 benchmarkWriteMegabytes = 0; // Set to a nonzero value to write that much synthetic data through each engine and report MB/s and p99 write latency instead of acquiring.
+
+static bool32 CreateDataFileHeader(char filePath[], TaskHandle taskHandles[], uInt32 numTasks, uInt32 sampsPerChan);
+static bool32 WriteDataFileHeader(char filePath[]);
+static void AppendToHeader(const char *format, ...);
 static long FindOutFileSize(char filePath[]);
+static void MakeSegmentPath(char segmentPath[], uInt32 number);
+static bool32 OpenDataFileSegment(DataFileSegment *segment, uInt32 number);
+static void CloseDataFileSegment(DataFileSegment *segment);
+static bool32 StartSegmentRotation(SegmentRotation *rotation);
+static void StopSegmentRotation(SegmentRotation *rotation);
+static bool32 RotateDataFileSegment(SegmentRotation *rotation);
+static WriterThreadResult WriterThreadCall SegmentOpenerThread(void *arg);
 static int WriteDataToDataFile(uInt16 *data, int32 numBytes);
+static void WriteBlockToDataFile(uInt32 task, BlockRing *ring, uInt32 slot);
+static uInt32 EncodeBlock(uInt32 task, BlockRing *ring, const uInt8 *block, uInt32 numSamples, uInt32 rawBytes);
 static void CloseDataFile(void);
-static bool32 CreateDataFileTaskEntry(TaskHandle taskHandle, uInt32 numChannels, uInt32 sampsToRead);
-static bool32 CreateDataFileChannelEntry(TaskHandle taskHandle, int idx);
-static int CalculateReadBlockSize(TaskHandle taskHandle, uInt32 numChannels, uInt32 sampsPerChan);
+static bool32 OpenDataFileWriter(DataFileWriter *writer, char filePath[], uInt64 headerSize, WriteEngine engine);
+static void CloseDataFileWriter(DataFileWriter *writer);
+static void SyncDataFile(DataFileWriter *writer);
+#ifdef HAVE_DIRECT_WRITE_ENGINES
+static void FlushWriteChunk(DataFileWriter *writer);
+#endif
+#ifdef HAVE_IO_URING
+static void ReapWriteChunk(DataFileWriter *writer);
+static bool32 SetupIoUring(IoUring *ring, uInt32 entries);
+static bool32 SubmitIoUringWrite(IoUring *ring, int fd, void *buffer, uInt32 numBytes, uInt64 offset, uInt32 index);
+static bool32 WaitIoUringCompletion(IoUring *ring, uInt32 *index, int32 *result);
+static void TeardownIoUring(IoUring *ring);
+#endif
+static bool32 OpenBlockIndex(DataFileSegment *segment, char filePath[]);
+static void AppendBlockIndexEntry(DataFileSegment *segment, uInt32 task, const BlockStamp *stamp, uInt32 recordBytes);
+static void ReleaseBlockIndexEntries(DataFileSegment *segment, uInt64 writtenBytes);
+static uInt64 GetWrittenDataFileBytes(DataFileWriter *writer);
+static void CloseBlockIndex(DataFileSegment *segment);
+static uInt32 ComputeCrc32c(uInt32 crc, const uInt8 *data, size_t numBytes);
+static uInt32 ComputeCrc32cTable(uInt32 crc, const uInt8 *data, size_t numBytes);
+#ifdef HAVE_X86_CRC32C
+static uInt32 ComputeCrc32cSSE42(uInt32 crc, const uInt8 *data, size_t numBytes);
+#endif
+static void BenchmarkWriteEngines(char filePath[], uInt32 blockBytes);
+static double GetTimeInSeconds(void);
+static uInt64 GetHostTimestamp(void);
+static bool32 CreateDataFileTaskEntry(TaskHandle taskHandle, uInt32 taskNum, uInt32 numChannels, uInt32 sampsToRead, uInt32 firstChannel);
+static bool32 CreateDataFileChannelEntry(TaskHandle taskHandle, uInt32 taskNum, int idx);
+static bool32 CalibrateLossySampleSize(TaskHandle taskHandle, uInt32 taskNum, uInt32 numChannels);
+static int CalculateReadBlockSize(TaskHandle taskHandle, uInt32 taskNum, uInt32 numChannels, uInt32 sampsPerChan);
+static int32 ConfigureReadEvent(TaskHandle taskHandle, uInt32 *eventSamples);
+static bool32 StartBlockRings(BlockRings *rings, uInt32 numRings, uInt32 numBlocks, uInt32 slotBytes);
+static void StopBlockRings(BlockRings *rings);
+static WriterThreadResult WriterThreadCall DiskWriterThread(void *arg);
 
-static FILE	*gFileHandle=NULL;
-static char	gHeader[2000];
-static uInt32 gReadBlockSize;
+static char	gFilePath[512];
+static HeaderBuilder gHeader;
+static uInt32 gHeaderSize;
+static uInt32 gSampsPerChan;
+static uInt32 gNumTasks;
+static uInt32 gReadBlockSize[MaxTasks];
+static uInt32 gTaskChannels[MaxTasks];
+static uInt32 gCodeBits[MaxTasks];		// Width of a sample in the raw data
+static uInt32 gSampleBits[MaxTasks];	// Width of a sample of all channels of the task
+static bool32 gCodesPacked[MaxTasks];	// Samples are packed MSB first rather than stored in whole little-endian bytes
+static bool32 gEncodeBlocks[MaxTasks];
+static float64 *gNoiseFloor[MaxTasks];		// Of each channel in LSBs, NULL unless the task was calibrated
+static uInt32 *gLossyErrorBound[MaxTasks];	// Of each channel, the largest error LSB removal adds to a sample, in LSBs
 static uInt16 *data=NULL;
 static uInt32 numChannels;
+static uInt32 gSlotBytes;
+static BlockRings gRings;
+static DataFileSegment gSegments[2],*gSegment=&gSegments[0];
+static SegmentRotation gRotation;
 
 static char	hiddenChanMsg[]="Hidden channels were detected in the task. However, this example does not handle these channels correctly. "
 							"For example, cold-junction compensation channels for thermocouples may be added as hidden channels. "
@@ -98,34 +514,60 @@ int32 CVICALLBACK DoneCallback(TaskHandle taskHandle, int32 status, void *callba
 int main(void)
 {
 	int32       error=0;
-	TaskHandle  taskHandle=0;
+	TaskHandle  taskHandles[MaxTasks]={0};
+	uInt32      numTasks=sizeof(taskChannels)/sizeof(taskChannels[0]),i,eventSamples;
 	char        errBuff[2048]={'\0'};
 
+	if( benchmarkWriteMegabytes ) {
+		// 1000 samples of 8 channels of 16-bit data per block
+		BenchmarkWriteEngines("C:\\stream.cfg",16000);
+		goto Error;
+	}
+
+	if( numTasks>MaxTasks ) {
+		printf("Error: The example streams at most %d tasks.\n",MaxTasks);
+		goto Error;
+	}
+
 	/*********************************************/
 	// DAQmx Configure Code
 	/*********************************************/
-	DAQmxErrChk (DAQmxCreateTask("",&taskHandle));
-	DAQmxErrChk (DAQmxCreateAIVoltageChan(taskHandle,"Dev1/ai0","",DAQmx_Val_Cfg_Default,-10.0,10.0,DAQmx_Val_Volts,NULL));
-	DAQmxErrChk (DAQmxCfgSampClkTiming(taskHandle,"",10000.0,DAQmx_Val_Rising,DAQmx_Val_ContSamps,1000));
-	DAQmxErrChk (DAQmxSetAIRawDataCompressionType(taskHandle,"",DAQmx_Val_LosslessPacking));
-	DAQmxErrChk (DAQmxSetAILossyLSBRemovalCompressedSampSize(taskHandle,"",12));
-	DAQmxErrChk (DAQmxGetTaskNumChans(taskHandle,&numChannels));
-
-	if( (data=malloc(1000*numChannels*sizeof(uInt16)))==NULL ) {
-		puts("Not enough memory");
-		goto Error;
+	for(i=0;i<numTasks;++i) {
+		DAQmxErrChk (DAQmxCreateTask("",&taskHandles[i]));
+		DAQmxErrChk (DAQmxCreateAIVoltageChan(taskHandles[i],taskChannels[i],"",DAQmx_Val_Cfg_Default,-10.0,10.0,DAQmx_Val_Volts,NULL));
+		DAQmxErrChk (DAQmxCfgSampClkTiming(taskHandles[i],"",10000.0,DAQmx_Val_Rising,DAQmx_Val_ContSamps,1000));
+		DAQmxErrChk (DAQmxSetAIRawDataCompressionType(taskHandles[i],"",DAQmx_Val_LosslessPacking));
+		DAQmxErrChk (DAQmxSetAILossyLSBRemovalCompressedSampSize(taskHandles[i],"",12));
+		DAQmxErrChk (DAQmxGetTaskNumChans(taskHandles[i],&numChannels));
+		if( calibrateLossySampleSize && !CalibrateLossySampleSize(taskHandles[i],i,numChannels) )
+			goto Error;
+		if( 1000*numChannels*sizeof(uInt16)>gSlotBytes )
+			gSlotBytes = 1000*numChannels*sizeof(uInt16);
 	}
 
-	if( !CreateDataFileHeader("C:\\stream.cfg",taskHandle,numChannels,1000) )
+	if( !CreateDataFileHeader("C:\\stream.cfg",taskHandles,numTasks,readAvailableSamples?maxSamplesPerRead:1000) )
 		goto Error;
 
-	DAQmxErrChk (DAQmxRegisterEveryNSamplesEvent(taskHandle,DAQmx_Val_Acquired_Into_Buffer,1000,0,EveryNCallback,NULL));
-	DAQmxErrChk (DAQmxRegisterDoneEvent(taskHandle,0,DoneCallback,NULL));
+	// Blocks that find the ring full are read here and dropped
+	for(i=0;i<numTasks;++i)
+		if( gReadBlockSize[i]>gSlotBytes )
+			gSlotBytes = gReadBlockSize[i];
+	if( (data=malloc((size_t)numTasks*gSlotBytes))==NULL || !StartBlockRings(&gRings,numTasks,numRingBlocks,gSlotBytes) ) {
+		puts("Not enough memory");
+		goto Error;
+	}
+
+	for(i=0;i<numTasks;++i) {
+		DAQmxErrChk (ConfigureReadEvent(taskHandles[i],&eventSamples));
+		DAQmxErrChk (DAQmxRegisterEveryNSamplesEvent(taskHandles[i],DAQmx_Val_Acquired_Into_Buffer,eventSamples,0,EveryNCallback,(void*)(size_t)i));
+		DAQmxErrChk (DAQmxRegisterDoneEvent(taskHandles[i],0,DoneCallback,NULL));
+	}
 
 	/*********************************************/
 	// DAQmx Start Code
 	/*********************************************/
-	DAQmxErrChk (DAQmxStartTask(taskHandle));
+	for(i=0;i<numTasks;++i)
+		DAQmxErrChk (DAQmxStartTask(taskHandles[i]));
 
 	printf("Streaming samples continuously. Press Enter to interrupt\n");
 	getchar();
@@ -133,16 +575,29 @@ int main(void)
 Error:
 	if( DAQmxFailed(error) )
 		DAQmxGetExtendedErrorInfo(errBuff,2048);
-	if( taskHandle!=0 ) {
+	if( taskHandles[0]!=0 ) {
 		/*********************************************/
 		// DAQmx Stop Code
 		/*********************************************/
-		DAQmxStopTask(taskHandle);
-		DAQmxClearTask(taskHandle);
+		for(i=0;i<numTasks&&taskHandles[i]!=0;++i) {
+			DAQmxStopTask(taskHandles[i]);
+			DAQmxClearTask(taskHandles[i]);
+		}
+		StopBlockRings(&gRings);
 		CloseDataFile();
+		for(i=0;i<gRings.numRings;++i) {
+			printf("Task %u ring high-water mark: %u of %u blocks. Dropped blocks: %u\n",(unsigned)i,(unsigned)gRings.rings[i].highWaterMark,(unsigned)gRings.rings[i].numBlocks,(unsigned)gRings.rings[i].droppedBlocks);
+			if( gRings.rings[i].encodedBytes )
+				printf("Task %u delta encoding: %.2f times smaller, %.0f MB/s\n",(unsigned)i,(double)gRings.rings[i].rawBytes/gRings.rings[i].encodedBytes,
+					gRings.rings[i].encodeSeconds>0.0?gRings.rings[i].rawBytes/1048576.0/gRings.rings[i].encodeSeconds:0.0);
+		}
 	}
 	if( data )
 		free(data);
+	for(i=0;i<MaxTasks;++i) {
+		free(gNoiseFloor[i]);
+		free(gLossyErrorBound[i]);
+	}
 	if( DAQmxFailed(error) )
 		printf("DAQmx Error: %s\n",errBuff);
 	puts("End of program, press Enter key to quit");
@@ -150,37 +605,49 @@ Error:
 	return 0;
 }
 
-static bool32 CreateDataFileHeader(char filePath[], TaskHandle taskHandle, uInt32 numChannels, uInt32 sampsPerChan)
+// A single task is written in the version 1.0.0 format. Version 2.0.0
+// holds several tasks, and every block in the file is preceded by a
+// BlockTagBytes little-endian tag with the number of its task.
+static bool32 CreateDataFileHeader(char filePath[], TaskHandle taskHandles[], uInt32 numTasks, uInt32 sampsPerChan)
 {
-	uInt32  i=0,size;
-	char	*s,ch;
+	uInt32  i,taskNum,numChannels,firstChannel=0;
 
-	if( filePath==NULL || *filePath=='\0' || (gFileHandle=fopen(filePath,"w"))==NULL )
+	if( filePath==NULL || *filePath=='\0' || strlen(filePath)>=sizeof(gFilePath) || numTasks<1 || numTasks>MaxTasks )
 		goto Error;
-	strcpy(gHeader,"[DAQCompressedBinaryFile]\nVersion=1.0.0\nHeaderSize=0deadBEEF0\nNumberOfTasks=1\n");
-	if( !CreateDataFileTaskEntry(taskHandle,numChannels,sampsPerChan) )
-		return FALSE;
-	while( i<numChannels )
-		CreateDataFileChannelEntry(taskHandle,i++);
-	strcat(gHeader,"[BinaryData]\nBegin=Here\n");
-	fputs(gHeader,gFileHandle);
-	fclose(gFileHandle);
-	size = FindOutFileSize(filePath);
-	if( (gFileHandle=fopen(filePath,"r+"))==NULL )
-		goto Error;
-	// Write the actual header size
-	fread(gHeader,1,2*size,gFileHandle);
-	if( (s=strstr(gHeader,"0deadBEEF0")) ) {
-		ch = s[10];
-		sprintf(s,"%010d",(int)size);
-		s[10] = ch;
+	strcpy(gFilePath,filePath);
+	gSampsPerChan = sampsPerChan;
+	gNumTasks = numTasks;
+	gHeader.length = 0;
+	gHeader.failed = FALSE;
+	AppendToHeader("[DAQCompressedBinaryFile]\nVersion=%s\nHeaderSize=0deadBEEF0\nNumberOfTasks=%u\n",numTasks>1?"2.0.0":"1.0.0",(unsigned)numTasks);
+	if( writeBlockChecksums )
+		AppendToHeader("RecordChecksum=CRC32C\n");
+#ifdef HAVE_DIRECT_WRITE_ENGINES
+	// The file may have holes and padding until it is closed
+	if( writeEngine!=StdioWriteEngine )
+		AppendToHeader("UnorderedWrites=TRUE\n");
+#endif
+	for(taskNum=0;taskNum<numTasks;++taskNum) {
+		if( DAQmxFailed(DAQmxGetTaskNumChans(taskHandles[taskNum],&numChannels)) )
+			return FALSE;
+		gTaskChannels[taskNum] = numChannels;
+		if( !CreateDataFileTaskEntry(taskHandles[taskNum],taskNum,numChannels,sampsPerChan,firstChannel) )
+			return FALSE;
+		for(i=0;i<numChannels;++i)
+			CreateDataFileChannelEntry(taskHandles[taskNum],taskNum,i);
+		firstChannel += numChannels;
 	}
-	fseek(gFileHandle,0,SEEK_SET);
-	fwrite(gHeader,1,strlen(gHeader),gFileHandle);
-	fclose(gFileHandle);
+	AppendToHeader("[BinaryData]\nBegin=Here\n");
+	if( gHeader.failed )
+		goto Error;
 
-	if( (gFileHandle=fopen(filePath,"ab"))==NULL )
+	gSegment = &gSegments[0];
+	if( !OpenDataFileSegment(gSegment,0) )
+		goto Error;
+	if( (segmentMegabytes || segmentSeconds) && !StartSegmentRotation(&gRotation) ) {
+		CloseDataFileSegment(gSegment);
 		goto Error;
+	}
 	return TRUE;
 
 Error:
@@ -188,6 +655,68 @@ Error:
 	return FALSE;
 }
 
+// Writes the header to a new data file. The header size is only known once
+// the header is in a file, so the size is patched into the first file and
+// every later segment gets the patched header.
+static bool32 WriteDataFileHeader(char filePath[])
+{
+	FILE	*f;
+	uInt32	size;
+	char	*s,ch;
+
+	if( (f=fopen(filePath,"w"))==NULL )
+		return FALSE;
+	fputs(gHeader.text,f);
+	fclose(f);
+	if( gHeaderSize )
+		return TRUE;
+	size = FindOutFileSize(filePath);
+	if( (f=fopen(filePath,"r+"))==NULL )
+		return FALSE;
+	// Write the actual header size. It has as many digits as the placeholder.
+	if( (s=strstr(gHeader.text,"0deadBEEF0")) ) {
+		ch = s[10];
+		sprintf(s,"%010d",(int)size);
+		s[10] = ch;
+	}
+	fwrite(gHeader.text,1,gHeader.length,f);
+	fclose(f);
+	gHeaderSize = size;
+	return TRUE;
+}
+
+
+// Appends formatted text to the header, doubling its buffer when full
+static void AppendToHeader(const char *format, ...)
+{
+	va_list	args;
+	size_t	capacity;
+	char	*text;
+	int		n;
+
+	if( gHeader.failed )
+		return;
+	for(;;) {
+		va_start(args,format);
+		n = vsnprintf(gHeader.text+gHeader.length,gHeader.capacity-gHeader.length,format,args);
+		va_end(args);
+		if( n<0 ) {
+			gHeader.failed = TRUE;
+			return;
+		}
+		if( gHeader.length+n<gHeader.capacity ) {
+			gHeader.length += n;
+			return;
+		}
+		for(capacity=gHeader.capacity?gHeader.capacity:4096;capacity<=gHeader.length+n;capacity*=2);
+		if( (text=(char*)realloc(gHeader.text,capacity))==NULL ) {
+			gHeader.failed = TRUE;
+			return;
+		}
+		gHeader.text = text;
+		gHeader.capacity = capacity;
+	}
+}
 
 static long FindOutFileSize(char filePath[])
 {
@@ -201,35 +730,1011 @@ static long FindOutFileSize(char filePath[])
 	return size;
 }
 
-static int WriteDataToDataFile(uInt16 *data, int32 numBytes)
+static bool32 StartBlockRings(BlockRings *rings, uInt32 numRings, uInt32 numBlocks, uInt32 slotBytes)
+{
+	BlockRing	*ring;
+	uInt32		i;
+
+	memset(rings,0,sizeof(BlockRings));
+	if( numBlocks==0 || numBlocks>0x80000000 || numRings>MaxTasks )
+		return FALSE;
+	// Rounded up to a power of two by carrying its lowest bit
+	while( numBlocks&(numBlocks-1) )
+		numBlocks += numBlocks&(~numBlocks+1);
+	rings->numRings = numRings;
+	for(i=0;i<numRings;++i) {
+		ring = &rings->rings[i];
+		ring->numBlocks = numBlocks;
+		ring->mask = numBlocks - 1;
+		ring->slotBytes = slotBytes;
+		ring->blockBytes = gReadBlockSize[i];
+		if( (ring->blocks=(uInt8*)malloc((size_t)numBlocks*slotBytes))==NULL
+		 || (ring->stamps=(BlockStamp*)malloc(sizeof(BlockStamp)*numBlocks))==NULL ) {
+			StopBlockRings(rings);
+			return FALSE;
+		}
+		// An encoded block is never larger than the raw one, or the raw one is stored
+		if( gEncodeBlocks[i]
+		 && ((ring->codes=(uInt32*)malloc(sizeof(uInt32)*gSampsPerChan*gTaskChannels[i]))==NULL
+		  || (ring->encoded=(uInt8*)malloc(ring->blockBytes))==NULL) ) {
+			StopBlockRings(rings);
+			return FALSE;
+		}
+	}
+	if( !WriterSemaphoreInit(&rings->filled) ) {
+		StopBlockRings(rings);
+		return FALSE;
+	}
+	if( !WriterThreadCreate(&rings->writer,DiskWriterThread,rings) ) {
+		WriterSemaphoreDestroy(&rings->filled);
+		StopBlockRings(rings);
+		return FALSE;
+	}
+	rings->running = TRUE;
+	return TRUE;
+}
+
+// Lets the disk writer thread drain what is left in the rings, then frees them
+static void StopBlockRings(BlockRings *rings)
+{
+	uInt32	i;
+
+	if( rings->running ) {
+		rings->quit = TRUE;
+		WriterSemaphorePost(&rings->filled);
+		WriterThreadJoin(rings->writer);
+		WriterSemaphoreDestroy(&rings->filled);
+		rings->running = FALSE;
+	}
+	for(i=0;i<MaxTasks;++i) {
+		if( rings->rings[i].blocks )
+			free(rings->rings[i].blocks);
+		if( rings->rings[i].stamps )
+			free(rings->rings[i].stamps);
+		if( rings->rings[i].codes )
+			free(rings->rings[i].codes);
+		if( rings->rings[i].encoded )
+			free(rings->rings[i].encoded);
+		rings->rings[i].blocks = NULL;
+		rings->rings[i].stamps = NULL;
+		rings->rings[i].codes = NULL;
+		rings->rings[i].encoded = NULL;
+	}
+}
+
+// Writes the oldest block waiting in any ring next, so the blocks of
+// several tasks reach the file in the order they were read.
+static WriterThreadResult WriterThreadCall DiskWriterThread(void *arg)
 {
-	if( gFileHandle )
-		fwrite(data,sizeof(uInt8),numBytes,gFileHandle);
+	BlockRings	*rings=(BlockRings*)arg;
+	BlockRing	*ring,*oldest;
+	BlockStamp	last;
+	uInt32		i,task=0;
+	bool32		wrote;
+
+	for(;;) {
+		WriterSemaphoreWait(&rings->filled);
+		wrote = FALSE;
+		for(;;) {
+			oldest = NULL;
+			for(i=0;i<rings->numRings;++i) {
+				ring = &rings->rings[i];
+				if( ring->tail!=RingLoadAcquire(&ring->head)
+				 && (oldest==NULL || ring->stamps[ring->tail&ring->mask].timestamp<oldest->stamps[oldest->tail&oldest->mask].timestamp) ) {
+					oldest = ring;
+					task = i;
+				}
+			}
+			if( oldest==NULL )
+				break;
+			last = oldest->stamps[oldest->tail&oldest->mask];
+			wrote = TRUE;
+			WriteBlockToDataFile(task,oldest,oldest->tail&oldest->mask);
+			RingStoreRelease(&oldest->tail,oldest->tail+1);
+		}
+		// Progress is reported once per drain, off the acquisition path
+		if( wrote )
+			printf("Acquired %u samples. Total %llu\r",(unsigned)last.numSamples,(unsigned long long)(last.firstSample+last.numSamples));
+		if( rings->quit )
+			break;
+	}
 	return 0;
 }
 
+// Encodes the block if the task is encoded and rotates the segment if
+// needed, then writes the index entry, the task tag of a multi-task file,
+// the number of samples of a block of variable size, the length of an
+// encoded block, the block and the checksum of all of them
+static void WriteBlockToDataFile(uInt32 task, BlockRing *ring, uInt32 slot)
+{
+	uInt8		tag[BlockTagBytes],count[BlockSampleCountBytes],length[BlockLengthBytes],checksum[BlockChecksumBytes];
+	const uInt8	*block=ring->blocks+(size_t)slot*ring->slotBytes;
+	uInt32		numSamples=ring->stamps[slot].numSamples,rawBytes=ring->blockBytes,blockBytes,recordBytes,crc=0;
+	double		start;
+
+	// A block of variable size ends at the byte after its last sample
+	if( readAvailableSamples )
+		rawBytes = (uInt32)(((uInt64)numSamples*gSampleBits[task]+7)/8);
+	blockBytes = rawBytes;
+	if( ring->encoded ) {
+		start = GetTimeInSeconds();
+		if( (blockBytes=EncodeBlock(task,ring,block,numSamples,rawBytes))>0 )
+			block = ring->encoded;
+		else
+			blockBytes = rawBytes;
+		ring->encodeSeconds += GetTimeInSeconds() - start;
+		ring->rawBytes += rawBytes;
+		ring->encodedBytes += BlockLengthBytes + blockBytes;
+	}
+	recordBytes = blockBytes + (gNumTasks>1?BlockTagBytes:0) + (readAvailableSamples?BlockSampleCountBytes:0) + (ring->encoded?BlockLengthBytes:0) + (writeBlockChecksums?BlockChecksumBytes:0);
+
+	if( gRotation.running ) {
+		if( gSegment->writer.size==gHeaderSize )
+			gSegment->startTime = GetTimeInSeconds();
+		else if( (segmentMegabytes && gSegment->writer.size+recordBytes>gHeaderSize+(uInt64)segmentMegabytes*1048576)
+		 || (segmentSeconds && GetTimeInSeconds()-gSegment->startTime>=segmentSeconds) ) {
+			if( RotateDataFileSegment(&gRotation) )
+				gSegment->startTime = GetTimeInSeconds();
+		}
+	}
+	AppendBlockIndexEntry(gSegment,task,&ring->stamps[slot],recordBytes);
+	if( gNumTasks>1 ) {
+		tag[0] = (uInt8)task;
+		tag[1] = (uInt8)(task>>8);
+		tag[2] = (uInt8)(task>>16);
+		tag[3] = (uInt8)(task>>24);
+		WriteDataToDataFile((uInt16*)tag,BlockTagBytes);
+		crc = ComputeCrc32c(crc,tag,BlockTagBytes);
+	}
+	if( readAvailableSamples ) {
+		count[0] = (uInt8)numSamples;
+		count[1] = (uInt8)(numSamples>>8);
+		count[2] = (uInt8)(numSamples>>16);
+		count[3] = (uInt8)(numSamples>>24);
+		WriteDataToDataFile((uInt16*)count,BlockSampleCountBytes);
+		crc = ComputeCrc32c(crc,count,BlockSampleCountBytes);
+	}
+	if( ring->encoded ) {
+		length[0] = (uInt8)blockBytes;
+		length[1] = (uInt8)(blockBytes>>8);
+		length[2] = (uInt8)(blockBytes>>16);
+		length[3] = (uInt8)(blockBytes>>24);
+		WriteDataToDataFile((uInt16*)length,BlockLengthBytes);
+		crc = ComputeCrc32c(crc,length,BlockLengthBytes);
+	}
+	WriteDataToDataFile((uInt16*)block,blockBytes);
+	if( writeBlockChecksums ) {
+		crc = ComputeCrc32c(crc,block,blockBytes);
+		checksum[0] = (uInt8)crc;
+		checksum[1] = (uInt8)(crc>>8);
+		checksum[2] = (uInt8)(crc>>16);
+		checksum[3] = (uInt8)(crc>>24);
+		WriteDataToDataFile((uInt16*)checksum,BlockChecksumBytes);
+	}
+	ReleaseBlockIndexEntries(gSegment,GetWrittenDataFileBytes(&gSegment->writer));
+}
+
+// Stores each channel of the block as its first sample followed by the
+// zigzag encoded differences between consecutive samples, packed MSB
+// first at the width of the largest difference:
+//   uInt8 width, uInt32 little-endian first sample, differences padded to a byte
+// Differences wrap at the sample width, so signed and unsigned samples
+// encode alike. Returns the size of the encoded block, or 0 if it would
+// not be smaller than the rawBytes of the raw block.
+static uInt32 EncodeBlock(uInt32 task, BlockRing *ring, const uInt8 *block, uInt32 numSamples, uInt32 rawBytes)
+{
+	uInt32		numChannels=gTaskChannels[task],bits=gCodeBits[task];
+	uInt32		numValues=numChannels*numSamples,mask=bits<32?(1u<<bits)-1:0xFFFFFFFF,shift=32-bits;
+	uInt32		*codes=ring->codes,iChan,iSamp,i,prev,zigzag,largest,width,accBits=0;
+	uInt8		*out=ring->encoded,*end=ring->encoded+rawBytes;
+	uInt64		acc=0;
+	int32		delta;
+
+	// Unpack the raw codes, interleaved by channel
+	if( gCodesPacked[task] ) {
+		for(i=0;i<numValues;++i) {
+			while( accBits<bits ) {
+				acc = acc<<8 | *block++;
+				accBits += 8;
+			}
+			accBits -= bits;
+			codes[i] = (uInt32)(acc>>accBits) & mask;
+		}
+	}
+	else
+		for(i=0;i<numValues;++i,block+=bits/8)
+			for(codes[i]=0,iSamp=0;iSamp<bits/8;++iSamp)
+				codes[i] |= (uInt32)block[iSamp] << iSamp*8;
+
+	for(iChan=0;iChan<numChannels;++iChan) {
+		// The largest difference sets the width of the channel
+		for(largest=0,prev=codes[iChan],iSamp=1;iSamp<numSamples;++iSamp) {
+			delta = (int32)(((codes[iSamp*numChannels+iChan]-prev)&mask)<<shift) >> shift;
+			zigzag = (uInt32)delta<<1 ^ (uInt32)(delta>>31);
+			largest |= zigzag;
+			prev = codes[iSamp*numChannels+iChan];
+		}
+		for(width=0;width<32&&(largest>>width);++width);
+		if( (uInt64)(end-out)<=5+((uInt64)(numSamples-1)*width+7)/8 )
+			return 0;
+		prev = codes[iChan];
+		*out++ = (uInt8)width;
+		*out++ = (uInt8)prev;
+		*out++ = (uInt8)(prev>>8);
+		*out++ = (uInt8)(prev>>16);
+		*out++ = (uInt8)(prev>>24);
+		for(acc=0,accBits=0,iSamp=1;iSamp<numSamples&&width>0;++iSamp) {
+			delta = (int32)(((codes[iSamp*numChannels+iChan]-prev)&mask)<<shift) >> shift;
+			zigzag = (uInt32)delta<<1 ^ (uInt32)(delta>>31);
+			prev = codes[iSamp*numChannels+iChan];
+			acc = acc<<width | zigzag;
+			for(accBits+=width;accBits>=8;accBits-=8)
+				*out++ = (uInt8)(acc>>(accBits-8));
+		}
+		if( accBits )
+			*out++ = (uInt8)(acc<<(8-accBits));
+	}
+	return (uInt32)(out-ring->encoded);
+}
+
+/*********************************************/
+// Data File Writer
+/*********************************************/
+static bool32 OpenDataFileWriter(DataFileWriter *writer, char filePath[], uInt64 headerSize, WriteEngine engine)
+{
+	memset(writer,0,sizeof(DataFileWriter));
+	writer->size = headerSize;
+#ifdef HAVE_DIRECT_WRITE_ENGINES
+	writer->fd = -1;
+	if( engine!=StdioWriteEngine ) {
+		uInt32	i;
+
+		// O_DIRECT is refused by some file systems, fall back to the page cache for those
+		if( (writer->fd=open(filePath,O_RDWR|O_DIRECT))<0 && (writer->fd=open(filePath,O_RDWR))<0 )
+			return FALSE;
+		writer->numChunks = numWriteChunks<1 ? 1 : numWriteChunks>MaxWriteChunks ? MaxWriteChunks : numWriteChunks;
+		writer->chunkBytes = (writeChunkBytes+WriteAlignment-1)/WriteAlignment*WriteAlignment;
+		for(i=0;i<writer->numChunks;++i)
+			if( posix_memalign((void**)&writer->chunks[i],WriteAlignment,writer->chunkBytes) ) {
+				writer->chunks[i] = NULL;
+				CloseDataFileWriter(writer);
+				return FALSE;
+			}
+		// Direct writes start on an aligned offset, so stage the end of the header again
+		writer->chunkOffset = headerSize/WriteAlignment*WriteAlignment;
+		writer->fill = (uInt32)(headerSize-writer->chunkOffset);
+		if( writer->fill && pread(writer->fd,writer->chunks[0],WriteAlignment,(off_t)writer->chunkOffset)<(ssize_t)writer->fill ) {
+			CloseDataFileWriter(writer);
+			return FALSE;
+		}
+#ifdef HAVE_IO_URING
+		if( engine==IoUringWriteEngine && SetupIoUring(&writer->ring,writer->numChunks) )
+			writer->engine = IoUringWriteEngine;
+		else
+#endif
+			writer->engine = PwriteWriteEngine;
+		return TRUE;
+	}
+#endif
+	writer->engine = StdioWriteEngine;
+	return (writer->file=fopen(filePath,"ab"))!=NULL;
+}
+
+static int WriteDataToDataFile(uInt16 *data, int32 numBytes)
+{
+	DataFileWriter	*writer=&gSegment->writer;
+
+	writer->size += numBytes;
+	if( writer->engine==StdioWriteEngine ) {
+		if( writer->file )
+			fwrite(data,sizeof(uInt8),numBytes,writer->file);
+		return 0;
+	}
+#ifdef HAVE_DIRECT_WRITE_ENGINES
+	{
+		const uInt8	*src=(const uInt8*)data;
+		uInt32		count;
+
+		while( numBytes>0 && !writer->failed ) {
+			count = writer->chunkBytes-writer->fill;
+			if( count>(uInt32)numBytes )
+				count = numBytes;
+			memcpy(writer->chunks[writer->current]+writer->fill,src,count);
+			writer->fill += count;
+			src += count;
+			numBytes -= count;
+			if( writer->fill==writer->chunkBytes )
+				FlushWriteChunk(writer);
+		}
+	}
+#endif
+	return writer->failed ? -1 : 0;
+}
+
 static void CloseDataFile(void)
 {
-	if( gFileHandle )
-		fclose(gFileHandle);
+	StopSegmentRotation(&gRotation);
+	CloseDataFileSegment(gSegment);
+	free(gHeader.text);
+	memset(&gHeader,0,sizeof(gHeader));
+}
+
+static void CloseDataFileWriter(DataFileWriter *writer)
+{
+	if( writer->file )
+		fclose(writer->file);
+	writer->file = NULL;
+#ifdef HAVE_DIRECT_WRITE_ENGINES
+	{
+		uInt32	i;
+
+		if( writer->fd>=0 ) {
+			// The last chunk is padded to the alignment and the padding cut off again
+			if( writer->fill && writer->chunks[writer->current] ) {
+				memset(writer->chunks[writer->current]+writer->fill,0,writer->chunkBytes-writer->fill);
+				writer->fill = (writer->fill+WriteAlignment-1)/WriteAlignment*WriteAlignment;
+				FlushWriteChunk(writer);
+			}
+#ifdef HAVE_IO_URING
+			if( writer->engine==IoUringWriteEngine ) {
+				while( writer->inFlight && !writer->failed )
+					ReapWriteChunk(writer);
+				TeardownIoUring(&writer->ring);
+			}
+#endif
+			if( writer->engine!=StdioWriteEngine && ftruncate(writer->fd,(off_t)writer->size) )
+				writer->failed = TRUE;
+			close(writer->fd);
+		}
+		writer->fd = -1;
+		for(i=0;i<MaxWriteChunks;++i)
+			free(writer->chunks[i]);
+		memset(writer->chunks,0,sizeof(writer->chunks));
+	}
+#endif
+	if( writer->failed )
+		puts("Error: There was a problem writing to the file.");
+	writer->failed = FALSE;
+}
+
+// Returns the size of the start of the data file that is entirely written.
+// The direct engines stage the end of the stream in a chunk, and io_uring
+// may complete a chunk before the chunks ahead of it.
+static uInt64 GetWrittenDataFileBytes(DataFileWriter *writer)
+{
+	uInt64	written=writer->size;
+#ifdef HAVE_DIRECT_WRITE_ENGINES
+	if( writer->engine!=StdioWriteEngine )
+		written = writer->chunkOffset;
+#endif
+#ifdef HAVE_IO_URING
+	{
+		uInt32	i;
+
+		for(i=0;writer->engine==IoUringWriteEngine&&i<writer->numChunks;++i)
+			if( writer->pending[i] && writer->pendingOffsets[i]<written )
+				written = writer->pendingOffsets[i];
+	}
+#endif
+	return written;
+}
+
+#ifdef HAVE_DIRECT_WRITE_ENGINES
+// Writes the current chunk at its aligned file offset and moves on to the next chunk
+static void FlushWriteChunk(DataFileWriter *writer)
+{
+	uInt8	*chunk=writer->chunks[writer->current];
+	uInt32	bytes=writer->fill;
+	uInt64	offset=writer->chunkOffset;
+
+	// Reserve the file extents ahead of the data, so the writes do not allocate
+	if( offset+bytes>writer->preallocated ) {
+		if( writer->preallocated<offset )
+			writer->preallocated = offset;
+#ifdef FALLOC_FL_KEEP_SIZE
+		fallocate(writer->fd,FALLOC_FL_KEEP_SIZE,(off_t)writer->preallocated,(off_t)preallocateBytes);
+#endif
+		writer->preallocated += preallocateBytes;
+	}
+#ifdef HAVE_IO_URING
+	if( writer->engine==IoUringWriteEngine ) {
+		if( SubmitIoUringWrite(&writer->ring,writer->fd,chunk,bytes,offset,writer->current) ) {
+			writer->pending[writer->current] = bytes;
+			writer->pendingOffsets[writer->current] = offset;
+			++writer->inFlight;
+		}
+		else
+			writer->failed = TRUE;
+		writer->current = (writer->current+1)%writer->numChunks;
+		while( writer->pending[writer->current] && !writer->failed )
+			ReapWriteChunk(writer);
+	}
+	else
+#endif
+	{
+		ssize_t	written;
+
+		while( bytes ) {
+			if( (written=pwrite(writer->fd,chunk,bytes,(off_t)offset))<=0 ) {
+				writer->failed = TRUE;
+				break;
+			}
+			chunk += written;
+			offset += written;
+			bytes -= (uInt32)written;
+		}
+		writer->current = (writer->current+1)%writer->numChunks;
+	}
+	writer->chunkOffset += writer->chunkBytes;
+	writer->fill = 0;
+}
+#endif
+
+#ifdef HAVE_IO_URING
+static void ReapWriteChunk(DataFileWriter *writer)
+{
+	uInt32	index;
+	int32	result;
+
+	if( !WaitIoUringCompletion(&writer->ring,&index,&result) || index>=writer->numChunks ) {
+		writer->failed = TRUE;
+		writer->inFlight = 0;
+		memset(writer->pending,0,sizeof(writer->pending));
+		return;
+	}
+	// A short write is an error too, the chunks are not resubmitted
+	if( result<0 || (uInt32)result!=writer->pending[index] )
+		writer->failed = TRUE;
+	writer->pending[index] = 0;
+	--writer->inFlight;
+}
+
+// Minimal io_uring set up through the raw system calls, so the example
+// does not need liburing on the target.
+static bool32 SetupIoUring(IoUring *ring, uInt32 entries)
+{
+	struct io_uring_params	params;
+	uInt8					*sq,*cq;
+
+	memset(ring,0,sizeof(IoUring));
+	memset(&params,0,sizeof(params));
+	if( (ring->fd=(int)syscall(__NR_io_uring_setup,entries,&params))<0 )
+		return FALSE;
+	ring->sqRingBytes = params.sq_off.array + params.sq_entries*sizeof(uInt32);
+	ring->cqRingBytes = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+	ring->sqesBytes = params.sq_entries*sizeof(struct io_uring_sqe);
+	ring->sqRing = mmap(NULL,ring->sqRingBytes,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ring->fd,IORING_OFF_SQ_RING);
+	ring->cqRing = mmap(NULL,ring->cqRingBytes,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ring->fd,IORING_OFF_CQ_RING);
+	ring->sqes = (struct io_uring_sqe*)mmap(NULL,ring->sqesBytes,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ring->fd,IORING_OFF_SQES);
+	if( ring->sqRing==MAP_FAILED || ring->cqRing==MAP_FAILED || ring->sqes==MAP_FAILED ) {
+		TeardownIoUring(ring);
+		return FALSE;
+	}
+	sq = (uInt8*)ring->sqRing;
+	cq = (uInt8*)ring->cqRing;
+	ring->sqHead = (uInt32*)(sq+params.sq_off.head);
+	ring->sqTail = (uInt32*)(sq+params.sq_off.tail);
+	ring->sqMask = (uInt32*)(sq+params.sq_off.ring_mask);
+	ring->sqArray = (uInt32*)(sq+params.sq_off.array);
+	ring->cqHead = (uInt32*)(cq+params.cq_off.head);
+	ring->cqTail = (uInt32*)(cq+params.cq_off.tail);
+	ring->cqMask = (uInt32*)(cq+params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(cq+params.cq_off.cqes);
+	return TRUE;
+}
+
+static bool32 SubmitIoUringWrite(IoUring *ring, int fd, void *buffer, uInt32 numBytes, uInt64 offset, uInt32 index)
+{
+	uInt32				tail=*ring->sqTail,slot=tail&*ring->sqMask;
+	struct io_uring_sqe	*sqe=&ring->sqes[slot];
+
+	ring->iovecs[index].iov_base = buffer;
+	ring->iovecs[index].iov_len = numBytes;
+	memset(sqe,0,sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = fd;
+	sqe->addr = (uInt64)(size_t)&ring->iovecs[index];
+	sqe->len = 1;
+	sqe->off = offset;
+	sqe->user_data = index;
+	ring->sqArray[slot] = slot;
+	__atomic_store_n(ring->sqTail,tail+1,__ATOMIC_RELEASE);
+	// The write is submitted once the kernel has moved the SQ head past it
+	while( __atomic_load_n(ring->sqHead,__ATOMIC_ACQUIRE)==tail ) {
+		if( syscall(__NR_io_uring_enter,ring->fd,1,0,0,NULL,0)<0 && errno!=EINTR && errno!=EAGAIN ) {
+			// Withdraw the entry, so a later submission does not write the chunk after all
+			if( __atomic_load_n(ring->sqHead,__ATOMIC_ACQUIRE)==tail ) {
+				__atomic_store_n(ring->sqTail,tail,__ATOMIC_RELEASE);
+				return FALSE;
+			}
+			break;
+		}
+	}
+	return TRUE;
+}
+
+static bool32 WaitIoUringCompletion(IoUring *ring, uInt32 *index, int32 *result)
+{
+	uInt32				head=*ring->cqHead;
+	struct io_uring_cqe	*cqe;
+
+	while( head==__atomic_load_n(ring->cqTail,__ATOMIC_ACQUIRE) )
+		if( syscall(__NR_io_uring_enter,ring->fd,0,1,IORING_ENTER_GETEVENTS,NULL,0)<0 && errno!=EINTR )
+			return FALSE;
+	cqe = &ring->cqes[head&*ring->cqMask];
+	*index = (uInt32)cqe->user_data;
+	*result = cqe->res;
+	__atomic_store_n(ring->cqHead,head+1,__ATOMIC_RELEASE);
+	return TRUE;
+}
+
+static void TeardownIoUring(IoUring *ring)
+{
+	if( ring->sqes && ring->sqes!=MAP_FAILED )
+		munmap(ring->sqes,ring->sqesBytes);
+	if( ring->cqRing && ring->cqRing!=MAP_FAILED )
+		munmap(ring->cqRing,ring->cqRingBytes);
+	if( ring->sqRing && ring->sqRing!=MAP_FAILED )
+		munmap(ring->sqRing,ring->sqRingBytes);
+	if( ring->fd>=0 )
+		close(ring->fd);
+	memset(ring,0,sizeof(IoUring));
+	ring->fd = -1;
+}
+#endif
+
+/*********************************************/
+// Segment Rotation
+/*********************************************/
+// Without rotation the stream goes to the file path itself. With rotation
+// segment N goes to the file path with -N inserted before the extension.
+static void MakeSegmentPath(char segmentPath[], uInt32 number)
+{
+	char	*dot=strrchr(gFilePath,'.');
+
+	strcpy(segmentPath,gFilePath);
+	if( segmentMegabytes==0 && segmentSeconds==0 )
+		return;
+	if( dot==NULL || strchr(dot,'\\') || strchr(dot,'/') )
+		dot = gFilePath + strlen(gFilePath);
+	sprintf(segmentPath+(dot-gFilePath),"-%05u%s",(unsigned)number,dot);
+}
+
+static bool32 OpenDataFileSegment(DataFileSegment *segment, uInt32 number)
+{
+	char	filePath[sizeof(gFilePath)+16];
+	uInt64	numBytes=(uInt64)segmentMegabytes*1048576;
+
+	memset(segment,0,sizeof(DataFileSegment));
+	segment->number = number;
+	MakeSegmentPath(filePath,number);
+	if( !WriteDataFileHeader(filePath) || !OpenDataFileWriter(&segment->writer,filePath,gHeaderSize,writeEngine) )
+		return FALSE;
+	segment->open = TRUE;
+	if( (writeBlockIndex || segmentMegabytes || segmentSeconds) && !OpenBlockIndex(segment,filePath) ) {
+		CloseDataFileSegment(segment);
+		return FALSE;
+	}
+	// Reserve the whole segment now rather than while the data streams in
+	if( numBytes ) {
+#ifdef _WIN32
+		FILE_ALLOCATION_INFO	allocation;
+
+		allocation.AllocationSize.QuadPart = gHeaderSize+numBytes;
+		if( segment->writer.file )
+			SetFileInformationByHandle((HANDLE)_get_osfhandle(_fileno(segment->writer.file)),FileAllocationInfo,&allocation,sizeof(allocation));
+#elif defined(HAVE_DIRECT_WRITE_ENGINES) && defined(FALLOC_FL_KEEP_SIZE)
+		if( segment->writer.engine==StdioWriteEngine )
+			fallocate(fileno(segment->writer.file),FALLOC_FL_KEEP_SIZE,(off_t)gHeaderSize,(off_t)numBytes);
+		else if( fallocate(segment->writer.fd,FALLOC_FL_KEEP_SIZE,(off_t)gHeaderSize,(off_t)numBytes)==0 )
+			segment->writer.preallocated = gHeaderSize+numBytes;
+#endif
+	}
+	return TRUE;
+}
+
+static void CloseDataFileSegment(DataFileSegment *segment)
+{
+	if( !segment->open )
+		return;
+	CloseDataFileWriter(&segment->writer);
+	// The padding of the last chunk has been cut off
+	ReleaseBlockIndexEntries(segment,segment->writer.size);
+	CloseBlockIndex(segment);
+	segment->open = FALSE;
+}
+
+static bool32 StartSegmentRotation(SegmentRotation *rotation)
+{
+	memset(rotation,0,sizeof(SegmentRotation));
+	rotation->next = gSegment==&gSegments[0] ? &gSegments[1] : &gSegments[0];
+	rotation->next->number = gSegment->number+1;
+	if( !WriterSemaphoreInit(&rotation->request) )
+		return FALSE;
+	if( !WriterSemaphoreInit(&rotation->ready) ) {
+		WriterSemaphoreDestroy(&rotation->request);
+		return FALSE;
+	}
+	if( !WriterThreadCreate(&rotation->opener,SegmentOpenerThread,rotation) ) {
+		WriterSemaphoreDestroy(&rotation->ready);
+		WriterSemaphoreDestroy(&rotation->request);
+		return FALSE;
+	}
+	rotation->running = rotation->pending = TRUE;
+	WriterSemaphorePost(&rotation->request);
+	return TRUE;
+}
+
+// Stops the opener thread and deletes the segment it opened ahead of time
+static void StopSegmentRotation(SegmentRotation *rotation)
+{
+	char	filePath[sizeof(gFilePath)+16];
+
+	if( !rotation->running )
+		return;
+	if( rotation->pending )
+		WriterSemaphoreWait(&rotation->ready);
+	rotation->quit = TRUE;
+	WriterSemaphorePost(&rotation->request);
+	WriterThreadJoin(rotation->opener);
+	WriterSemaphoreDestroy(&rotation->ready);
+	WriterSemaphoreDestroy(&rotation->request);
+	if( rotation->nextOpened ) {
+		CloseDataFileSegment(rotation->next);
+		MakeSegmentPath(filePath,rotation->next->number);
+		remove(filePath);
+		strcat(filePath,".idx");
+		remove(filePath);
+	}
+	rotation->running = FALSE;
+}
+
+// Called by the disk writer thread at a block boundary. It only waits if
+// the opener thread has not finished with the previous rotation yet. When
+// the open failed, the current segment keeps growing and the open is asked
+// for again every SegmentRetrySeconds. Its result is then polled rather
+// than waited for, so a failing disk does not stall the rings. Returns TRUE
+// once the stream writes to the next segment.
+static bool32 RotateDataFileSegment(SegmentRotation *rotation)
+{
+	DataFileSegment	*segment=gSegment;
+
+	if( !rotation->pending ) {
+		if( GetTimeInSeconds()>=rotation->retryTime ) {
+			rotation->pending = rotation->retrying = TRUE;
+			WriterSemaphorePost(&rotation->request);
+		}
+		return FALSE;
+	}
+	if( rotation->retrying ) {
+		if( !WriterSemaphoreTryWait(&rotation->ready) )
+			return FALSE;
+	}
+	else
+		WriterSemaphoreWait(&rotation->ready);
+	rotation->pending = rotation->retrying = FALSE;
+	if( !rotation->nextOpened ) {
+		if( rotation->failures++==0 )
+			printf("Error: Could not open segment %u. Retrying every %.0f s.\n",(unsigned)rotation->next->number,SegmentRetrySeconds);
+		rotation->retryTime = GetTimeInSeconds() + SegmentRetrySeconds;
+		return FALSE;
+	}
+	rotation->failures = 0;
+	gSegment = rotation->next;
+	rotation->next = rotation->retired = segment;
+	rotation->next->number = gSegment->number+1;
+	rotation->pending = TRUE;
+	WriterSemaphorePost(&rotation->request);
+	return TRUE;
+}
+
+static WriterThreadResult WriterThreadCall SegmentOpenerThread(void *arg)
+{
+	SegmentRotation	*rotation=(SegmentRotation*)arg;
+
+	for(;;) {
+		WriterSemaphoreWait(&rotation->request);
+		if( rotation->quit )
+			break;
+		if( rotation->retired ) {
+			CloseDataFileSegment(rotation->retired);
+			rotation->retired = NULL;
+		}
+		rotation->nextOpened = OpenDataFileSegment(rotation->next,rotation->next->number);
+		WriterSemaphorePost(&rotation->ready);
+	}
+	return 0;
+}
+
+/*********************************************/
+// Block Index
+/*********************************************/
+static bool32 OpenBlockIndex(DataFileSegment *segment, char filePath[])
+{
+	BlockIndexHeader	header;
+	char				*indexPath;
+
+	if( (indexPath=(char*)malloc(strlen(filePath)+5))==NULL )
+		return FALSE;
+	sprintf(indexPath,"%s.idx",filePath);
+	segment->indexHandle = fopen(indexPath,"wb");
+	free(indexPath);
+	if( segment->indexHandle==NULL )
+		return FALSE;
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,BlockIndexMagic,sizeof(header.magic));
+	header.version = BlockIndexVersion;
+	header.entryBytes = sizeof(BlockIndexEntry);
+	header.dataHeaderSize = gHeaderSize;
+	header.readBlockSizeInBytes = gReadBlockSize[0];
+	header.readBlockSize = gSampsPerChan;
+	// A reader following the file needs the header before the first entry
+	return fwrite(&header,sizeof(header),1,segment->indexHandle)==1 && fflush(segment->indexHandle)==0;
+}
+
+// Called by the disk writer thread just before the block goes to the data
+// file. The sample numbers run on across segments, which is what lets the
+// reader stitch them together. The direct engines hold the entry until
+// the whole record is in the file, so a reader following the file can
+// stop at the last record of the index. An index with a record missing
+// would mislead the reader, so the segment stops at a failed entry.
+static void AppendBlockIndexEntry(DataFileSegment *segment, uInt32 task, const BlockStamp *stamp, uInt32 recordBytes)
+{
+	BlockIndexEntry	entry,*held;
+
+	if( segment->indexHandle==NULL || segment->writer.failed )
+		return;
+	entry.byteOffset = segment->writer.size;
+	entry.firstSample = stamp->firstSample;
+	entry.timestamp = stamp->timestamp;
+	entry.task = task;
+	entry.recordBytes = recordBytes;
+	if( segment->writer.engine==StdioWriteEngine ) {
+		fwrite(&entry,sizeof(entry),1,segment->indexHandle);
+		return;
+	}
+	if( segment->numHeld==segment->maxHeld ) {
+		if( (held=(BlockIndexEntry*)realloc(segment->heldEntries,sizeof(BlockIndexEntry)*(segment->maxHeld+64)))==NULL ) {
+			puts("Error: Not enough memory for the block index. No more blocks are written to the segment.");
+			segment->writer.failed = TRUE;
+			return;
+		}
+		segment->heldEntries = held;
+		segment->maxHeld += 64;
+	}
+	segment->heldEntries[segment->numHeld++] = entry;
+}
+
+// Writes the held index entries of the records that end within the first
+// writtenBytes of the data file
+static void ReleaseBlockIndexEntries(DataFileSegment *segment, uInt64 writtenBytes)
+{
+	uInt32	i;
+
+	for(i=0;i<segment->numHeld&&segment->heldEntries[i].byteOffset+segment->heldEntries[i].recordBytes<=writtenBytes;++i);
+	if( i==0 || segment->indexHandle==NULL )
+		return;
+	fwrite(segment->heldEntries,sizeof(BlockIndexEntry),i,segment->indexHandle);
+	fflush(segment->indexHandle);
+	segment->numHeld -= i;
+	memmove(segment->heldEntries,segment->heldEntries+i,sizeof(BlockIndexEntry)*segment->numHeld);
+}
+
+static void CloseBlockIndex(DataFileSegment *segment)
+{
+	if( segment->indexHandle )
+		fclose(segment->indexHandle);
+	segment->indexHandle = NULL;
+	free(segment->heldEntries);
+	segment->heldEntries = NULL;
+	segment->numHeld = segment->maxHeld = 0;
+}
+
+/*********************************************/
+// Block Checksums
+/*********************************************/
+// Returns the CRC32C of numBytes at data, continuing the crc of the bytes
+// before them, which is 0 for the first bytes
+static uInt32 ComputeCrc32c(uInt32 crc, const uInt8 *data, size_t numBytes)
+{
+	static uInt32	(*compute)(uInt32 crc, const uInt8 *data, size_t numBytes)=NULL;
+
+	if( !writeBlockChecksums )
+		return 0;
+	if( compute==NULL ) {
+		compute = ComputeCrc32cTable;
+#ifdef HAVE_X86_CRC32C
+		__builtin_cpu_init();
+		if( __builtin_cpu_supports("sse4.2") )
+			compute = ComputeCrc32cSSE42;
+#endif
+	}
+	return ~compute(~crc,data,numBytes);
+}
+
+static uInt32 ComputeCrc32cTable(uInt32 crc, const uInt8 *data, size_t numBytes)
+{
+	static uInt32	table[256];
+	static bool32	tableBuilt=FALSE;
+	uInt32			i,bit,entry;
+
+	if( !tableBuilt ) {
+		for(i=0;i<256;++i) {
+			for(entry=i,bit=0;bit<8;++bit)
+				entry = entry>>1 ^ (entry&1?Crc32cPolynomial:0);
+			table[i] = entry;
+		}
+		tableBuilt = TRUE;
+	}
+	while( numBytes-- )
+		crc = table[(crc^*data++)&0xFF] ^ crc>>8;
+	return crc;
+}
+
+#ifdef HAVE_X86_CRC32C
+// Eight bytes per crc32 instruction, which keeps the checksum of a block
+// far below the time it takes to write it
+__attribute__((target("sse4.2")))
+static uInt32 ComputeCrc32cSSE42(uInt32 crc, const uInt8 *data, size_t numBytes)
+{
+	uInt32	word32;
+#ifdef __x86_64__
+	uInt64	crc64=crc,word;
+
+	for(;numBytes>=8;numBytes-=8,data+=8) {
+		memcpy(&word,data,8);
+		crc64 = _mm_crc32_u64(crc64,word);
+	}
+	crc = (uInt32)crc64;
+#endif
+	for(;numBytes>=4;numBytes-=4,data+=4) {
+		memcpy(&word32,data,4);
+		crc = _mm_crc32_u32(crc,word32);
+	}
+	while( numBytes-- )
+		crc = _mm_crc32_u8(crc,*data++);
+	return crc;
+}
+#endif
+
+/*********************************************/
+// Write Benchmark
+/*********************************************/
+static int CompareLatencies(const void *a, const void *b)
+{
+	return *(const double*)a<*(const double*)b ? -1 : *(const double*)a>*(const double*)b;
+}
+
+// Streams benchmarkWriteMegabytes of synthetic read blocks through each
+// write engine. The time includes flushing the data to the disk, so the
+// stdio figure is not just the speed of the page cache.
+static void BenchmarkWriteEngines(char filePath[], uInt32 blockBytes)
+{
+	static const char	*engineNames[]={"stdio","pwrite","io_uring"};
+	static const char	header[]="[DAQCompressedBinaryFile]\n";
+	uInt32				numBlocks=(uInt32)((uInt64)benchmarkWriteMegabytes*1048576/blockBytes),i;
+	uInt16				*block;
+	double				*latencies,start,blockStart,elapsed;
+	FILE				*f;
+	int					engine;
+
+	if( numBlocks==0 || (block=(uInt16*)malloc(blockBytes))==NULL )
+		return;
+	if( (latencies=(double*)malloc(sizeof(double)*numBlocks))==NULL ) {
+		free(block);
+		return;
+	}
+	for(i=0;i<blockBytes;++i)
+		((uInt8*)block)[i] = (uInt8)(i*7);
+	printf("Write benchmark (%u MB in %u byte blocks):\n",(unsigned)benchmarkWriteMegabytes,(unsigned)blockBytes);
+	for(engine=StdioWriteEngine;engine<=IoUringWriteEngine;++engine) {
+		if( (f=fopen(filePath,"wb"))==NULL )
+			break;
+		fputs(header,f);
+		fclose(f);
+		if( !OpenDataFileWriter(&gSegment->writer,filePath,sizeof(header)-1,(WriteEngine)engine) || gSegment->writer.engine!=engine ) {
+			CloseDataFileWriter(&gSegment->writer);
+			printf("  %s:\tnot supported\n",engineNames[engine]);
+			continue;
+		}
+		start = GetTimeInSeconds();
+		for(i=0;i<numBlocks;++i) {
+			blockStart = GetTimeInSeconds();
+			WriteDataToDataFile(block,blockBytes);
+			latencies[i] = GetTimeInSeconds()-blockStart;
+		}
+		SyncDataFile(&gSegment->writer);
+		CloseDataFileWriter(&gSegment->writer);
+		elapsed = GetTimeInSeconds()-start;
+		qsort(latencies,numBlocks,sizeof(double),CompareLatencies);
+		printf("  %s:\t%.1f MB/s\tp99 write latency %.1f us\tmax %.1f us\n",engineNames[engine],
+			benchmarkWriteMegabytes/elapsed,latencies[numBlocks*99/100]*1e6,latencies[numBlocks-1]*1e6);
+	}
+	free(latencies);
+	free(block);
+}
+
+static void SyncDataFile(DataFileWriter *writer)
+{
+	if( writer->file ) {
+		fflush(writer->file);
+#ifdef _WIN32
+		_commit(_fileno(writer->file));
+#else
+		fsync(fileno(writer->file));
+#endif
+	}
+}
+
+static double GetTimeInSeconds(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER	frequency,counter;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart/frequency.QuadPart;
+#else
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return now.tv_sec + now.tv_nsec*1e-9;
+#endif
+}
+
+// Wall clock time in ns since 1970-01-01 UTC
+static uInt64 GetHostTimestamp(void)
+{
+#ifdef _WIN32
+	FILETIME		now;
+	ULARGE_INTEGER	ticks;
+
+	GetSystemTimeAsFileTime(&now);
+	ticks.LowPart = now.dwLowDateTime;
+	ticks.HighPart = now.dwHighDateTime;
+	// FILETIME counts 100 ns ticks since 1601-01-01
+	return (ticks.QuadPart-116444736000000000ULL)*100;
+#else
+	struct timespec	now;
+
+	clock_gettime(CLOCK_REALTIME,&now);
+	return (uInt64)now.tv_sec*1000000000 + now.tv_nsec;
+#endif
 }
 
-static bool32 CreateDataFileTaskEntry(TaskHandle taskHandle, uInt32 numChannels, uInt32 sampsToRead)
+static bool32 CreateDataFileTaskEntry(TaskHandle taskHandle, uInt32 taskNum, uInt32 numChannels, uInt32 sampsToRead, uInt32 firstChannel)
 {
 	char    taskName[1000];
 	bool32  success;
+	uInt32  i;
 
-	strcat(gHeader+strlen(gHeader),"[Task0]\n");
+	AppendToHeader("[Task%u]\n",(unsigned)taskNum);
 	DAQmxGetTaskName(taskHandle,taskName,1000);
-	sprintf(gHeader+strlen(gHeader),"Name=%s\n",taskName);
-	sprintf(gHeader+strlen(gHeader),"NumberOfChannels=%d\n",(int)numChannels);
-	sprintf(gHeader+strlen(gHeader),"ReadBlockSize=%d\n",(int)sampsToRead);
-	success = CalculateReadBlockSize(taskHandle,numChannels,sampsToRead);
-	sprintf(gHeader+strlen(gHeader),"ReadBlockSizeInBytes=%d\n",(int)gReadBlockSize);
+	AppendToHeader("Name=%s\n",taskName);
+	AppendToHeader("NumberOfChannels=%d\n",(int)numChannels);
+	AppendToHeader("ReadBlockSize=%d\n",(int)sampsToRead);
+	success = CalculateReadBlockSize(taskHandle,taskNum,numChannels,sampsToRead);
+	AppendToHeader("ReadBlockSizeInBytes=%d\n",(int)gReadBlockSize[taskNum]);
+	// Encoded blocks are preceded by the BlockLengthBytes little-endian length of the stored block
+	gEncodeBlocks[taskNum] = deltaEncodeBlocks && gCodeBits[taskNum]>=1 && gCodeBits[taskNum]<=32;
+	if( gEncodeBlocks[taskNum] )
+		AppendToHeader("BlockEncoding=DeltaZigzag\n");
+	// Blocks of variable size are preceded by the BlockSampleCountBytes
+	// little-endian number of samples per channel they hold, at most
+	// ReadBlockSize
+	if( readAvailableSamples )
+		AppendToHeader("VariableBlockSize=TRUE\n");
+	// The file channel each channel of the raw data goes to, counted across all tasks
+	if( gNumTasks>1 ) {
+		AppendToHeader("ChannelMap=");
+		for(i=0;i<numChannels;++i)
+			AppendToHeader("%u;",(unsigned)(firstChannel+i));
+		AppendToHeader("\n");
+	}
 	return success;
 }
 
-static bool32 CreateDataFileChannelEntry(TaskHandle taskHandle, int idx)
+static bool32 CreateDataFileChannelEntry(TaskHandle taskHandle, uInt32 taskNum, int idx)
 {
 	char    channelName[1000];
 	float64 f64,resolution,coeffs[1000];
@@ -237,51 +1742,120 @@ static bool32 CreateDataFileChannelEntry(TaskHandle taskHandle, int idx)
 	int32   i32,numCoeffs;
 
 	DAQmxGetNthTaskChannel(taskHandle,idx+1,channelName,1000);
-	sprintf(gHeader+strlen(gHeader),"[Task0Channel%d]\nName=%s\n",idx,channelName);
+	AppendToHeader("[Task%uChannel%d]\nName=%s\n",(unsigned)taskNum,idx,channelName);
 	DAQmxGetAIResolution(taskHandle,channelName,&resolution);
-	sprintf(gHeader+strlen(gHeader),"RawSampleResolution=%u\n",(unsigned)resolution);
+	AppendToHeader("RawSampleResolution=%u\n",(unsigned)resolution);
 	DAQmxGetAIRawSampSize(taskHandle,channelName,&rawSampSize);
-	sprintf(gHeader+strlen(gHeader),"RawSampleSizeInBits=%u\n",(unsigned)rawSampSize);
+	AppendToHeader("RawSampleSizeInBits=%u\n",(unsigned)rawSampSize);
 	DAQmxGetAIRawSampJustification(taskHandle,channelName,&i32);
-	sprintf(gHeader+strlen(gHeader),"RawSampleJustification=%s\n",i32==DAQmx_Val_LeftJustified?"Left":"Right");
+	AppendToHeader("RawSampleJustification=%s\n",i32==DAQmx_Val_LeftJustified?"Left":"Right");
 	DAQmxGetAIMin(taskHandle,channelName,&f64);
-	sprintf(gHeader+strlen(gHeader),"SignedNumber=%s\n",f64<0?"TRUE":"FALSE");
+	AppendToHeader("SignedNumber=%s\n",f64<0?"TRUE":"FALSE");
 	DAQmxGetAIRawDataCompressionType(taskHandle,channelName,&i32);
 	switch( i32 ) {
 		case DAQmx_Val_LosslessPacking:
-			strcat(gHeader,"CompressionType=LosslessPacking\n");
+			AppendToHeader("CompressionType=LosslessPacking\n");
 			DAQmxGetAIResolution(taskHandle,channelName,&f64);
 			u32 = (uInt32)f64;
 			break;
 		case DAQmx_Val_LossyLSBRemoval:
-			strcat(gHeader,"CompressionType=LossyLSBRemoval\n");
+			AppendToHeader("CompressionType=LossyLSBRemoval\n");
 			DAQmxGetAILossyLSBRemovalCompressedSampSize(taskHandle,channelName,&u32);
 			break;
 		default:
-			strcat(gHeader,"CompressionType=None\n");
+			AppendToHeader("CompressionType=None\n");
 			u32 = rawSampSize;
 			break;
 	}
-	sprintf(gHeader+strlen(gHeader),"CompressedSampleSizeInBits=%u\n",(unsigned)u32);
-	sprintf(gHeader+strlen(gHeader),"CompressionByteOrder=%s\n",rawSampSize==resolution||i32==DAQmx_Val_None?"LittleEndian":"BigEndian");
+	AppendToHeader("CompressedSampleSizeInBits=%u\n",(unsigned)u32);
+	AppendToHeader("CompressionByteOrder=%s\n",rawSampSize==resolution||i32==DAQmx_Val_None?"LittleEndian":"BigEndian");
 
 	numCoeffs = DAQmxGetAIDevScalingCoeff(taskHandle,channelName,NULL,0);
 	if( numCoeffs>1000 )
 		numCoeffs = 1000;
 	DAQmxGetAIDevScalingCoeff(taskHandle,channelName,coeffs,numCoeffs);
-	strcat(gHeader,"PolynomialScalingCoeffs=");
+	AppendToHeader("PolynomialScalingCoeffs=");
 	for(i32=0;i32<numCoeffs;++i32)
-		sprintf(gHeader+strlen(gHeader),"%0.15lE;",coeffs[i32]);
-	strcat(gHeader,"\n");
+		AppendToHeader("%0.15lE;",coeffs[i32]);
+	AppendToHeader("\n");
+	// The accuracy bound of a calibrated compressed sample size
+	if( gNoiseFloor[taskNum] )
+		AppendToHeader("NoiseFloorInLSBs=%.3f\nLossyErrorBoundInLSBs=%u\n",gNoiseFloor[taskNum][idx],(unsigned)gLossyErrorBound[taskNum][idx]);
 
 	return FALSE;
 }
 
-static int CalculateReadBlockSize(TaskHandle taskHandle, uInt32 numChannels, uInt32 sampsPerChan)
+// Acquires a short burst and measures the noise floor of each channel from
+// the differences between consecutive samples, which slow signals barely
+// change. LSB removal truncates, so removing k bits lowers a sample by 0
+// to 2^k-1 LSBs. The error is one-sided, with a mean bias of (2^k-1)/2
+// LSBs and an RMS of about 2^k/sqrt(12) around it. The task is switched
+// to LossyLSBRemoval, and every channel keeps its own resolution less the
+// most bits whose RMS stays within lossyErrorBudget of its noise floor.
+static bool32 CalibrateLossySampleSize(TaskHandle taskHandle, uInt32 taskNum, uInt32 numChannels)
 {
-	uInt32  rawDataWidth,rawSampSize=1,val;
+	int32       error=0,read=0,justification,numCoeffs;
+	char        errBuff[2048]={'\0'},channelName[1000];
+	float64     *burst=NULL,resolution=0.0,coeffs[1000],lsbVolts,sum,delta;
+	uInt32      rawSampSize,bits,iChan,iSamp;
+	bool32      success=FALSE;
+
+	if( (burst=(float64*)malloc(sizeof(float64)*calibrationSamples*numChannels))==NULL
+	 || (gNoiseFloor[taskNum]=(float64*)calloc(numChannels,sizeof(float64)))==NULL
+	 || (gLossyErrorBound[taskNum]=(uInt32*)calloc(numChannels,sizeof(uInt32)))==NULL ) {
+		puts("Not enough memory");
+		goto Error;
+	}
+	DAQmxErrChk (DAQmxStartTask(taskHandle));
+	DAQmxErrChk (DAQmxReadAnalogF64(taskHandle,calibrationSamples,10.0,DAQmx_Val_GroupByScanNumber,burst,calibrationSamples*numChannels,&read,NULL));
+	DAQmxErrChk (DAQmxStopTask(taskHandle));
+	DAQmxErrChk (DAQmxSetAIRawDataCompressionType(taskHandle,"",DAQmx_Val_LossyLSBRemoval));
+
+	for(iChan=0;iChan<numChannels;++iChan) {
+		DAQmxErrChk (DAQmxGetNthTaskChannel(taskHandle,iChan+1,channelName,1000));
+		DAQmxErrChk (DAQmxGetAIResolution(taskHandle,channelName,&resolution));
+		DAQmxErrChk (DAQmxGetAIRawSampSize(taskHandle,channelName,&rawSampSize));
+		DAQmxErrChk (DAQmxGetAIRawSampJustification(taskHandle,channelName,&justification));
+		// The first order coefficient scales one raw code, whose LSB is
+		// below the resolution when the raw samples are left justified
+		numCoeffs = DAQmxGetAIDevScalingCoeff(taskHandle,channelName,NULL,0);
+		if( numCoeffs>1000 )
+			numCoeffs = 1000;
+		lsbVolts = 0.0;
+		if( numCoeffs>1 && DAQmxGetAIDevScalingCoeff(taskHandle,channelName,coeffs,numCoeffs)>=0 )
+			lsbVolts = fabs(coeffs[1]);
+		if( justification==DAQmx_Val_LeftJustified && rawSampSize>(uInt32)resolution )
+			lsbVolts = ldexp(lsbVolts,(int)(rawSampSize-(uInt32)resolution));
+
+		// A difference holds the noise of two samples
+		for(sum=0.0,iSamp=1;iSamp<(uInt32)read;++iSamp) {
+			delta = burst[iSamp*numChannels+iChan] - burst[(iSamp-1)*numChannels+iChan];
+			sum += delta*delta;
+		}
+		gNoiseFloor[taskNum][iChan] = read>1&&lsbVolts>0.0 ? sqrt(sum/(2.0*(read-1)))/lsbVolts : 0.0;
+		for(bits=0;bits+MinLossySampleSize<(uInt32)resolution && ldexp(1.0,bits+1)/sqrt(12.0)<=lossyErrorBudget*gNoiseFloor[taskNum][iChan];++bits);
+		DAQmxErrChk (DAQmxSetAILossyLSBRemovalCompressedSampSize(taskHandle,channelName,(uInt32)resolution-bits));
+		gLossyErrorBound[taskNum][iChan] = (1u<<bits) - 1;
+		printf("Task %u %s: %u-bit samples for a noise floor of %.2f LSBs, error bound %u LSBs\n",(unsigned)taskNum,channelName,(unsigned)((uInt32)resolution-bits),gNoiseFloor[taskNum][iChan],(unsigned)gLossyErrorBound[taskNum][iChan]);
+	}
+	success = TRUE;
+
+Error:
+	if( DAQmxFailed(error) ) {
+		DAQmxGetExtendedErrorInfo(errBuff,2048);
+		printf("DAQmx Error: %s\n",errBuff);
+	}
+	free(burst);
+	return success;
+}
+
+static int CalculateReadBlockSize(TaskHandle taskHandle, uInt32 taskNum, uInt32 numChannels, uInt32 sampsPerChan)
+{
+	uInt32  rawDataWidth,rawSampSize=1,val,chanVal,sum,iChan;
 	int32   compType;
 	float64 resolution;
+	char    channelName[1000];
+	bool32  mixed=FALSE;
 
 	if( DAQmxGetReadRawDataWidth(taskHandle,&rawDataWidth)==DAQmxErrorCompressedSampSizeExceedsResolution
 	 || DAQmxGetAIRawSampSize(taskHandle,"",&rawSampSize)==DAQmxErrorCompressedSampSizeExceedsResolution
@@ -289,20 +1863,33 @@ static int CalculateReadBlockSize(TaskHandle taskHandle, uInt32 numChannels, uIn
 		printf("Error: %s\n",resolutionMsg);
 		return 0;
 	}
+	DAQmxGetAIResolution(taskHandle,"",&resolution);
 	switch( compType ) {
 		case DAQmx_Val_LosslessPacking:
-			DAQmxGetAIResolution(taskHandle,"",&resolution);
 			val = (uInt32)resolution;
 			break;
 		case DAQmx_Val_LossyLSBRemoval:
-			DAQmxGetAILossyLSBRemovalCompressedSampSize(taskHandle,"",&val);
+			// A calibrated task has a compressed sample size per channel
+			for(val=0,sum=0,iChan=0;iChan<numChannels;++iChan) {
+				DAQmxGetNthTaskChannel(taskHandle,iChan+1,channelName,1000);
+				DAQmxGetAILossyLSBRemovalCompressedSampSize(taskHandle,channelName,&chanVal);
+				if( iChan>0 && chanVal!=val )
+					mixed = TRUE;
+				val = chanVal;
+				sum += chanVal;
+			}
 			break;
 		default:
 			val = rawSampSize;
 			break;
 	}
 	rawDataWidth *= 8;	// Multiply by number of bits
-	gReadBlockSize = (uInt32)ceil(val*rawDataWidth*sampsPerChan/rawSampSize/8);
+	gSampleBits[taskNum] = mixed ? sum : val*rawDataWidth/rawSampSize;
+	gReadBlockSize[taskNum] = (uInt32)(((uInt64)gSampleBits[taskNum]*sampsPerChan+7)/8);
+	// Samples in whole bytes are stored in their raw size, as the reader expects.
+	// Codes of different sizes are not delta encoded.
+	gCodesPacked[taskNum] = compType!=DAQmx_Val_None && !(rawSampSize==(uInt32)resolution && val%8==0);
+	gCodeBits[taskNum] = mixed ? 0 : gCodesPacked[taskNum] ? val : rawSampSize;
 	// Detect hidden channels
 	if( rawDataWidth%rawSampSize && floor(rawDataWidth/rawSampSize)!=numChannels ) {
 		printf("Error: %s\n",hiddenChanMsg);
@@ -311,20 +1898,77 @@ static int CalculateReadBlockSize(TaskHandle taskHandle, uInt32 numChannels, uIn
 	return 1;
 }
 
+// Every callback reads 1000 samples, unless readAvailableSamples lets it
+// drain the buffer. Then the event covers readEventSeconds at the actual
+// sample clock rate, and the input buffer grows to an even multiple of the
+// event size, which DMA transfers require.
+static int32 ConfigureReadEvent(TaskHandle taskHandle, uInt32 *eventSamples)
+{
+	int32   error=0;
+	float64 rate,samples;
+	uInt32  bufferSize,largest=maxSamplesPerRead/2>1?maxSamplesPerRead/2:1;
+	uInt64  evenSize;
+
+	*eventSamples = 1000;
+	if( !readAvailableSamples )
+		return 0;
+	DAQmxErrChk (DAQmxGetSampClkRate(taskHandle,&rate));
+	samples = rate*readEventSeconds;
+	if( samples>*eventSamples )
+		*eventSamples = samples<largest ? (uInt32)samples : largest;
+	if( *eventSamples>largest )
+		*eventSamples = largest;
+	DAQmxErrChk (DAQmxGetBufInputBufSize(taskHandle,&bufferSize));
+	evenSize = ((uInt64)bufferSize+2*(uInt64)*eventSamples-1)/(2*(uInt64)*eventSamples)*2*(*eventSamples);
+	if( evenSize<2*(uInt64)*eventSamples )
+		evenSize = 2*(uInt64)*eventSamples;
+	if( evenSize!=bufferSize && evenSize<=0xFFFFFFFF ) {
+		DAQmxErrChk (DAQmxCfgInputBuffer(taskHandle,(uInt32)evenSize));
+	}
+
+Error:
+	return error;
+}
+
 int32 CVICALLBACK EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData)
 {
 	int32       error=0;
 	char        errBuff[2048]={'\0'};
-	static int  totalRead=0;
 	int32       read=0;
+	uInt32      task=(uInt32)(size_t)callbackData,sampsToRead=1000,available;
+	BlockRing   *ring=&gRings.rings[task];
+	uInt32      head=ring->head,used=head-RingLoadAcquire(&ring->tail);
+	void        *scratch=(uInt8*)data+(size_t)task*gSlotBytes,*slot=scratch;
+
+	// Read straight into the next free slot of the ring, or drop the block if the disk writer is too far behind
+	if( used<ring->numBlocks )
+		slot = ring->blocks+(size_t)(head&ring->mask)*ring->slotBytes;
 
 	/*********************************************/
 	// DAQmx Read Code
 	/*********************************************/
-	DAQmxErrChk (DAQmxReadRaw(taskHandle,1000,10.0,data,1000*numChannels*sizeof(uInt16),&read,NULL,NULL));
+	// Drain everything acquired since the last callback, as events of a busy system arrive late and merged
+	if( readAvailableSamples ) {
+		DAQmxErrChk (DAQmxGetReadAvailSampPerChan(taskHandle,&available));
+		sampsToRead = available<maxSamplesPerRead ? available : maxSamplesPerRead;
+	}
+	if( sampsToRead>0 ) {
+		DAQmxErrChk (DAQmxReadRaw(taskHandle,sampsToRead,10.0,slot,gSlotBytes,&read,NULL,NULL));
+	}
 	if( read>0 ) {
-		WriteDataToDataFile(data,gReadBlockSize);
-		printf("Acquired %d samples. Total %d\r",(int)read,(int)(totalRead+=read));
+		// A file of fixed blocks cannot hold a short block, so it is dropped
+		if( slot==scratch || (!readAvailableSamples && (uInt32)read<sampsToRead) )
+			++ring->droppedBlocks;
+		else {
+			ring->stamps[head&ring->mask].firstSample = ring->samplesAcquired;
+			ring->stamps[head&ring->mask].timestamp = GetHostTimestamp();
+			ring->stamps[head&ring->mask].numSamples = (uInt32)read;
+			RingStoreRelease(&ring->head,head+1);
+			WriterSemaphorePost(&gRings.filled);
+			if( ++used>ring->highWaterMark )
+				ring->highWaterMark = used;
+		}
+		ring->samplesAcquired += read;
 	}
 
 Error:
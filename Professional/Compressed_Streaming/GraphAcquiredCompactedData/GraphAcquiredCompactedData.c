@@ -13,14 +13,97 @@
 *
 * Instructions for Running:
 *    1. Select your Data File.
+*    2. Set blocksPerRead. This determines how many data blocks are
+*       decoded at a time and bounds the memory used by the example,
+*       whatever the size of the file.
+*    3. Set numDecodeThreads. Blocks are decoded on a pool of worker
+*       threads, one per processor by default.
+*    4. Optionally set benchmarkIterations to time the packed or the
+*       unpacked data decoders against each other on the same file,
+*       and the scaling tables against the polynomial evaluation. On
+*       16-bit signed data, the AVX2 kernel widens and scales 4
+*       samples at a time instead of looking them up. To track decoder
+*       performance across changes, set benchmarkSuiteDirectory
+*       instead. The example then writes synthetic data files for every
+*       compression type, compressed sample size from 8 to 32 bits,
+*       byte order, justification and number of channels in
+*       benchmarkSuiteChannels, decodes each one on the main thread and
+*       on the decode threads, and writes the samples/s, MB/s and peak
+*       memory of every run to benchmark.json in that directory.
+*    5. Optionally set rangeStartSeconds and rangeDurationSeconds to
+*       decode only a window of the acquisition. The block index
+*       written next to the data file locates the first block of the
+*       window, so the blocks before it are not read. In a file with
+*       several tasks, the window of each task is found from the times
+*       its own blocks were read.
+*    6. For a stream written in rotating segments, select the file
+*       name without the segment number and set firstSegmentNumber.
+*       The segments are read one after the other as one stream.
+*    7. Optionally set buildOverview to write a min/max/mean overview
+*       of each data file as it is decoded. The overview reduces every
+*       channel at 1:64, 1:4096 and 1:262144. Once it exists, set
+*       overviewPoints to plot the whole file or a time window from the
+*       coarsest level with enough points instead of decoding the data.
+*    8. Optionally set channelSelection to decode only some channels
+*       of the file. The other channels are skipped by their bit
+*       offset in each sample, without being unpacked or scaled, so
+*       extracting one channel of a wide file costs about as much as
+*       reading a file of that one channel. Overviews are not built
+*       and the benchmarks are not run while channels are selected.
+*    9. Optionally set exportDirectory to convert the file to NumPy
+*       .npy files as it is decoded, one per decoded channel, or a
+*       single 2-D array with exportSingleArray. Each file is one
+*       contiguous float64 or float32 array after an aligned header,
+*       so numpy.load with mmap_mode maps it without copying. The
+*       whole file is decoded rather than read from its overview.
+*   10. Optionally set followFile to decode a file while the Continuous
+*       Acquisition to File (Compacted) example is still writing it.
+*       The example waits for the file to appear, decodes every whole
+*       block as it lands, within followPollMilliseconds, and moves on
+*       to the next segment of a rotating stream when the writer does.
+*       Each byte of the file is decoded once. Following stops once the
+*       file has not grown for followIdleSeconds.
+*    Note: Files with several tasks list the channels of all tasks
+*          in task order, as the ChannelMap of each task places them.
+*    Note: Blocks delta encoded by the Continuous Acquisition to File
+*          (Compacted) example are rebuilt into raw blocks as they
+*          are read, then decoded like any other block.
+*    Note: Blocks of variable size are decoded up to the number of
+*          samples each one holds, at most ReadBlockSize per channel.
+*    Note: Blocks written with a checksum are checked before they are
+*          decoded. The byte range of every corrupt block is displayed,
+*          and decoding resumes at the next block whose checksum
+*          matches.
+*    Note: On Linux, link the example with -pthread.
 *
 * Steps:
 *    1. Parse header information in file and check validity.
 *    2. Check if header is valid and if configuration is supported.
-*    3. Calculate values used to decompress the data.
-*    4. Read data blocks from file and convert to samples.
-*    5. Scale decompressed samples.
-*    6. Display an error if any.
+*    3. Calculate values used to decompress the data. If a time
+*       window is selected, look up its first block in the block
+*       index.
+*    4. Map the next data blocks of the file into memory and convert
+*       them to samples. The blocks are split between the decode
+*       threads. The tagged blocks of a file with several tasks are
+*       sorted by task as they are decoded, in a single pass over the
+*       file. Packed data is unpacked a block at a time by a kernel
+*       specialized for the compressed sample size and the CPU
+*       features. Unpacked data is decoded a channel at a time by a
+*       kernel specialized for its sample size, byte order and sign.
+*       When channels are selected, each selected channel is read at
+*       its bit offset in the samples of the block instead.
+*    5. Scale decompressed samples. Channels whose raw codes are 16
+*       bits or fewer look the scaled value up in a table built when
+*       the header is parsed, until the tables reach
+*       scalingTableMegabytes; other codes evaluate the polynomial.
+*    6. Repeat steps 4 and 5 until the end of the file or of the
+*       window, adding the samples to the overview if one is being
+*       built. For a rotating stream, continue with the next segment
+*       until the last one. A segment with an up-to-date overview is
+*       plotted from a single level of the overview instead. When
+*       following the file, wait for the writer to append more whole
+*       blocks and repeat steps 4 and 5 on them.
+*    7. Display the corrupt blocks skipped and an error if any.
 *
 * I/O Connections Overview:
 *    No I/O connections are needed.
@@ -37,31 +120,125 @@
 *    The example does not handle files containing uncrompressed data
 *    logged from a task with channels on multiple DSA devices. The
 *    example will not detect this case and the scaled data returned
-*    will not be correct.
+*    will not be correct. Log one task per DSA device instead.
 *
 *    For cDAQ, the order of channels in the raw data is likely to not
-*    be the same as the order specified in the task. The example does
-*    not handle this case and the scaled data returned by the
-*    decompaction example will not be correct.
+*    be the same as the order specified in the task. The example only
+*    handles this case for files with several tasks, whose ChannelMap
+*    gives the order of the channels in the raw data.
+*
+*    The benchmarks are not supported for files with several tasks,
+*    with delta encoded blocks, with blocks of variable size or with
+*    block checksums. Overviews are not built for a time window, and
+*    a time window of a file of records is always decoded.
+*
+*    Exporting one .npy file per channel keeps a file open for every
+*    decoded channel. For files with more channels than the system
+*    lets a process open, select fewer channels or export a single
+*    array. A single array is only exported for files with one task.
+*
+*    The pwrite and io_uring write engines pad the last chunk of a
+*    file with zeros until they close it, and io_uring may complete
+*    chunks out of order, so their files are only followed up to the
+*    last block of the block index, and not at all without it. Time
+*    windows are not supported while following, and overviews are
+*    neither built nor used.
+*
+*    The samples of the blocks skipped for a bad checksum are
+*    missing from the decoded data, and the samples after them are
+*    not shifted to their acquisition time. Use the block index to
+*    place them. A file written without checksums still stops at the
+*    first corrupt block.
+*
+*    The peak memory of the benchmark suite is measured separately for
+*    each run on Linux only. Elsewhere it is the peak of the process up
+*    to that run.
 *
 *********************************************************************/
 
+#define _FILE_OFFSET_BITS 64
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <NIDAQmx.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#endif
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_UNPACK_KERNELS
+#define HAVE_X86_CRC32C
+#include <immintrin.h>
+#endif
 
 #define DAQmxErrChk(functionCall) if( DAQmxFailed(error=(functionCall)) ) goto Error; else
 
+#ifdef _WIN32
+typedef HANDLE				DecodeThread;
+typedef DWORD				DecodeThreadResult;
+#define DecodeThreadCall					WINAPI
+typedef CRITICAL_SECTION	DecodeMutex;
+typedef CONDITION_VARIABLE	DecodeCond;
+#define DecodeThreadCreate(thread,func,arg)	((*(thread)=CreateThread(NULL,0,(func),(arg),0,NULL))!=NULL)
+#define DecodeThreadJoin(thread)			(WaitForSingleObject((thread),INFINITE),CloseHandle(thread))
+#define DecodeMutexInit(mutex)				InitializeCriticalSection(mutex)
+#define DecodeMutexDestroy(mutex)			DeleteCriticalSection(mutex)
+#define DecodeMutexLock(mutex)				EnterCriticalSection(mutex)
+#define DecodeMutexUnlock(mutex)			LeaveCriticalSection(mutex)
+#define DecodeCondInit(cond)				InitializeConditionVariable(cond)
+#define DecodeCondDestroy(cond)
+#define DecodeCondWait(cond,mutex)			SleepConditionVariableCS((cond),(mutex),INFINITE)
+#define DecodeCondSignal(cond)				WakeConditionVariable(cond)
+#define DecodeCondBroadcast(cond)			WakeAllConditionVariable(cond)
+#else
+typedef pthread_t			DecodeThread;
+typedef void				*DecodeThreadResult;
+#define DecodeThreadCall
+typedef pthread_mutex_t		DecodeMutex;
+typedef pthread_cond_t		DecodeCond;
+#define DecodeThreadCreate(thread,func,arg)	(pthread_create((thread),NULL,(func),(arg))==0)
+#define DecodeThreadJoin(thread)			pthread_join((thread),NULL)
+#define DecodeMutexInit(mutex)				pthread_mutex_init((mutex),NULL)
+#define DecodeMutexDestroy(mutex)			pthread_mutex_destroy(mutex)
+#define DecodeMutexLock(mutex)				pthread_mutex_lock(mutex)
+#define DecodeMutexUnlock(mutex)			pthread_mutex_unlock(mutex)
+#define DecodeCondInit(cond)				pthread_cond_init((cond),NULL)
+#define DecodeCondDestroy(cond)				pthread_cond_destroy(cond)
+#define DecodeCondWait(cond,mutex)			pthread_cond_wait((cond),(mutex))
+#define DecodeCondSignal(cond)				pthread_cond_signal(cond)
+#define DecodeCondBroadcast(cond)			pthread_cond_broadcast(cond)
+#endif
+
+// Offsets in the overview may be beyond the 2 GB a long reaches on Windows
+#ifdef _WIN32
+#define SeekFile(file,offset)				_fseeki64((file),(__int64)(offset),SEEK_SET)
+#define TellFile(file)						_ftelli64(file)
+#else
+#define SeekFile(file,offset)				fseeko((file),(off_t)(offset),SEEK_SET)
+#define TellFile(file)						ftello(file)
+#endif
+
 typedef enum {
 	BigEndian,
 	LittleEndian
 } ByteOrder;
 
-typedef struct _ScaleCoeff {
-	double	scalingCoeff;
-	struct _ScaleCoeff	*next;
-} ScaleCoeff;
+// Reads and scales numSamples unpacked samples of one channel, stride bytes apart
+struct _ChannelInfo;
+typedef void (*DecodeChannelFunc)(struct _ChannelInfo *chan, const uInt8 *src, uInt32 stride, uInt32 numSamples, float64 *dst);
 
 typedef struct _ChannelInfo {
 	char		name[100];
@@ -72,32 +249,378 @@ typedef struct _ChannelInfo {
 	uInt32		compressionType;
 	uInt32		compressedSampleSizeInBits;
 	ByteOrder	compressionByteOrder;
-	ScaleCoeff	*polynomialScalingCoeffChain;
-	struct _ChannelInfo	*next;
+	float64		*scalingCoeffs;		// Polynomial scaling coefficients, constant term first
+	uInt32		numScalingCoeffs;
+	float64		*scalingTable;		// Scaled value of every raw code, for codes of 16 bits or fewer
+	bool32		ownsScalingTable;
+	float64		noiseFloor;			// In LSBs, measured when the compressed sample size was calibrated, or -1
+	uInt32		lossyErrorBound;	// Largest error LSB removal added to a sample, in LSBs
+	DecodeChannelFunc	decode;		// Kernel for the sample size, byte order and sign of unpacked data
 } ChannelInfo;
 
-typedef struct {
+// One per task of the file. The first task also describes the file.
+typedef struct _DataFileInfo {
 	char		version[100];
 	uInt32		headerSize;
+	uInt32		numberOfTasks;
+	uInt32		numberOfFileChannels;	// Channels of all tasks
+	bool32		taggedBlocks;		// Every block is preceded by the number of its task
+	bool32		blockRecords;		// Blocks are tagged or encoded, so they are read one record at a time
+	bool32		checksummedRecords;	// Every record ends with its CRC32C
+	bool32		unorderedWrites;	// The file may have holes and padding until it is closed
 	char		taskName[500];
 	uInt32		numberOfChannels;
 	uInt32		readBlockSize;
 	uInt32		readBlockSizeInBytes;
-	ChannelInfo	*channelInfoChain;
+	uInt32		firstChannel;		// File channel of the first channel of the task
+	uInt32		*channelMap;		// File channel of each channel of the raw data, NULL in version 1.0.0 files
+	bool32		encodedBlocks;		// Every block is delta encoded and preceded by its length
+	bool32		variableBlocks;		// Every block is preceded by its number of samples, at most readBlockSize
+	uInt32		*selectedChannels;	// Channels of the raw data to decode, NULL to decode them all
+	uInt32		numSelectedChannels;
+	uInt32		*channelBitOffsets;	// Of each channel in a sample of all channels, when some are selected
+	uInt32		sampleBits;			// Size of a sample of all channels
+	ChannelInfo	*channels;			// numberOfChannels entries, in raw data order
+	struct _DataFileInfo	*nextTask;
 } DataFileInfo;
 
+#define BlockTagBytes			4
+#define BlockSampleCountBytes	4
+#define BlockLengthBytes		4
+#define BlockChecksumBytes		4
+#define Crc32cPolynomial		0x82F63B78	// Castagnoli, bit reversed
+
+// One worker's share of the blocks handed to DecodeDataBlocksParallel
+typedef struct {
+	struct _DecodeThreadPool	*pool;
+	DataFileInfo				*info;
+	const uInt8					*rawData;
+	uInt32						numBytes;
+	uInt32						firstBlock;
+	float64						**data;
+	uInt32						dataCapacity;	// Channels data has room for
+	int							numSamples;
+} DecodeJob;
+
+typedef struct _DecodeThreadPool {
+	uInt32			numThreads;
+	DecodeThread	*threads;
+	DecodeJob		*jobs;
+	DecodeMutex		lock;
+	DecodeCond		start;
+	DecodeCond		done;
+	uInt32			generation;
+	uInt32			pending;
+	bool32			quit;
+} DecodeThreadPool;
+
+// Layout of the block index the Continuous Acquisition to File
+// (Compacted) example writes next to the data file, with .idx appended
+// to its name. One entry follows the header for every block of the data
+// file, in file order. Version 1 entries end before the task number.
+#define BlockIndexMagic		"DAQCBIDX"
+#define BlockIndexVersion	2
+
+typedef struct {
+	char	magic[8];
+	uInt32	version;
+	uInt32	entryBytes;
+	uInt64	dataHeaderSize;
+	uInt32	readBlockSizeInBytes;
+	uInt32	readBlockSize;
+} BlockIndexHeader;
+
+typedef struct {
+	uInt64	byteOffset;		// Offset of the block in the data file
+	uInt64	firstSample;	// Samples per channel acquired before the block, dropped blocks included
+	uInt64	timestamp;		// Host time the block was read, in ns since 1970-01-01 UTC
+	uInt32	task;			// Task of the block
+	uInt32	recordBytes;	// Length of the record of the block, 0 in older files
+} BlockIndexEntry;
+
+#define BlockIndexEntryBytesV1	24
+
+// Entries are read on demand, so looking a block up costs a binary search
+// of the index file whatever the length of the acquisition.
+typedef struct {
+	FILE	*file;
+	uInt64	numEntries;
+	uInt32	entryBytes;
+	uInt32	readBlockSize;
+} DataFileIndex;
+
+// The time window of one task of a file of records, in samples counted
+// per task, and the records of the segment being read that it covers
+typedef struct {
+	uInt64	firstSample;	// First sample of the window
+	uInt64	endSample;		// Sample after the window
+	uInt64	numSamples;		// Samples of the window read so far
+	uInt64	startOffset;	// Record of the first sample in the segment
+	uInt64	endOffset;		// Record of the last sample in the segment
+	uInt32	skip;			// Samples of the first record before the window
+	uInt32	keep;			// Samples of the last record before the end of the window
+	bool32	haveStart;
+	bool32	haveEnd;
+	bool32	ended;			// Set once no later segment holds samples of the window
+} RecordWindow;
+
+// Walks the data blocks of a file through a sliding memory-mapped view,
+// so only the blocks being decoded are resident.
+typedef struct {
+	DataFileInfo	*info;
+	uInt64			fileSize;
+	uInt64			offset;
+	uInt32			granularity;
+#ifdef _WIN32
+	HANDLE			file;
+	HANDLE			mapping;
+#else
+	int				fd;
+#endif
+	void			*view;
+	size_t			viewBytes;
+	DecodeThreadPool	*pool;
+	uInt32			skip;		// Samples the next read drops before the selected range
+	uInt64			remaining;	// Samples left in the selected range
+	RecordWindow	*windows;	// Window of each task in a file of records
+	uInt64			windowEnd;	// Offset of the last record in the windows
+	DataFileIndex	*index;		// Bounds a followed file whose writes are unordered
+	bool32			unindexed;	// The followed file has bytes past the last record of the index
+	bool32			damaged;	// Searching for the next record whose checksum matches
+	uInt64			damageStart;	// Offset of the first corrupt record
+	bool32			skippedDamage;	// Corrupt records were skipped somewhere in the file
+} DataFileBlockIterator;
+
+// Waits for a data file that is still being written to grow. On Linux
+// the directory of the file is watched with inotify, so the reader wakes
+// as soon as the writer writes the file or starts its next segment.
+// Elsewhere, and if the directory cannot be watched, the file is polled.
+typedef struct {
+	bool32			idle;		// Set once the file has not grown for followIdleSeconds
+	double			lastGrowth;
+#ifdef __linux__
+	int				inotifyFd;
+#endif
+} DataFileFollower;
+
+// Layout of the min/max/mean overview written next to the data file,
+// with .ovr appended to its name. Each level reduces a fixed number of
+// samples of a channel to one point. The points of a channel at a level
+// are contiguous, so a plot reads only the points of the level it draws.
+// The header is written last, once every sample of the data file has been
+// reduced, and the overview is discarded if the data file has changed size.
+#define OverviewMagic			"DAQCOVRV"
+#define OverviewVersion			1
+#define OverviewLevels			3
+#define OverviewBufferPoints	64
+
+static const uInt32 overviewDecimation[OverviewLevels] = {64,4096,262144};
+
+typedef struct {
+	char	magic[8];
+	uInt32	version;
+	uInt32	numLevels;
+	uInt32	decimation[OverviewLevels];
+	uInt32	numChannels;
+	uInt64	dataHeaderSize;
+	uInt64	dataFileSize;
+} OverviewHeader;
+
+// One per file channel, after the header
+typedef struct {
+	uInt64	numSamples;
+	uInt64	offset[OverviewLevels];	// Of the first point of each level
+} OverviewChannelEntry;
+
+typedef struct {
+	float32	min;
+	float32	max;
+	float32	mean;
+} OverviewPoint;
+
+// The point of a channel being reduced at one level, and the points
+// completed since they were last written
+typedef struct {
+	float64			min;
+	float64			max;
+	float64			sum;
+	uInt32			count;
+	uInt32			numBuffered;
+	uInt64			numWritten;
+	OverviewPoint	buffer[OverviewBufferPoints];
+} OverviewAccumulator;
+
+typedef struct {
+	FILE					*file;
+	char					*filePath;		// Removed unless the overview is completed
+	OverviewHeader			header;
+	bool32					failed;			// A write failed
+	uInt32					numChannels;
+	OverviewChannelEntry	*entries;
+	OverviewAccumulator		*accumulators;	// OverviewLevels per channel
+} OverviewBuilder;
+
+// Size of the header of the exported .npy files, so the data of each file
+// starts aligned. The header is written again with the final shape.
+#define NpyHeaderBytes	128
+
+// Writes the scaled samples of the decoded channels to NumPy .npy files
+typedef struct {
+	FILE		**files;		// One per file channel, NULL for channels that are not decoded
+	uInt64		*numSamples;	// Written to each file
+	uInt32		numChannels;
+	bool32		singleArray;	// files[0] holds a row per sample with a column per decoded channel
+	uInt32		*columns;		// File channel of each column
+	uInt32		numColumns;
+	void		*buffer;		// Samples converted or interleaved for writing
+	uInt32		bufferSamples;
+	bool32		failed;
+} NpyExporter;
+
+// Unpacks numValues MSB-first values of the given bit width from a byte aligned block
+typedef void (*UnpackBitsFunc)(const uInt8 *src, uInt32 srcBytes, uInt32 bits, uInt32 numValues, uInt32 *dst);
+
+// Sample format shared by every channel of a synthetic benchmark file
+typedef struct {
+	uInt32		compressionType;
+	uInt32		resolution;
+	uInt32		rawSampleSizeInBits;
+	uInt32		compressedSampleSizeInBits;
+	ByteOrder	byteOrder;
+	uInt32		justification;
+} BenchmarkFormat;
+
+/*********************************************/
+// Read Options
+/*********************************************/
+const uInt32 blocksPerRead = 64; // The number of data blocks decoded at a time. The scaled data buffers hold blocksPerRead*ReadBlockSize samples per channel.
+const uInt32 numDecodeThreads = 0; // The number of threads that decode the blocks of each read. 0 uses one thread per processor, 1 decodes on the main thread.
+const float64 rangeStartSeconds = -1.0; // Set to 0 or more to decode only the window that starts this many seconds after the first block was read. Requires the .idx block index.
+const float64 rangeDurationSeconds = 2.0; // The length of the window in seconds.
+const char channelSelection[] = ""; // The file channels to decode, counted from 0, for example "0,4-7". Leave empty to decode every channel. The other channels are skipped without being unpacked or scaled.
+const uInt32 scalingTableMegabytes = 64; // The memory the scaling tables of the channels of a file may take. Channels whose table does not fit evaluate their scaling polynomial instead.
+const uInt32 firstSegmentNumber = 0; // The first segment to read from a rotating stream, such as stream-00000.cfg for the file stream.cfg. Older segments may have been deleted.
+
+/*********************************************/
+// Overview Options
+/*********************************************/
+const bool32 buildOverview = FALSE; // Set to TRUE to write a min/max/mean overview next to each data file as it is decoded, with .ovr appended to its name.
+const uInt32 overviewPoints = 0; // Set to the number of points per channel a plot of the whole file or of a time window needs. The coarsest overview level with at least that many points is read instead of the data file, which is only decoded if even the finest level has fewer.
+
+/*********************************************/
+// Follow Options
+/*********************************************/
+const bool32 followFile = FALSE; // Set to TRUE to keep decoding the blocks appended to the data file while it is being written.
+const float64 followIdleSeconds = 10.0; // Following stops once the file, or the first segment to read, has not grown for this many seconds.
+const uInt32 followPollMilliseconds = 50; // The longest time a new block waits before it is decoded. On Linux the reader is woken as soon as the file is written.
+
+/*********************************************/
+// Export Options
+/*********************************************/
+const char exportDirectory[] = ""; // Set to a directory to write the scaled samples of the decoded channels there as NumPy .npy files, one per channel named channel0.npy, channel1.npy and so on, numbered like channelSelection.
+const bool32 exportSingleArray = FALSE; // Set to TRUE to write one data.npy array with a row per sample and a column per decoded channel instead. Only for files with one task.
+const bool32 exportFloat32 = FALSE; // Set to TRUE to export float32 samples instead of float64.
+
+/*********************************************/
+// Benchmark Options
+/*********************************************/
+const uInt32 benchmarkIterations = 0; // Set to a nonzero value to time the bit-serial packed decoder against the unpack kernels, or the per-sample unpacked decoder against the channel kernels, on the data file.
+const char benchmarkSuiteDirectory[] = ""; // Set to a directory to run the decode benchmark suite instead of reading the data file. The results are written to benchmark.json in the directory.
+const uInt32 benchmarkSuiteChannels[] = {1,8,64,1024}; // The numbers of channels of the synthetic data files of the suite.
+const uInt32 benchmarkSuiteBlockValues = 16384; // The samples of all channels in each block of a synthetic data file.
+const uInt32 benchmarkSuiteBlocks = 256; // The number of blocks in each synthetic data file.
+
 static int ReadScaleAndPlotDataFileData(const char filePath[]);
 static DataFileInfo *ParseDataFileHeader(const char filePath[]);
-static uInt8 *ReadDataFileData(DataFileInfo *info, const char filePath[], uInt32 *numBytes);
-static int PlotScaledData(float64 *data[100], uInt32 numChannels, uInt32 numSamples);
-static int DecodeDataWithoutPacking(DataFileInfo *info, uInt8 *rawData, uInt32 numBytes, float64 *data[100]);
-static int DecodeDataWithPacking(DataFileInfo *info, uInt8 *rawData, uInt32 numBytes, float64 *data[100]);
+static bool32 ParseChannelSelection(const char selection[], uInt32 numChannels, bool32 selected[]);
+static bool32 SelectDataFileChannels(DataFileInfo *info, const bool32 selected[]);
+static int OpenDataFileBlockIterator(DataFileInfo *info, const char filePath[], DataFileBlockIterator *iter);
+static const uInt8 *MapDataFileBytes(DataFileBlockIterator *iter, uInt64 maxBytes, uInt32 *numBytes);
+static const uInt8 *MapNextDataFileBlocks(DataFileBlockIterator *iter, uInt32 maxSamples, uInt32 *numBytes);
+static int ReadNextDataFileBlocks(DataFileBlockIterator *iter, float64 *data[], uInt32 maxSamples);
+static uInt64 ReadDataFileRecords(DataFileBlockIterator *iter, float64 *data[], float64 totals[], uInt64 counts[], OverviewBuilder *overview, NpyExporter *exporter);
+static int32 ParseBlockRecord(DataFileInfo *info, const uInt8 *record, uInt32 numBytes, uInt32 *tag, DataFileInfo **task, const uInt8 **block, uInt32 *blockBytes, uInt32 *blockSamples);
+static uInt32 GetRawBlockBytes(DataFileInfo *task, uInt32 numSamples);
+static uInt64 FinishDataFileRecords(DataFileBlockIterator *iter, float64 *data[], float64 totals[], uInt64 counts[], OverviewBuilder *overview, NpyExporter *exporter);
+static void ReportDataFileDamage(DataFileBlockIterator *iter, uInt64 end);
+static uInt32 ComputeCrc32c(uInt32 crc, const uInt8 *data, size_t numBytes);
+static uInt32 ComputeCrc32cTable(uInt32 crc, const uInt8 *data, size_t numBytes);
+#ifdef HAVE_X86_CRC32C
+static uInt32 ComputeCrc32cSSE42(uInt32 crc, const uInt8 *data, size_t numBytes);
+#endif
+static void CloseDataFileBlockIterator(DataFileBlockIterator *iter);
+static void StartFollowingDataFile(DataFileFollower *follower, const char filePath[]);
+static int FollowDataFile(DataFileFollower *follower, DataFileBlockIterator *iter, const char nextSegmentPath[]);
+static int GrowDataFileBlockIterator(DataFileBlockIterator *iter);
+static void WaitForDataFileChange(DataFileFollower *follower);
+static uInt64 GetDataFileSize(const char filePath[]);
+static void StopFollowingDataFile(DataFileFollower *follower);
+static int OpenDataFileIndex(DataFileInfo *info, const char filePath[], DataFileIndex *index);
+static int ReadDataFileIndexEntry(DataFileIndex *index, uInt64 entryNum, BlockIndexEntry *entry);
+static int ReadTaskIndexEntry(DataFileIndex *index, uInt64 entryNum, uInt32 task, uInt64 *found, BlockIndexEntry *entry);
+static int FindTaskIndexEntry(DataFileIndex *index, uInt32 task, uInt64 sample, uInt64 *entryNum, BlockIndexEntry *entry);
+static int FindDataFileSampleAtTime(DataFileIndex *index, uInt32 task, uInt32 blockSize, uInt64 origin, float64 seconds, uInt64 *sample);
+static int SeekDataFileSamples(DataFileBlockIterator *iter, DataFileIndex *index, uInt64 *firstSample, uInt64 numSamples);
+static int SeekDataFileRecords(DataFileBlockIterator *iter, DataFileIndex *index, uInt64 origin, RecordWindow windows[]);
+static uInt64 GetIndexedDataFileSize(DataFileIndex *index);
+static void CloseDataFileIndex(DataFileIndex *index);
+static void MakeSegmentPath(char segmentPath[], const char filePath[], uInt32 number);
+static int CreateDataFileOverview(DataFileInfo *info, const char filePath[], uInt64 fileSize, OverviewBuilder *overview);
+static int CountDataFileBlocks(DataFileInfo *info, const char filePath[], uInt64 numBlocks[]);
+static void AddOverviewData(OverviewBuilder *overview, float64 *data[], uInt32 firstChannel, uInt32 numChannels, uInt32 numSamples);
+static void AccumulateOverviewPoint(OverviewBuilder *overview, uInt32 iChan, uInt32 level, float64 min, float64 max, float64 sum, uInt32 count);
+static void EmitOverviewPoint(OverviewBuilder *overview, uInt32 iChan, uInt32 level);
+static void FlushOverviewPoints(OverviewBuilder *overview, uInt32 iChan, uInt32 level);
+static void CloseDataFileOverview(OverviewBuilder *overview, bool32 complete);
+static uInt64 ReadDataFileOverview(DataFileInfo *info, const char filePath[], uInt64 fileSize, uInt64 firstSample, uInt64 numSamples, uInt32 minPoints, float64 totals[], uInt64 counts[], uInt32 *decimation);
+static int OpenNpyExporter(NpyExporter *exporter, DataFileInfo *info, const char directory[], float64 *data[]);
+static int WriteNpyHeader(FILE *file, uInt64 numRows, uInt32 numColumns);
+static void ExportData(NpyExporter *exporter, float64 *data[], uInt32 firstChannel, uInt32 numChannels, uInt32 numSamples);
+static int CloseNpyExporter(NpyExporter *exporter);
+static int PlotScaledData(float64 *data[], uInt32 numChannels, uInt32 numSamples, float64 totals[]);
+static void PlotTaskData(DataFileInfo *task, float64 *data[], uInt32 numSamples, float64 totals[], uInt64 counts[], OverviewBuilder *overview, NpyExporter *exporter);
+static void PlotOverviewData(const OverviewPoint points[], uInt64 numPoints, uInt32 decimation, uInt32 skip, uInt64 numSamples, float64 *total);
+static bool32 IsDataPacked(DataFileInfo *info);
+static int BuildScalingTables(DataFileInfo *info, uInt64 *tableBytes);
+static uInt32 HashChannelScaling(const ChannelInfo *chan);
+static bool32 IsSameChannelScaling(const ChannelInfo *chan, const ChannelInfo *other);
+static int32 ExpandRawCode(ChannelInfo *chan, uInt32 code, bool32 packed);
+static float64 EvaluateScalingPolynomial(ChannelInfo *chan, int32 val);
+static int DecodeDataBlocks(DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[]);
+static int DecodeShortBlock(DataFileInfo *task, const uInt8 *rawData, uInt32 numSamples, float64 *data[]);
+static int DecodeDeltaBlock(DataFileInfo *task, const uInt8 *src, uInt32 srcBytes, uInt32 numSamples, uInt32 *codes, uInt8 *raw);
+static DecodeThreadPool *CreateDecodeThreadPool(uInt32 numThreads);
+static void DestroyDecodeThreadPool(DecodeThreadPool *pool);
+static DecodeThreadResult DecodeThreadCall DecodeWorkerThread(void *arg);
+static int DecodeDataBlocksParallel(DecodeThreadPool *pool, DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[]);
+static int DecodeDataWithoutPacking(DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[]);
+static int DecodeDataWithoutPackingPerSample(DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[]);
+static int DecodeSelectedChannels(DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[]);
+static int DecodeDataWithPacking(DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[]);
+static int DecodeDataWithPackingBitSerial(DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[]);
+static UnpackBitsFunc SelectUnpackKernel(uInt32 bits, const char **name);
+static DecodeChannelFunc SelectDecodeChannelKernel(ChannelInfo *chan, const char **name);
+static void BenchmarkPackedDecode(DataFileInfo *info, const char filePath[], float64 *data[], uInt32 maxSamples, DecodeThreadPool *pool);
+static void BenchmarkUnpackedDecode(DataFileInfo *info, const char filePath[], float64 *data[], uInt32 maxSamples, DecodeThreadPool *pool);
+static void BenchmarkScaling(DataFileInfo *info, uInt32 numSamples);
+static int RunBenchmarkSuite(const char directory[]);
+static bool32 MakeBenchmarkFormat(uInt32 compressionType, uInt32 bits, ByteOrder byteOrder, uInt32 justification, BenchmarkFormat *format);
+static bool32 IsBenchmarkFormatPacked(const BenchmarkFormat *format);
+static int WriteBenchmarkFile(const char filePath[], const BenchmarkFormat *format, uInt32 numChannels);
+static int BenchmarkDecodeFile(const char filePath[], const BenchmarkFormat *format, DecodeThreadPool *pool, FILE *results, uInt32 *numRuns);
+static double GetTimeInSeconds(void);
+static void ResetPeakMemoryUsage(void);
+static uInt64 GetPeakMemoryUsage(void);
+static bool32 ParseScalingCoeffs(ChannelInfo *chan, char coeffBuff[]);
 static void FreeDataFileInfoContent(DataFileInfo *info);
-static long FindOutFileSize(const char filePath[]);
 
 int main(void)
 {
-	if( !ReadScaleAndPlotDataFileData("c:\\stream.cfg") )
+	if( *benchmarkSuiteDirectory ) {
+		if( !RunBenchmarkSuite(benchmarkSuiteDirectory) )
+			puts("Error: There was a problem writing or decoding the benchmark files.");
+	}
+	else if( !ReadScaleAndPlotDataFileData("c:\\stream.cfg") )
 		puts("Error: There was a problem reading from the file or the file format is invalid.");
 	puts("\nEnd of program, press Enter key to quit");
 	getchar();
@@ -106,308 +629,3188 @@ int main(void)
 
 static int ReadScaleAndPlotDataFileData(const char filePath[])
 {
-	DataFileInfo    *info;
-	uInt8           *rawData=NULL;
-	uInt32          numBytes,numSamples=0,size,iChan=0;
-	float64         *data[100],**dataPtr=&data[0];
+	DataFileInfo			*info=NULL,*task;
+	DataFileBlockIterator	iter;
+	DataFileIndex			index,followIndex={NULL};
+	BlockIndexEntry			entry;
+	OverviewBuilder			overview;
+	NpyExporter				exporter={NULL};
+	DataFileFollower		follower={FALSE};
+	DecodeThreadPool		*pool=NULL;
+	RecordWindow			*windows=NULL;
+	uInt32					numSamples,maxSamples=0,numChannels=0,numTasks=0,iChan=0,i,segmentNum=firstSegmentNumber,decimation;
+	uInt64					totalSamples=0,segmentSamples,origin=0,windowStart=0,firstSample=0,endSample=(uInt64)-1,nextSample=0,*counts=NULL;
+	float64					**data=NULL,*totals=NULL;
+	char					segmentPath[1024],nextSegmentPath[1024];
+	bool32					segmented,window=rangeStartSeconds>=0.0,haveStart=FALSE,haveEnd=FALSE,done=FALSE,building,*selected=NULL;
+	bool32					selection=*channelSelection!='\0',exporting=*exportDirectory!='\0',following=followFile;
 
-	memset(data,0,sizeof(data));
 	puts(filePath);
-	if( (info=ParseDataFileHeader(filePath)) && (rawData=ReadDataFileData(info,filePath,&numBytes)) ) {
-		size = numBytes/info->numberOfChannels;
-		if( info->channelInfoChain->compressionType==DAQmx_Val_LossyLSBRemoval )
-			size = (uInt32)((double)size*8.0/info->channelInfoChain->compressedSampleSizeInBits) + 20;
-		for(;iChan<info->numberOfChannels;++iChan)
-			if( (data[iChan]=(float64*)malloc(sizeof(float64)*size))==NULL )
+	if( strlen(filePath)>=sizeof(segmentPath)-16 )
+		return 0;
+	if( following )
+		StartFollowingDataFile(&follower,filePath);
+	for(;;) {
+		// A rotating stream is read segment by segment from the first one found
+		MakeSegmentPath(segmentPath,filePath,segmentNum);
+		segmented = (info=ParseDataFileHeader(segmentPath))!=NULL;
+		if( !segmented ) {
+			strcpy(segmentPath,filePath);
+			info = ParseDataFileHeader(segmentPath);
+		}
+		// A stream that is being written may not have its first block yet
+		if( !following || (info && GetDataFileSize(segmentPath)>info->headerSize)
+		 || GetTimeInSeconds()-follower.lastGrowth>=followIdleSeconds )
+			break;
+		if( info ) {
+			FreeDataFileInfoContent(info);
+			info = NULL;
+		}
+		WaitForDataFileChange(&follower);
+	}
+	if( info && OpenDataFileBlockIterator(info,segmentPath,&iter) ) {
+		numChannels = info->numberOfFileChannels;
+		numTasks = info->numberOfTasks;
+		maxSamples = info->readBlockSize*blocksPerRead;
+		if( (data=(float64**)calloc(numChannels,sizeof(float64*)))==NULL
+		 || (totals=(float64*)calloc(numChannels,sizeof(float64)))==NULL
+		 || (counts=(uInt64*)calloc(numChannels,sizeof(uInt64)))==NULL
+		 || (selected=(bool32*)calloc(numChannels,sizeof(bool32)))==NULL )
+			goto Error;
+		if( !ParseChannelSelection(channelSelection,numChannels,selected) || !SelectDataFileChannels(info,selected) ) {
+			puts("Error: The channel selection does not match the channels of the file.");
+			goto Error;
+		}
+		// The buffers of each selected channel hold blocksPerRead blocks of its task
+		for(task=info;task;task=task->nextTask)
+			for(i=0;i<task->numberOfChannels;++i,++iChan)
+				if( selected[iChan] && (data[iChan]=(float64*)malloc(sizeof(float64)*task->readBlockSize*blocksPerRead))==NULL )
+					goto Error;
+		if( numTasks>1 )
+			printf("%d task(s)\n",(int)numTasks);
+		printf("%d channel(s)\n",(int)numChannels);
+		if( window && following ) {
+			puts("Error: Time windows are not supported while following a file.");
+			goto Error;
+		}
+		// The window of each task of a file of records is kept apart
+		if( window && info->blockRecords ) {
+			if( (windows=(RecordWindow*)calloc(numTasks,sizeof(RecordWindow)))==NULL )
 				goto Error;
-		printf("%d channel(s)\n",(int)info->numberOfChannels);
-		if (info->channelInfoChain->compressionType==DAQmx_Val_None ||
-				(info->channelInfoChain->compressionByteOrder==LittleEndian && info->channelInfoChain->compressedSampleSizeInBits%8==0)) 
-		{
-			numSamples = DecodeDataWithoutPacking(info,rawData,numBytes,data);
+			for(i=0;i<numTasks;++i)
+				windows[i].endSample = (uInt64)-1;
 		}
-		else
-		{
-			numSamples = DecodeDataWithPacking(info,rawData,numBytes,data);
+		if( exporting && exportSingleArray && numTasks>1 ) {
+			puts("Error: A single exported array is not supported for files with several tasks.");
+			goto Error;
+		}
+		if( exporting && !OpenNpyExporter(&exporter,info,exportDirectory,data) ) {
+			puts("Error: There was a problem creating the export files.");
+			goto Error;
+		}
+		if( numDecodeThreads!=1 )
+			pool = CreateDecodeThreadPool(numDecodeThreads);
+		if( benchmarkIterations && !info->blockRecords && !selection && IsDataPacked(info) )
+			BenchmarkPackedDecode(info,segmentPath,data,maxSamples,pool);
+		else if( benchmarkIterations && !info->blockRecords && !selection )
+			BenchmarkUnpackedDecode(info,segmentPath,data,maxSamples,pool);
+		if( benchmarkIterations && !info->blockRecords && !selection )
+			BenchmarkScaling(info,maxSamples);
+		for(;;) {
+			iter.pool = pool;
+			// Only whole blocks are decoded from a file that is being written,
+			// and only the indexed ones if its writes are unordered
+			if( following && info->unorderedWrites ) {
+				OpenDataFileIndex(info,segmentPath,&followIndex);
+				if( followIndex.file==NULL ) {
+					puts("Error: Following a file written with the pwrite or io_uring engines requires its block index.");
+					goto Error;
+				}
+				iter.index = &followIndex;
+			}
+			if( following ) {
+				iter.fileSize = info->headerSize;
+				GrowDataFileBlockIterator(&iter);
+				MakeSegmentPath(nextSegmentPath,filePath,segmentNum+1);
+			}
+			if( window ) {
+				if( !OpenDataFileIndex(info,segmentPath,&index) || !ReadDataFileIndexEntry(&index,0,&entry) ) {
+					CloseDataFileIndex(&index);
+					puts("Error: The block index of the file is missing or does not match the file.");
+					goto Error;
+				}
+				// Times are counted from the first block of the first segment
+				if( segmentNum==firstSegmentNumber )
+					origin = entry.timestamp;
+				if( windows ) {
+					if( !SeekDataFileRecords(&iter,&index,origin,windows) )
+						iter.remaining = 0;
+					// The windows of every task end in this segment
+					for(done=TRUE,i=0;i<numTasks;++i)
+						done &= windows[i].ended;
+				}
+				else {
+					if( !haveStart && FindDataFileSampleAtTime(&index,0,info->readBlockSize,origin,rangeStartSeconds,&firstSample) )
+						haveStart = TRUE;
+					if( haveStart && !haveEnd && FindDataFileSampleAtTime(&index,0,info->readBlockSize,origin,rangeStartSeconds+rangeDurationSeconds,&endSample) )
+						haveEnd = TRUE;
+					if( haveStart ) {
+						if( totalSamples>0 )
+							firstSample = nextSample;
+						if( firstSample>=endSample )
+							done = TRUE;
+						else if( SeekDataFileSamples(&iter,&index,&firstSample,endSample-firstSample) ) {
+							// The window stops at samples dropped between two segments
+							if( totalSamples>0 && firstSample!=nextSample )
+								done = TRUE;
+							else if( totalSamples==0 )
+								windowStart = firstSample;
+						}
+						else if( totalSamples>0 )
+							done = TRUE;
+						else
+							iter.remaining = 0;
+					}
+					else
+						iter.remaining = 0;
+				}
+				CloseDataFileIndex(&index);
+			}
+			// A plot of the whole file, or of the samples of a window in a
+			// file of blocks, reads the overview instead of the data
+			segmentSamples = 0;
+			if( !windows && iter.remaining>0 && !exporting && !following && overviewPoints>0
+			 && (segmentSamples=ReadDataFileOverview(info,segmentPath,iter.fileSize,(iter.offset-info->headerSize)/info->readBlockSizeInBytes*info->readBlockSize+iter.skip,
+					iter.remaining,overviewPoints,totals,counts,&decimation))>0 ) {
+				if( totalSamples==0 )
+					printf("Overview: 1 point per %u samples\n",(unsigned)decimation);
+			}
+			else {
+				building = !window && !selection && !following && buildOverview && CreateDataFileOverview(info,segmentPath,iter.fileSize,&overview);
+				// A followed file is decoded again each time blocks are
+				// appended to it, from where the last pass stopped
+				do {
+					if( info->blockRecords )
+						segmentSamples += ReadDataFileRecords(&iter,data,totals,counts,building?&overview:NULL,exporting?&exporter:NULL);
+					else {
+						while( !done && (numSamples=ReadNextDataFileBlocks(&iter,data,maxSamples))>0 ) {
+							PlotScaledData(data,numChannels,numSamples,totals);
+							if( building )
+								AddOverviewData(&overview,data,0,numChannels,numSamples);
+							if( exporting )
+								ExportData(&exporter,data,0,numChannels,numSamples);
+							segmentSamples += numSamples;
+						}
+					}
+				} while( following && FollowDataFile(&follower,&iter,segmented?nextSegmentPath:NULL) );
+				if( info->blockRecords )
+					segmentSamples += FinishDataFileRecords(&iter,data,totals,counts,building?&overview:NULL,exporting?&exporter:NULL);
+				for(iChan=0;!info->blockRecords&&iChan<numChannels;++iChan)
+					counts[iChan] += segmentSamples;
+				// Complete once the decoding has reached the last whole block
+				// without skipping any
+				if( building )
+					CloseDataFileOverview(&overview,!iter.skippedDamage && (info->blockRecords ? iter.offset==iter.fileSize : iter.fileSize-iter.offset<info->readBlockSizeInBytes));
+			}
+			totalSamples += segmentSamples;
+			nextSample = firstSample + segmentSamples;
+			CloseDataFileBlockIterator(&iter);
+			CloseDataFileIndex(&followIndex);
+			FreeDataFileInfoContent(info);
+			info = NULL;
+			if( done || !segmented || follower.idle || (haveEnd && nextSample>=endSample) )
+				break;
+			MakeSegmentPath(segmentPath,filePath,++segmentNum);
+			if( (info=ParseDataFileHeader(segmentPath))==NULL )
+				break;
+			if( info->numberOfTasks!=numTasks || info->numberOfFileChannels!=numChannels || info->readBlockSize*blocksPerRead!=maxSamples
+			 || !SelectDataFileChannels(info,selected) ) {
+				puts("Error: The segments of the stream do not have the same channels or block size.");
+				goto Error;
+			}
+			if( !OpenDataFileBlockIterator(info,segmentPath,&iter) )
+				goto Error;
 		}
-		PlotScaledData(data,info->numberOfChannels,numSamples);
+		for(i=0;windows&&totalSamples>0&&i<numTasks;++i) {
+			if( windows[i].numSamples>0 && numTasks>1 )
+				printf("Window: task %d samples %lu to %lu\n",(int)i,(unsigned long)windows[i].firstSample,(unsigned long)(windows[i].firstSample+windows[i].numSamples));
+			else if( windows[i].numSamples>0 )
+				printf("Window: samples %lu to %lu\n",(unsigned long)windows[i].firstSample,(unsigned long)(windows[i].firstSample+windows[i].numSamples));
+		}
+		if( window && !windows && totalSamples>0 )
+			printf("Window: samples %lu to %lu\n",(unsigned long)windowStart,(unsigned long)(windowStart+totalSamples));
+		else if( window && totalSamples==0 )
+			puts("Error: The selected window is not in the file.");
+		if( exporting && !CloseNpyExporter(&exporter) )
+			puts("Error: There was a problem writing the export files.");
+		else if( exporting )
+			printf("Exported to %s\n",exportDirectory);
+		for(iChan=0;totalSamples>0&&iChan<numChannels;++iChan)
+			if( selected[iChan] )
+				printf("Channel: %d\tNumber of Samples: %lu\t\tAverage: %f\n",(int)iChan+1,(unsigned long)counts[iChan],counts[iChan]?totals[iChan]/counts[iChan]:0.0);
 	}
 
 Error:
-	if( rawData )
-		free(rawData);
-	while( *dataPtr )
-		free(*dataPtr++);
-	if( info )
+	CloseNpyExporter(&exporter);
+	if( following )
+		StopFollowingDataFile(&follower);
+	CloseDataFileIndex(&followIndex);
+	DestroyDecodeThreadPool(pool);
+	if( info ) {
+		CloseDataFileBlockIterator(&iter);
 		FreeDataFileInfoContent(info);
-	return numSamples>0;
+	}
+	for(iChan=0;data&&iChan<numChannels;++iChan)
+		free(data[iChan]);
+	free(data);
+	free(totals);
+	free(counts);
+	free(selected);
+	free(windows);
+	return totalSamples>0;
 }
 
+// Version 1.0.0 files hold one task. Version 2.0.0 files hold one or more
+// tasks whose blocks are tagged with the task number, and a ChannelMap
+// places the channels of each task among the channels of the file.
 static DataFileInfo *ParseDataFileHeader(const char filePath[])
 {
 	FILE    *f;
-	uInt32  numTasks,i=0,channelNum;
-	char    justificationBuff[100],signedBuff[100],compBuff[100],byteOrderBuff[100],coeffBuff[1000],*coeffStr;
+	uInt32  numTasks,taskNum,i,chanTaskNum,channelNum;
+	bool32  *mapped=NULL;
+	char    justificationBuff[100],signedBuff[100],compBuff[100],byteOrderBuff[100],coeffBuff[1000],encodingBuff[100];
+	uInt64  tableBytes=0;
 	static DataFileInfo info;
-	ChannelInfo         *chan,**chanInfoChainPtr=&info.channelInfoChain;
-	ScaleCoeff          *coeff,**coeffChainPtr;
+	DataFileInfo        *task=&info,**taskChainPtr=&info.nextTask;
+	ChannelInfo         *chan;
 
-	info.channelInfoChain = NULL;
-	if( (f=fopen(filePath,"r"))==NULL
-	 || fscanf(f,"[DAQCompressedBinaryFile]\n")<0
-	 || fscanf(f,"Version=%s\n",info.version)<0
-	 || fscanf(f,"HeaderSize=%ld\n",&info.headerSize)<0
-	 || fscanf(f,"NumberOfTasks=%ld\n",&numTasks)<0
-	 || fscanf(f,"[Task0]\n")<0
-	 || fscanf(f,"Name=%s\n",info.taskName)<0
-	 || fscanf(f,"NumberOfChannels=%ld\n",&info.numberOfChannels)<0
-	 || fscanf(f,"ReadBlockSize=%ld\n",&info.readBlockSize)<0
-	 || fscanf(f,"ReadBlockSizeInBytes=%ld\n",&info.readBlockSizeInBytes)<0 )
-		return NULL;
-	if( strcmp(info.version,"1.0.0") || info.numberOfChannels<1 )
+	info.channels = NULL;
+	info.channelMap = NULL;
+	info.selectedChannels = NULL;
+	info.channelBitOffsets = NULL;
+	info.nextTask = NULL;
+	info.numberOfFileChannels = 0;
+	if( (f=fopen(filePath,"r"))==NULL )
 		return NULL;
+	if( fscanf(f,"[DAQCompressedBinaryFile]\n")<0
+	 || fscanf(f,"Version=%s\n",info.version)<0
+	 || fscanf(f,"HeaderSize=%u\n",&info.headerSize)<0
+	 || fscanf(f,"NumberOfTasks=%u\n",&numTasks)<0 )
+		goto Error;
+	// The header size is filled in once the writer has written the header
+	if( info.headerSize==0 )
+		goto Error;
+	info.taggedBlocks = strcmp(info.version,"2.0.0")==0;
+	info.blockRecords = info.taggedBlocks;
+	if( (strcmp(info.version,"1.0.0") && !info.taggedBlocks) || numTasks<1 || (numTasks>1 && !info.taggedBlocks) )
+		goto Error;
+	info.numberOfTasks = numTasks;
 
-	for(;i<info.numberOfChannels;++i) {
-		if( (chan=(ChannelInfo*)malloc(sizeof(ChannelInfo)))==NULL )
-			return NULL;
-		chan->next = NULL;
-		chan->polynomialScalingCoeffChain = NULL;
-		*chanInfoChainPtr = chan;
-		chanInfoChainPtr = &chan->next;
-		if( fscanf(f,"[Task0Channel%ld]\n",&channelNum)<0
-		 || fscanf(f,"Name=%s\n",chan->name)<0
-		 || fscanf(f,"RawSampleResolution=%ld\n",&chan->rawSampleResolution)<0
-		 || fscanf(f,"RawSampleSizeInBits=%ld\n",&chan->rawSampleSizeInBits)<0
-		 || fscanf(f,"RawSampleJustification=%s\n",justificationBuff)<0
-		 || fscanf(f,"SignedNumber=%s\n",signedBuff)<0
-		 || fscanf(f,"CompressionType=%s\n",compBuff)<0
-		 || fscanf(f,"CompressedSampleSizeInBits=%ld\n",&chan->compressedSampleSizeInBits)<0
-		 || fscanf(f,"CompressionByteOrder=%s\n",byteOrderBuff)<0
-		 || fscanf(f,"PolynomialScalingCoeffs=%s\n",coeffBuff)<0 ) {
-			FreeDataFileInfoContent(&info);
-			return NULL;
+	// Only files whose records end with a checksum have a RecordChecksum
+	*encodingBuff = '\0';
+	if( fscanf(f,"RecordChecksum=%99s\n",encodingBuff)<0 )
+		goto Error;
+	info.checksummedRecords = strcmp(encodingBuff,"CRC32C")==0;
+	if( *encodingBuff && !info.checksummedRecords )
+		goto Error;
+	if( info.checksummedRecords )
+		info.blockRecords = TRUE;
+	// Files of the direct write engines have an UnorderedWrites
+	*encodingBuff = '\0';
+	if( fscanf(f,"UnorderedWrites=%99s\n",encodingBuff)<0 )
+		goto Error;
+	info.unorderedWrites = strcmp(encodingBuff,"TRUE")==0;
+
+	for(taskNum=0;taskNum<numTasks;++taskNum) {
+		if( taskNum>0 ) {
+			if( (task=(DataFileInfo*)calloc(1,sizeof(DataFileInfo)))==NULL )
+				goto Error;
+			*taskChainPtr = task;
+			taskChainPtr = &task->nextTask;
+			strcpy(task->version,info.version);
+			task->headerSize = info.headerSize;
+			task->numberOfTasks = numTasks;
+			task->taggedBlocks = info.taggedBlocks;
+			task->checksummedRecords = info.checksummedRecords;
 		}
+		chanTaskNum = numTasks;
+		if( fscanf(f,"[Task%u]\n",&chanTaskNum)<0
+		 || fscanf(f,"Name=%s\n",task->taskName)<0
+		 || fscanf(f,"NumberOfChannels=%u\n",&task->numberOfChannels)<0
+		 || fscanf(f,"ReadBlockSize=%u\n",&task->readBlockSize)<0
+		 || fscanf(f,"ReadBlockSizeInBytes=%u\n",&task->readBlockSizeInBytes)<0 )
+			goto Error;
+		if( chanTaskNum!=taskNum || task->numberOfChannels<1
+		 || (task->channels=(ChannelInfo*)calloc(task->numberOfChannels,sizeof(ChannelInfo)))==NULL )
+			goto Error;
+		task->firstChannel = info.numberOfFileChannels;
+		info.numberOfFileChannels += task->numberOfChannels;
 
-		if( channelNum!=i || *coeffBuff=='\0' || *coeffBuff==';' ) {
-			FreeDataFileInfoContent(&info);
-			return NULL;
+		// Only tasks with encoded blocks have a BlockEncoding
+		*encodingBuff = '\0';
+		if( fscanf(f,"BlockEncoding=%99s\n",encodingBuff)<0 )
+			goto Error;
+		task->encodedBlocks = strcmp(encodingBuff,"DeltaZigzag")==0;
+		if( *encodingBuff && !task->encodedBlocks )
+			goto Error;
+		if( task->encodedBlocks )
+			info.blockRecords = TRUE;
+
+		// Only tasks whose blocks vary in size have a VariableBlockSize
+		*encodingBuff = '\0';
+		if( fscanf(f,"VariableBlockSize=%99s\n",encodingBuff)<0 )
+			goto Error;
+		task->variableBlocks = strcmp(encodingBuff,"TRUE")==0;
+		if( task->variableBlocks )
+			info.blockRecords = TRUE;
+
+		// Each file channel of the task must be mapped once. The map is read
+		// straight from the file, as it grows with the number of channels.
+		if( info.taggedBlocks ) {
+			if( fscanf(f,"ChannelMap=")<0
+			 || (task->channelMap=(uInt32*)malloc(sizeof(uInt32)*task->numberOfChannels))==NULL
+			 || (mapped=(bool32*)calloc(task->numberOfChannels,sizeof(bool32)))==NULL )
+				goto Error;
+			for(i=0;i<task->numberOfChannels;++i) {
+				if( fscanf(f,"%u;",&task->channelMap[i])!=1
+				 || task->channelMap[i]<task->firstChannel || task->channelMap[i]>=info.numberOfFileChannels
+				 || mapped[task->channelMap[i]-task->firstChannel] )
+					goto Error;
+				mapped[task->channelMap[i]-task->firstChannel] = TRUE;
+			}
+			free(mapped);
+			mapped = NULL;
+			if( fscanf(f,"\n")<0 )
+				goto Error;
 		}
-		chan->rawSampleJustification = strcmp(justificationBuff,"Left")?DAQmx_Val_RightJustified:DAQmx_Val_LeftJustified;
-		chan->signedNumber = strcmp(signedBuff,"TRUE")==0;
-		chan->compressionType = strcmp(compBuff,"LosslessPacking")?(strcmp(compBuff,"LossyLSBRemoval")?DAQmx_Val_None:DAQmx_Val_LossyLSBRemoval):DAQmx_Val_LosslessPacking;
-		chan->compressionByteOrder = strcmp(byteOrderBuff,"LittleEndian")?BigEndian:LittleEndian;
 
-		coeffChainPtr = &chan->polynomialScalingCoeffChain;
-		coeffStr = strtok(coeffBuff,";");
-		while( coeffStr ) {
-			coeff = (ScaleCoeff*)malloc(sizeof(ScaleCoeff));
-			coeff->next = NULL;
-			*coeffChainPtr = coeff;
-			coeffChainPtr = &coeff->next;
-			sscanf(coeffStr,"%le",&coeff->scalingCoeff);
-			coeffStr = strtok(NULL,";");
+		for(i=0;i<task->numberOfChannels;++i) {
+			chan = &task->channels[i];
+			chanTaskNum = numTasks;
+			if( fscanf(f,"[Task%uChannel%u]\n",&chanTaskNum,&channelNum)<0
+			 || fscanf(f,"Name=%s\n",chan->name)<0
+			 || fscanf(f,"RawSampleResolution=%u\n",&chan->rawSampleResolution)<0
+			 || fscanf(f,"RawSampleSizeInBits=%u\n",&chan->rawSampleSizeInBits)<0
+			 || fscanf(f,"RawSampleJustification=%s\n",justificationBuff)<0
+			 || fscanf(f,"SignedNumber=%s\n",signedBuff)<0
+			 || fscanf(f,"CompressionType=%s\n",compBuff)<0
+			 || fscanf(f,"CompressedSampleSizeInBits=%u\n",&chan->compressedSampleSizeInBits)<0
+			 || fscanf(f,"CompressionByteOrder=%s\n",byteOrderBuff)<0
+			 || fscanf(f,"PolynomialScalingCoeffs=%s\n",coeffBuff)<0 )
+				goto Error;
+			// Only channels whose compressed sample size was calibrated have a noise floor
+			chan->noiseFloor = -1.0;
+			if( fscanf(f,"NoiseFloorInLSBs=%lf\n",&chan->noiseFloor)<0
+			 || fscanf(f,"LossyErrorBoundInLSBs=%u\n",&chan->lossyErrorBound)<0 )
+				goto Error;
+
+			if( chanTaskNum!=taskNum || channelNum!=i || *coeffBuff=='\0' || *coeffBuff==';' )
+				goto Error;
+			chan->rawSampleJustification = strcmp(justificationBuff,"Left")?DAQmx_Val_RightJustified:DAQmx_Val_LeftJustified;
+			chan->signedNumber = strcmp(signedBuff,"TRUE")==0;
+			chan->compressionType = strcmp(compBuff,"LosslessPacking")?(strcmp(compBuff,"LossyLSBRemoval")?DAQmx_Val_None:DAQmx_Val_LossyLSBRemoval):DAQmx_Val_LosslessPacking;
+			chan->compressionByteOrder = strcmp(byteOrderBuff,"LittleEndian")?BigEndian:LittleEndian;
+			if( !ParseScalingCoeffs(chan,coeffBuff) )
+				goto Error;
 		}
 	}
 
 	if( fscanf(f,"[BinaryData]\n")<0
-	 || fscanf(f,"Begin=Here\n")<0 ) {
-		FreeDataFileInfoContent(&info);
-		return NULL;
-	}
-
-	fclose(f);
-	return &info;
-}
-
-static uInt8 *ReadDataFileData(DataFileInfo *info, const char filePath[], uInt32 *numBytes)
-{
-	FILE	*f;
-	long	size=FindOutFileSize(filePath),read;
-	uInt8	*data=NULL;
-
-	// open binary file, skip headerSize bytes, start crackin'
-	if( (f=fopen(filePath,"rb"))==NULL )
-		return NULL;
-	if( fseek(f,info->headerSize,SEEK_SET) )
+	 || fscanf(f,"Begin=Here\n")<0 )
 		goto Error;
 
-	if( (data=(uInt8*)malloc(size-=info->headerSize))==NULL )
-		goto Error;
-	if( (read=fread(data,1,size,f))<size ) {
-		free(data);
-		data = NULL;
-		goto Error;
+	fclose(f);
+	for(task=&info;task;task=task->nextTask) {
+		task->numberOfFileChannels = info.numberOfFileChannels;
+		for(task->sampleBits=0,i=0;i<task->numberOfChannels;++i)
+			task->sampleBits += IsDataPacked(task) ? task->channels[i].compressedSampleSizeInBits : task->channels[i].rawSampleSizeInBits;
+		if( !BuildScalingTables(task,&tableBytes) ) {
+			FreeDataFileInfoContent(&info);
+			return NULL;
+		}
+		for(i=0;i<task->numberOfChannels;++i)
+			task->channels[i].decode = SelectDecodeChannelKernel(&task->channels[i],NULL);
 	}
-	if( numBytes )
-		*numBytes = size;
+	return &info;
 
 Error:
-	if( f )
-		fclose(f);
-	return data;
+	fclose(f);
+	free(mapped);
+	FreeDataFileInfoContent(&info);
+	return NULL;
 }
 
-static int PlotScaledData(float64 *data[100], uInt32 numChannels, uInt32 numSamples)
+// Reads a list of file channels and ranges of file channels, such as
+// "0,4-7". An empty list selects every channel.
+static bool32 ParseChannelSelection(const char selection[], uInt32 numChannels, bool32 selected[])
 {
-	uInt32	iChan=0,iSamp=0;
-	double	total;
+	const char		*pos=selection;
+	char			*end;
+	unsigned long	first,last;
 
-	if( numChannels<=0 || numSamples<=0 )
-		return 0;
-	// Plot your data here
-	for(;iChan<numChannels;++iChan,printf("Channel: %d\tNumber of Samples: %ld\t\tAverage: %f\n",(int)iChan,numSamples,total/numSamples))
-		for(total=0.0,iSamp=0;iSamp<numSamples;total+=data[iChan][iSamp++]);
-	return 1;
+	if( *pos=='\0' ) {
+		for(first=0;first<numChannels;++first)
+			selected[first] = TRUE;
+		return TRUE;
+	}
+	for(;;) {
+		first = last = strtoul(pos,&end,10);
+		if( end==pos )
+			return FALSE;
+		if( *end=='-' ) {
+			pos = end + 1;
+			last = strtoul(pos,&end,10);
+			if( end==pos )
+				return FALSE;
+		}
+		if( first>last || last>=numChannels )
+			return FALSE;
+		while( first<=last )
+			selected[first++] = TRUE;
+		if( *end=='\0' )
+			return TRUE;
+		if( *end!=',' )
+			return FALSE;
+		pos = end + 1;
+	}
 }
 
-static int DecodeDataWithoutPacking(DataFileInfo *info, uInt8 *rawData, uInt32 numBytes, float64 *data[100])
+// Lists the selected channels of each task in raw data order, with the
+// bit offset of every channel in a sample of all the channels of the task,
+// so the decoder can go straight to the channels it needs. Tasks whose
+// channels are all selected keep the decoders that decode every channel.
+static bool32 SelectDataFileChannels(DataFileInfo *info, const bool32 selected[])
 {
-	uInt32	numSamples=0,iSamp,iChan,iByte;
-	long	val;
-
-	// For each block of data
-	while( numBytes ) {
-		// For each sample
-		for(iSamp=0;iSamp<info->readBlockSize;++iSamp) {
-			ChannelInfo	*chan=info->channelInfoChain;
+	DataFileInfo	*task;
+	ChannelInfo		*chan;
+	bool32			packed;
+	uInt32			iChan,fileChannel,size;
 
-			// For each channel
-			for(iChan=0;iChan<info->numberOfChannels;++iChan,chan=chan->next) {
-				uInt32			size,bytes,signmask,extendmask;
-				ScaleCoeff		*coeff;
-				double			polynom=1.0;
+	for(task=info;task;task=task->nextTask) {
+		free(task->selectedChannels);
+		free(task->channelBitOffsets);
+		task->selectedChannels = task->channelBitOffsets = NULL;
+		task->numSelectedChannels = 0;
+		for(iChan=0;iChan<task->numberOfChannels;++iChan)
+			if( selected[task->channelMap?task->channelMap[iChan]:task->firstChannel+iChan] )
+				++task->numSelectedChannels;
+		if( task->numSelectedChannels==task->numberOfChannels )
+			continue;
 
-				if( chan==NULL )
-					goto Error;
+		if( (task->selectedChannels=(uInt32*)malloc(sizeof(uInt32)*(task->numSelectedChannels+1)))==NULL
+		 || (task->channelBitOffsets=(uInt32*)malloc(sizeof(uInt32)*task->numberOfChannels))==NULL )
+			return FALSE;
+		packed = IsDataPacked(task);
+		task->numSelectedChannels = task->sampleBits = 0;
+		for(iChan=0,chan=task->channels;iChan<task->numberOfChannels;++iChan,++chan) {
+			fileChannel = task->channelMap ? task->channelMap[iChan] : task->firstChannel+iChan;
+			if( selected[fileChannel] )
+				task->selectedChannels[task->numSelectedChannels++] = iChan;
+			size = packed ? chan->compressedSampleSizeInBits : chan->rawSampleSizeInBits;
+			if( size>32 )
+				return FALSE;
+			task->channelBitOffsets[iChan] = task->sampleBits;
+			task->sampleBits += size;
+		}
+	}
+	return TRUE;
+}
 
-				size = chan->rawSampleSizeInBits;
-				bytes = size / 8;
-				signmask = 1 << (size-1);
-				extendmask = 0xFFFFFFFF - (1 << (32-size)) + 1;
+// Reads the semicolon separated coefficients into an array
+static bool32 ParseScalingCoeffs(ChannelInfo *chan, char coeffBuff[])
+{
+	char	*coeffStr;
+	uInt32	numCoeffs=1;
 
-				// Read the bytes
-				val = 0;
+	for(coeffStr=coeffBuff;*coeffStr;++coeffStr)
+		if( *coeffStr==';' )
+			++numCoeffs;
+	if( (chan->scalingCoeffs=(float64*)malloc(sizeof(float64)*numCoeffs))==NULL )
+		return FALSE;
+	coeffStr = strtok(coeffBuff,";");
+	while( coeffStr && chan->numScalingCoeffs<numCoeffs ) {
+		sscanf(coeffStr,"%le",&chan->scalingCoeffs[chan->numScalingCoeffs++]);
+		coeffStr = strtok(NULL,";");
+	}
+	return chan->numScalingCoeffs>0;
+}
 
-				if( chan->compressionByteOrder==LittleEndian )
-					for(iByte=0;iByte<bytes&&numBytes;++iByte,--numBytes)
-						val += *rawData++ << iByte * 8;
-				else
-					for(iByte=0;iByte<bytes&&numBytes;++iByte,--numBytes)
-						val = (val<<8) + *rawData++;
+static int OpenDataFileBlockIterator(DataFileInfo *info, const char filePath[], DataFileBlockIterator *iter)
+{
+	memset(iter,0,sizeof(DataFileBlockIterator));
+	iter->info = info;
+	iter->offset = info->headerSize;
+	iter->remaining = (uInt64)-1;
+#ifdef _WIN32
+	{
+		SYSTEM_INFO		sysInfo;
+		LARGE_INTEGER	size;
 
-				// Extend sign if needed
-				if( chan->signedNumber && size<32 && val&signmask )
-					val |= extendmask;
+		GetSystemInfo(&sysInfo);
+		iter->granularity = sysInfo.dwAllocationGranularity;
+		if( info->readBlockSize==0 || info->readBlockSizeInBytes==0
+		 || (iter->file=CreateFileA(filePath,GENERIC_READ,FILE_SHARE_READ|FILE_SHARE_WRITE,NULL,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL))==INVALID_HANDLE_VALUE ) {
+			iter->file = NULL;
+			return 0;
+		}
+		if( !GetFileSizeEx(iter->file,&size) || (uInt64)size.QuadPart<=iter->offset
+		 || (iter->mapping=CreateFileMappingA(iter->file,NULL,PAGE_READONLY,0,0,NULL))==NULL ) {
+			CloseDataFileBlockIterator(iter);
+			return 0;
+		}
+		iter->fileSize = size.QuadPart;
+	}
+#else
+	{
+		struct stat		st;
 
-				// Scale
-				for(data[iChan][numSamples]=0.0,coeff=chan->polynomialScalingCoeffChain;coeff;coeff=coeff->next,polynom*=val)
-					data[iChan][numSamples] += coeff->scalingCoeff * polynom;
-			}
-			++numSamples;
+		iter->granularity = (uInt32)sysconf(_SC_PAGESIZE);
+		if( info->readBlockSize==0 || info->readBlockSizeInBytes==0 || (iter->fd=open(filePath,O_RDONLY))<0 ) {
+			iter->fd = -1;
+			return 0;
 		}
+		if( fstat(iter->fd,&st) || (uInt64)st.st_size<=iter->offset ) {
+			CloseDataFileBlockIterator(iter);
+			return 0;
+		}
+		iter->fileSize = st.st_size;
 	}
+#endif
+	return 1;
+}
 
-Error:
-	return numSamples;
+static void UnmapDataFileView(DataFileBlockIterator *iter)
+{
+	if( iter->view==NULL )
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(iter->view);
+#else
+	munmap(iter->view,iter->viewBytes);
+#endif
+	iter->view = NULL;
 }
 
-static int DecodeDataWithPacking(DataFileInfo *info, uInt8 *rawData, uInt32 numBytes, float64 *data[100])
+// Maps at most maxBytes from the offset of the iterator and moves the
+// offset past them. The previous view is released, so only one view is
+// mapped.
+static const uInt8 *MapDataFileBytes(DataFileBlockIterator *iter, uInt64 maxBytes, uInt32 *numBytes)
 {
-	uInt32	numSamples=0,iSamp,iChan;
-	long	val;
+	uInt64	start=iter->offset,end,viewStart;
 
-	// For each block of data
-	while( numBytes ) {
-		int		bitPos=0;
-		uInt32	ch=*rawData++,byteCount=1;
+	UnmapDataFileView(iter);
+	if( maxBytes==0 || start>=iter->fileSize )
+		return NULL;
+	end = start + maxBytes;
+	if( end>iter->fileSize )
+		end = iter->fileSize;
+	viewStart = start - start%iter->granularity;
+	iter->viewBytes = (size_t)(end-viewStart);
+#ifdef _WIN32
+	if( (iter->view=MapViewOfFile(iter->mapping,FILE_MAP_READ,(DWORD)(viewStart>>32),(DWORD)viewStart,iter->viewBytes))==NULL )
+		return NULL;
+#else
+	if( (iter->view=mmap(NULL,iter->viewBytes,PROT_READ,MAP_PRIVATE,iter->fd,(off_t)viewStart))==MAP_FAILED ) {
+		iter->view = NULL;
+		return NULL;
+	}
+#ifdef MADV_SEQUENTIAL
+	madvise(iter->view,iter->viewBytes,MADV_SEQUENTIAL);
+#endif
+#endif
+	iter->offset = end;
+	if( numBytes )
+		*numBytes = (uInt32)(end-start);
+	return (const uInt8*)iter->view + (start-viewStart);
+}
 
-		--numBytes;
-		// For each sample
-		for(iSamp=0;iSamp<info->readBlockSize;++iSamp) {
-			ChannelInfo	*chan=info->channelInfoChain;
+// Maps the next whole blocks that decode into at most maxSamples samples
+// per channel
+static const uInt8 *MapNextDataFileBlocks(DataFileBlockIterator *iter, uInt32 maxSamples, uInt32 *numBytes)
+{
+	return MapDataFileBytes(iter,(uInt64)(maxSamples/iter->info->readBlockSize)*iter->info->readBlockSizeInBytes,numBytes);
+}
 
-			// For each channel
-			for(iChan=0;iChan<info->numberOfChannels;++iChan,chan=chan->next) {
-				uInt32			size,lsb,realsize,signmask,extendmask,bitCount=0;
-				ScaleCoeff		*coeff;
-				double			polynom=1.0;
+// Decodes the next whole blocks into data, which must hold maxSamples
+// samples per channel. Returns the number of samples per channel, or 0
+// at the end of the file or of the range set by SeekDataFileSamples.
+static int ReadNextDataFileBlocks(DataFileBlockIterator *iter, float64 *data[], uInt32 maxSamples)
+{
+	const uInt8	*rawData;
+	uInt32		numBytes,iChan;
+	uInt64		rangeSamples=iter->skip+iter->remaining;
+	int			numSamples;
 
-				if( chan==NULL )
-					goto Error;
+	if( iter->remaining==0 )
+		return 0;
+	// Only map the blocks the range still needs
+	if( rangeSamples<maxSamples )
+		maxSamples = (uInt32)((rangeSamples+iter->info->readBlockSize-1)/iter->info->readBlockSize*iter->info->readBlockSize);
+	if( (rawData=MapNextDataFileBlocks(iter,maxSamples,&numBytes))==NULL )
+		return 0;
+	if( iter->pool )
+		numSamples = DecodeDataBlocksParallel(iter->pool,iter->info,rawData,numBytes,data);
+	else
+		numSamples = DecodeDataBlocks(iter->info,rawData,numBytes,data);
+	if( iter->skip ) {
+		if( numSamples<=(int)iter->skip ) {
+			iter->remaining = 0;
+			return 0;
+		}
+		numSamples -= iter->skip;
+		for(iChan=0;iChan<iter->info->numberOfChannels;++iChan)
+			if( data[iChan] )
+				memmove(data[iChan],data[iChan]+iter->skip,sizeof(float64)*numSamples);
+		iter->skip = 0;
+	}
+	if( (uInt64)numSamples>iter->remaining )
+		numSamples = (int)iter->remaining;
+	iter->remaining -= numSamples;
+	return numSamples;
+}
 
-				size = chan->compressedSampleSizeInBits;
-				lsb = (chan->rawSampleJustification==DAQmx_Val_LeftJustified?chan->rawSampleSizeInBits:chan->rawSampleResolution) - size;
-				realsize = size + lsb;
-				signmask = 1 << (realsize-1);
-				extendmask = 0xFFFFFFFF - (1 << realsize) + 1;
-				val = 0;
+// Walks the blocks of a file whose blocks are tagged with their task or
+// delta encoded, one record at a time. The blocks of several tasks are
+// sorted by task in one pass over the file. The blocks of a task are
+// decoded into the buffers of its channels, which hold blocksPerRead
+// blocks of the task, and plotted each time the buffers are full. With
+// the windows set by SeekDataFileRecords, only the samples of the window
+// of each task are kept and the walk stops after the last record of the
+// windows. Returns the number of samples per channel read, summed over
+// the tasks.
+static uInt64 ReadDataFileRecords(DataFileBlockIterator *iter, float64 *data[], float64 totals[], uInt64 counts[], OverviewBuilder *overview, NpyExporter *exporter)
+{
+	DataFileInfo	*info=iter->info,*task,**tasks;
+	RecordWindow	*window;
+	const uInt8		*rawData,*block;
+	float64			**out;
+	uInt8			*raw=NULL;
+	uInt32			*fill,*codes=NULL,numBytes,used,tag,blockBytes,blockSamples,skip,keep,i,maxRecordBytes=0,maxBlockBytes=0,maxValues=0;
+	int32			recordBytes=0;
+	uInt64			start,numSamples=0;
 
-				while( bitCount<size ) {
-					// Shift left
-					val <<= 1;
+	tasks = (DataFileInfo**)malloc(sizeof(DataFileInfo*)*info->numberOfTasks);
+	fill = (uInt32*)calloc(info->numberOfTasks,sizeof(uInt32));
+	out = (float64**)malloc(sizeof(float64*)*info->numberOfFileChannels);
+	if( tasks==NULL || fill==NULL || out==NULL )
+		goto Error;
+	for(i=0,task=info;task;task=task->nextTask,++i) {
+		tasks[i] = task;
+		if( task->readBlockSizeInBytes+BlockTagBytes+BlockSampleCountBytes+BlockLengthBytes+BlockChecksumBytes>maxRecordBytes )
+			maxRecordBytes = task->readBlockSizeInBytes + BlockTagBytes + BlockSampleCountBytes + BlockLengthBytes + BlockChecksumBytes;
+		// Encoded blocks are rebuilt into a raw block before they are decoded
+		if( task->encodedBlocks && task->readBlockSizeInBytes>maxBlockBytes )
+			maxBlockBytes = task->readBlockSizeInBytes;
+		if( task->encodedBlocks && task->readBlockSize*task->numberOfChannels>maxValues )
+			maxValues = task->readBlockSize*task->numberOfChannels;
+	}
+	if( maxBlockBytes
+	 && ((raw=(uInt8*)malloc(maxBlockBytes))==NULL || (codes=(uInt32*)malloc(sizeof(uInt32)*maxValues))==NULL) )
+		goto Error;
 
-					// Add in the next bit
-					val += (ch >> (8-bitPos-1)) & 1;
-					// Get next byte if necessary
-					++bitCount;
-					++bitPos;
-					if( bitPos==8 && byteCount<info->readBlockSizeInBytes ) {
-						bitPos = 0;
-						if( numBytes==0 )
-							goto Error;
-						else {
-							ch = *rawData++;
-							--numBytes;
-							++byteCount;
-						}
-					}
+	while( iter->remaining>0 ) {
+		start = iter->offset;
+		if( (rawData=MapDataFileBytes(iter,(uInt64)blocksPerRead*maxRecordBytes,&numBytes))==NULL )
+			break;
+		for(used=0;(recordBytes=ParseBlockRecord(info,rawData+used,numBytes-used,&tag,&task,&block,&blockBytes,&blockSamples))!=0;used+=recordBytes) {
+			// An encoded block that would not have shrunk is stored raw
+			if( recordBytes>0 && blockBytes<GetRawBlockBytes(task,blockSamples) ) {
+				if( DecodeDeltaBlock(task,block,blockBytes,blockSamples,codes,raw) )
+					block = raw;
+				else
+					recordBytes = -1;
+			}
+			// Past a corrupt record, the next record is searched for one
+			// byte further at a time until its checksum matches
+			if( recordBytes<0 ) {
+				if( !info->checksummedRecords )
+					break;
+				if( !iter->damaged ) {
+					iter->damaged = TRUE;
+					iter->damageStart = start + used;
 				}
-
-				// Scale back in the lost bits
-				val <<= lsb;
-
-				// Extend sign if needed
-				if( chan->signedNumber && realsize<32 && val&signmask )
-					val |= extendmask;
-
-				// Scale
-				for(data[iChan][numSamples]=0.0,coeff=chan->polynomialScalingCoeffChain;coeff;coeff=coeff->next,polynom*=val)
-					data[iChan][numSamples] += coeff->scalingCoeff * polynom;
+				recordBytes = 1;
+				continue;
 			}
-			++numSamples;
+			if( iter->damaged )
+				ReportDataFileDamage(iter,start+used);
+			skip = 0;
+			keep = blockSamples;
+			if( iter->windows ) {
+				if( start+used>iter->windowEnd ) {
+					iter->remaining = 0;
+					break;
+				}
+				window = &iter->windows[tag];
+				if( start+used<window->startOffset || start+used>window->endOffset )
+					continue;
+				if( start+used==window->startOffset )
+					skip = window->skip;
+				if( start+used==window->endOffset && window->keep<keep )
+					keep = window->keep;
+				if( skip>=keep )
+					continue;
+				window->numSamples += keep-skip;
+			}
+			// A block of variable size that does not fit after the samples
+			// in the buffers of its task plots them first
+			if( fill[tag]+blockSamples>task->readBlockSize*blocksPerRead ) {
+				PlotTaskData(task,data,fill[tag],totals,counts,overview,exporter);
+				fill[tag] = 0;
+			}
+			for(i=0;i<task->numberOfChannels;++i) {
+				out[i] = data[task->channelMap?task->channelMap[i]:task->firstChannel+i];
+				if( out[i] )
+					out[i] += fill[tag];
+			}
+			if( blockSamples<task->readBlockSize )
+				DecodeShortBlock(task,block,blockSamples,out);
+			else
+				DecodeDataBlocks(task,block,task->readBlockSizeInBytes,out);
+			for(i=0;skip>0&&i<task->numberOfChannels;++i)
+				if( out[i] )
+					memmove(out[i],out[i]+skip,sizeof(float64)*(keep-skip));
+			numSamples += keep-skip;
+			fill[tag] += keep-skip;
+			if( fill[tag]==task->readBlockSize*blocksPerRead ) {
+				PlotTaskData(task,data,fill[tag],totals,counts,overview,exporter);
+				fill[tag] = 0;
+			}
+		}
+		if( recordBytes<0 ) {
+			puts("Error: The file has a corrupt block or a block of an unknown task.");
+			goto Error;
 		}
+		// A block cut by the end of the view is mapped again by the next
+		// view, unless the rest of the file is shorter than a block. Then
+		// it is left for the next call, once a followed file has grown.
+		iter->offset = start + used;
+		if( used==0 )
+			break;
 	}
 
 Error:
+	if( tasks && fill )
+		for(i=0;i<info->numberOfTasks;++i)
+			if( fill[i] )
+				PlotTaskData(tasks[i],data,fill[i],totals,counts,overview,exporter);
+	free(tasks);
+	free(fill);
+	free(out);
+	free(raw);
+	free(codes);
 	return numSamples;
 }
 
-static void FreeDataFileInfoContent(DataFileInfo *info)
+// Decodes the records left at the end of a file that is read to its end.
+// Without checksums they are a record cut short by the end of the file.
+// With checksums they may also be a corrupt record whose length runs past
+// the end of the file, so the records after it are searched for. Returns
+// the number of samples per channel read, summed over the tasks.
+static uInt64 FinishDataFileRecords(DataFileBlockIterator *iter, float64 *data[], float64 totals[], uInt64 counts[], OverviewBuilder *overview, NpyExporter *exporter)
 {
-	ChannelInfo	*chain=info->channelInfoChain,*next;
-	ScaleCoeff	*coeff,*nextCoeff;
+	DataFileInfo	*task;
+	const uInt8		*rawData,*block;
+	uInt32			numBytes,used,tag,blockBytes,blockSamples;
+	uInt64			start,numSamples=0;
 
-	while( chain ) {
-		next = chain->next;
-		coeff = chain->polynomialScalingCoeffChain;
-		while( coeff ) {
-			nextCoeff = coeff->next;
-			free(coeff);
-			coeff = nextCoeff;
+	// The rest of the file is after the windows
+	if( iter->remaining==0 )
+		return 0;
+	while( iter->info->checksummedRecords && iter->offset<iter->fileSize && iter->remaining>0 ) {
+		if( !iter->damaged ) {
+			iter->damaged = TRUE;
+			iter->damageStart = iter->offset;
 		}
-		free(chain);
-		chain = next;
+		// The rest of the file is shorter than a record, so it is mapped
+		// once and searched for the next record whose checksum matches
+		start = iter->offset;
+		if( (rawData=MapDataFileBytes(iter,iter->fileSize-start,&numBytes))==NULL )
+			break;
+		for(used=1;used<numBytes&&ParseBlockRecord(iter->info,rawData+used,numBytes-used,&tag,&task,&block,&blockBytes,&blockSamples)<=0;++used);
+		iter->offset = start + used;
+		if( used>=numBytes )
+			break;
+		numSamples += ReadDataFileRecords(iter,data,totals,counts,overview,exporter);
+		if( iter->offset==start+used )
+			++iter->offset;
 	}
+	if( iter->damaged )
+		ReportDataFileDamage(iter,iter->fileSize);
+	else if( iter->offset<iter->fileSize )
+		printf("Warning: The last %lu bytes of the file are not a whole block.\n",(unsigned long)(iter->fileSize-iter->offset));
+	return numSamples;
 }
 
-static long FindOutFileSize(const char filePath[])
+static void ReportDataFileDamage(DataFileBlockIterator *iter, uInt64 end)
 {
-	FILE	*f;
-	long	size=0;
+	printf("Warning: Skipped corrupt blocks from byte %lu to byte %lu of the file.\n",(unsigned long)iter->damageStart,(unsigned long)end);
+	iter->damaged = FALSE;
+	iter->skippedDamage = TRUE;
+}
 
-	if( (f=fopen(filePath,"rb")) && fseek(f,0,SEEK_END)==0 ) {
-		size = ftell(f);
-		fclose(f);
+// Finds the task, the stored block and the samples per channel of the
+// record at the start of numBytes bytes. A record holds the task tag of a
+// multi-task file, the number of samples of a block of variable size, the
+// length of an encoded block, the block and the checksum of all of them,
+// in that order. Returns the size of the record, 0 if the bytes end before
+// it does, or -1 if the record is corrupt.
+static int32 ParseBlockRecord(DataFileInfo *info, const uInt8 *record, uInt32 numBytes, uInt32 *tag, DataFileInfo **task, const uInt8 **block, uInt32 *blockBytes, uInt32 *blockSamples)
+{
+	const uInt8	*length,*count,*checksum;
+	uInt32		headerBytes=0,i;
+
+	*tag = 0;
+	if( info->taggedBlocks ) {
+		if( numBytes<BlockTagBytes )
+			return 0;
+		*tag = record[0] | (uInt32)record[1]<<8 | (uInt32)record[2]<<16 | (uInt32)record[3]<<24;
+		headerBytes = BlockTagBytes;
+	}
+	for(*task=info,i=0;*task&&i<*tag;*task=(*task)->nextTask,++i);
+	if( *task==NULL )
+		return -1;
+	*blockSamples = (*task)->readBlockSize;
+	if( (*task)->variableBlocks ) {
+		if( numBytes-headerBytes<BlockSampleCountBytes )
+			return 0;
+		count = record + headerBytes;
+		*blockSamples = count[0] | (uInt32)count[1]<<8 | (uInt32)count[2]<<16 | (uInt32)count[3]<<24;
+		headerBytes += BlockSampleCountBytes;
+		if( *blockSamples==0 || *blockSamples>(*task)->readBlockSize )
+			return -1;
+	}
+	*blockBytes = GetRawBlockBytes(*task,*blockSamples);
+	if( (*task)->encodedBlocks ) {
+		if( numBytes-headerBytes<BlockLengthBytes )
+			return 0;
+		length = record + headerBytes;
+		i = length[0] | (uInt32)length[1]<<8 | (uInt32)length[2]<<16 | (uInt32)length[3]<<24;
+		headerBytes += BlockLengthBytes;
+		if( i==0 || i>*blockBytes )
+			return -1;
+		*blockBytes = i;
+	}
+	if( numBytes-headerBytes<*blockBytes )
+		return 0;
+	*block = record + headerBytes;
+	if( info->checksummedRecords ) {
+		if( numBytes-headerBytes-*blockBytes<BlockChecksumBytes )
+			return 0;
+		checksum = *block + *blockBytes;
+		i = checksum[0] | (uInt32)checksum[1]<<8 | (uInt32)checksum[2]<<16 | (uInt32)checksum[3]<<24;
+		if( ComputeCrc32c(0,record,headerBytes+*blockBytes)!=i )
+			return -1;
+		return (int32)(headerBytes+*blockBytes+BlockChecksumBytes);
+	}
+	return (int32)(headerBytes+*blockBytes);
+}
+
+// Returns the size of the raw data of a block of numSamples samples per
+// channel. Blocks of variable size end at the byte after their last
+// sample.
+static uInt32 GetRawBlockBytes(DataFileInfo *task, uInt32 numSamples)
+{
+	if( numSamples==task->readBlockSize )
+		return task->readBlockSizeInBytes;
+	return (uInt32)(((uInt64)numSamples*task->sampleBits+7)/8);
+}
+
+static void CloseDataFileBlockIterator(DataFileBlockIterator *iter)
+{
+	UnmapDataFileView(iter);
+#ifdef _WIN32
+	if( iter->mapping )
+		CloseHandle(iter->mapping);
+	if( iter->file )
+		CloseHandle(iter->file);
+	iter->mapping = iter->file = NULL;
+#else
+	if( iter->fd>=0 )
+		close(iter->fd);
+	iter->fd = -1;
+#endif
+}
+
+/*********************************************/
+// Block Checksums
+/*********************************************/
+// Returns the CRC32C of numBytes at data, continuing the crc of the bytes
+// before them, which is 0 for the first bytes
+static uInt32 ComputeCrc32c(uInt32 crc, const uInt8 *data, size_t numBytes)
+{
+	static uInt32	(*compute)(uInt32 crc, const uInt8 *data, size_t numBytes)=NULL;
+
+	if( compute==NULL ) {
+		compute = ComputeCrc32cTable;
+#ifdef HAVE_X86_CRC32C
+		__builtin_cpu_init();
+		if( __builtin_cpu_supports("sse4.2") )
+			compute = ComputeCrc32cSSE42;
+#endif
+	}
+	return ~compute(~crc,data,numBytes);
+}
+
+static uInt32 ComputeCrc32cTable(uInt32 crc, const uInt8 *data, size_t numBytes)
+{
+	static uInt32	table[256];
+	static bool32	tableBuilt=FALSE;
+	uInt32			i,bit,entry;
+
+	if( !tableBuilt ) {
+		for(i=0;i<256;++i) {
+			for(entry=i,bit=0;bit<8;++bit)
+				entry = entry>>1 ^ (entry&1?Crc32cPolynomial:0);
+			table[i] = entry;
+		}
+		tableBuilt = TRUE;
+	}
+	while( numBytes-- )
+		crc = table[(crc^*data++)&0xFF] ^ crc>>8;
+	return crc;
+}
+
+#ifdef HAVE_X86_CRC32C
+__attribute__((target("sse4.2")))
+static uInt32 ComputeCrc32cSSE42(uInt32 crc, const uInt8 *data, size_t numBytes)
+{
+	uInt32	word32;
+#ifdef __x86_64__
+	uInt64	crc64=crc,word;
+
+	for(;numBytes>=8;numBytes-=8,data+=8) {
+		memcpy(&word,data,8);
+		crc64 = _mm_crc32_u64(crc64,word);
+	}
+	crc = (uInt32)crc64;
+#endif
+	for(;numBytes>=4;numBytes-=4,data+=4) {
+		memcpy(&word32,data,4);
+		crc = _mm_crc32_u32(crc,word32);
+	}
+	while( numBytes-- )
+		crc = _mm_crc32_u8(crc,*data++);
+	return crc;
+}
+#endif
+
+/*********************************************/
+// Follow Mode
+/*********************************************/
+static void StartFollowingDataFile(DataFileFollower *follower, const char filePath[])
+{
+#ifdef __linux__
+	char	directory[1024],*slash;
+#endif
+
+	memset(follower,0,sizeof(DataFileFollower));
+	follower->lastGrowth = GetTimeInSeconds();
+#ifdef __linux__
+	// The directory is watched rather than the file, which may not exist
+	// yet and is followed by the next segment of a rotating stream
+	strncpy(directory,filePath,sizeof(directory)-1);
+	directory[sizeof(directory)-1] = '\0';
+	if( (slash=strrchr(directory,'/'))==NULL )
+		strcpy(directory,".");
+	else
+		slash[slash==directory] = '\0';
+	if( (follower->inotifyFd=inotify_init1(IN_NONBLOCK|IN_CLOEXEC))>=0
+	 && inotify_add_watch(follower->inotifyFd,directory,IN_MODIFY|IN_CREATE|IN_CLOSE_WRITE|IN_MOVED_TO)<0 ) {
+		close(follower->inotifyFd);
+		follower->inotifyFd = -1;
+	}
+#endif
+}
+
+// Waits until whole blocks have been appended to the file of the iterator
+// and takes them into its range. Returns 1 once they have, or 0 when the
+// stream has moved on to the segment at nextSegmentPath or the file has
+// not grown for followIdleSeconds.
+static int FollowDataFile(DataFileFollower *follower, DataFileBlockIterator *iter, const char nextSegmentPath[])
+{
+	bool32	nextStarted=FALSE;
+
+	for(;;) {
+		if( GrowDataFileBlockIterator(iter) ) {
+			follower->lastGrowth = GetTimeInSeconds();
+			return 1;
+		}
+		// The writer writes the last block of a segment before the first
+		// block of the next one, but closes the segment in the background,
+		// so the segment is checked once more after the next one starts.
+		// A segment written out of order is done once the index covers it.
+		if( nextStarted && !iter->unindexed )
+			return 0;
+		if( !nextStarted && nextSegmentPath && GetDataFileSize(nextSegmentPath)>iter->info->headerSize )
+			nextStarted = TRUE;
+		else if( GetTimeInSeconds()-follower->lastGrowth>=followIdleSeconds ) {
+			follower->idle = TRUE;
+			return 0;
+		}
+		WaitForDataFileChange(follower);
+	}
+}
+
+// Moves the end of the range of the iterator to the current end of its
+// file. A file of untagged blocks ends at its last whole block; a record
+// cut by the end of the file is left for later by ReadDataFileRecords. A
+// file whose writes are unordered ends at the last record of its index,
+// as the bytes after it may still be holes or padding. Returns 1 if the
+// file has grown.
+static int GrowDataFileBlockIterator(DataFileBlockIterator *iter)
+{
+	uInt64			size,indexed;
+#ifdef _WIN32
+	LARGE_INTEGER	fileSize;
+	HANDLE			mapping;
+
+	if( !GetFileSizeEx(iter->file,&fileSize) )
+		return 0;
+	size = fileSize.QuadPart;
+#else
+	struct stat		st;
+
+	if( fstat(iter->fd,&st) )
+		return 0;
+	size = st.st_size;
+#endif
+	if( iter->index ) {
+		indexed = GetIndexedDataFileSize(iter->index);
+		iter->unindexed = size>indexed;
+		if( size>indexed )
+			size = indexed;
+	}
+	if( !iter->info->blockRecords && size>iter->info->headerSize )
+		size -= (size-iter->info->headerSize)%iter->info->readBlockSizeInBytes;
+	if( size<=iter->fileSize )
+		return 0;
+#ifdef _WIN32
+	// A mapping only covers the size the file had when it was created
+	UnmapDataFileView(iter);
+	if( (mapping=CreateFileMappingA(iter->file,NULL,PAGE_READONLY,0,0,NULL))==NULL )
+		return 0;
+	CloseHandle(iter->mapping);
+	iter->mapping = mapping;
+#endif
+	iter->fileSize = size;
+	return 1;
+}
+
+// Returns after a write to the directory of the followed file, or after
+// followPollMilliseconds
+static void WaitForDataFileChange(DataFileFollower *follower)
+{
+#ifdef __linux__
+	struct pollfd	pollFd;
+	char			events[4096];
+
+	if( follower->inotifyFd>=0 ) {
+		pollFd.fd = follower->inotifyFd;
+		pollFd.events = POLLIN;
+		if( poll(&pollFd,1,(int)followPollMilliseconds)>0 )
+			while( read(follower->inotifyFd,events,sizeof(events))>0 );
+		return;
+	}
+#endif
+#ifdef _WIN32
+	Sleep(followPollMilliseconds);
+#else
+	usleep(followPollMilliseconds*1000);
+#endif
+}
+
+// Returns the size of a file, or 0 if it does not exist
+static uInt64 GetDataFileSize(const char filePath[])
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA	attributes;
+
+	if( !GetFileAttributesExA(filePath,GetFileExInfoStandard,&attributes) )
+		return 0;
+	return (uInt64)attributes.nFileSizeHigh<<32 | attributes.nFileSizeLow;
+#else
+	struct stat		st;
+
+	return stat(filePath,&st) ? 0 : (uInt64)st.st_size;
+#endif
+}
+
+static void StopFollowingDataFile(DataFileFollower *follower)
+{
+#ifdef __linux__
+	if( follower->inotifyFd>=0 )
+		close(follower->inotifyFd);
+	follower->inotifyFd = -1;
+#endif
+}
+
+/*********************************************/
+// Block Index
+/*********************************************/
+static int OpenDataFileIndex(DataFileInfo *info, const char filePath[], DataFileIndex *index)
+{
+	BlockIndexHeader	header;
+	char				*indexPath;
+	long				size;
+
+	memset(index,0,sizeof(DataFileIndex));
+	if( (indexPath=(char*)malloc(strlen(filePath)+5))==NULL )
+		return 0;
+	sprintf(indexPath,"%s.idx",filePath);
+	index->file = fopen(indexPath,"rb");
+	free(indexPath);
+	if( index->file==NULL )
+		return 0;
+	if( fread(&header,sizeof(header),1,index->file)!=1
+	 || memcmp(header.magic,BlockIndexMagic,sizeof(header.magic))
+	 || (header.version!=BlockIndexVersion && header.version!=1)
+	 || header.entryBytes!=(header.version==1?BlockIndexEntryBytesV1:sizeof(BlockIndexEntry))
+	 || header.dataHeaderSize!=info->headerSize
+	 || header.readBlockSizeInBytes!=info->readBlockSizeInBytes
+	 || header.readBlockSize!=info->readBlockSize
+	 || fseek(index->file,0,SEEK_END) || (size=ftell(index->file))<(long)sizeof(header) ) {
+		CloseDataFileIndex(index);
+		return 0;
+	}
+	index->numEntries = (size-sizeof(header))/header.entryBytes;
+	index->entryBytes = header.entryBytes;
+	index->readBlockSize = header.readBlockSize;
+	return index->numEntries>0;
+}
+
+static int ReadDataFileIndexEntry(DataFileIndex *index, uInt64 entryNum, BlockIndexEntry *entry)
+{
+	memset(entry,0,sizeof(BlockIndexEntry));
+	return entryNum<index->numEntries
+		&& fseek(index->file,(long)(sizeof(BlockIndexHeader)+entryNum*index->entryBytes),SEEK_SET)==0
+		&& fread(entry,index->entryBytes,1,index->file)==1;
+}
+
+// Reads the first entry of a task at or after entry entryNum, whose
+// number goes to found. Every entry of a file of one task is of task 0.
+// Returns 0 if the task has no block from there on.
+static int ReadTaskIndexEntry(DataFileIndex *index, uInt64 entryNum, uInt32 task, uInt64 *found, BlockIndexEntry *entry)
+{
+	for(;ReadDataFileIndexEntry(index,entryNum,entry);++entryNum)
+		if( entry->task==task ) {
+			*found = entryNum;
+			return 1;
+		}
+	return 0;
+}
+
+// Finds the last block of a task that starts at or before a sample. The
+// blocks of the other tasks between two entries of the task are skipped
+// on the way. Returns 0 if the first block of the task starts after it.
+static int FindTaskIndexEntry(DataFileIndex *index, uInt32 task, uInt64 sample, uInt64 *entryNum, BlockIndexEntry *entry)
+{
+	uInt64	low,high=index->numEntries-1,mid,found;
+
+	if( !ReadTaskIndexEntry(index,0,task,&low,entry) || entry->firstSample>sample )
+		return 0;
+	while( low<high ) {
+		mid = low + (high-low+1)/2;
+		if( ReadTaskIndexEntry(index,mid,task,&found,entry) && entry->firstSample<=sample )
+			low = found;
+		else
+			high = mid-1;
+	}
+	*entryNum = low;
+	return ReadDataFileIndexEntry(index,low,entry);
+}
+
+// Converts a time, in seconds after the host time origin, to a sample
+// number of a task whose blocks hold blockSize samples per channel. The
+// timestamp of a block is taken when its last sample has been acquired,
+// so the sample is interpolated between the ends of the blocks of the
+// task read just before and just after the time. Returns 0 if the time
+// is after the last block of the task.
+static int FindDataFileSampleAtTime(DataFileIndex *index, uInt32 task, uInt32 blockSize, uInt64 origin, float64 seconds, uInt64 *sample)
+{
+	BlockIndexEntry	before,after;
+	uInt64			low,high=index->numEntries-1,mid,found;
+	float64			target=seconds*1e9,t0,t1,value;
+
+	// Last block read at or before the time, or the first block
+	if( !ReadTaskIndexEntry(index,0,task,&low,&before) )
+		return 0;
+	while( low<high ) {
+		mid = low + (high-low+1)/2;
+		if( ReadTaskIndexEntry(index,mid,task,&found,&after) && (float64)(int64)(after.timestamp-origin)<=target )
+			low = found;
+		else
+			high = mid-1;
+	}
+	if( !ReadDataFileIndexEntry(index,low,&before) )
+		return 0;
+	t0 = (float64)(int64)(before.timestamp-origin);
+	// The last block of the task, or its only one
+	if( !ReadTaskIndexEntry(index,low+1,task,&found,&after) ) {
+		if( t0<target )
+			return 0;
+		*sample = t0>target ? before.firstSample : before.firstSample+blockSize;
+		return 1;
+	}
+	t1 = (float64)(int64)(after.timestamp-origin);
+	value = (float64)(before.firstSample+blockSize);
+	if( t1>t0 )
+		value += (target-t0)/(t1-t0)*(float64)(after.firstSample-before.firstSample);
+	*sample = value>0.0 ? (uInt64)value : 0;
+	return 1;
+}
+
+// Positions the iterator on the block that holds firstSample so the next
+// reads return numSamples samples from there. A range that starts in
+// blocks that were dropped during the acquisition moves to the next block
+// in the file, and one that runs into dropped blocks stops before them.
+// firstSample receives the first sample of the range.
+static int SeekDataFileSamples(DataFileBlockIterator *iter, DataFileIndex *index, uInt64 *firstSample, uInt64 numSamples)
+{
+	BlockIndexEntry	start,entry;
+	uInt64			low=0,high=index->numEntries-1,mid,blockNum,available;
+
+	// Last block that starts at or before the sample
+	while( low<high ) {
+		mid = low + (high-low+1)/2;
+		if( !ReadDataFileIndexEntry(index,mid,&entry) )
+			return 0;
+		if( entry.firstSample<=*firstSample )
+			low = mid;
+		else
+			high = mid-1;
+	}
+	blockNum = low;
+	if( !ReadDataFileIndexEntry(index,blockNum,&start) )
+		return 0;
+	if( *firstSample>=start.firstSample+index->readBlockSize && !ReadDataFileIndexEntry(index,++blockNum,&start) )
+		return 0;
+	if( *firstSample<start.firstSample ) {
+		numSamples = *firstSample+numSamples>start.firstSample ? *firstSample+numSamples-start.firstSample : 0;
+		*firstSample = start.firstSample;
+	}
+	// Last block of the contiguous run that begins with this one
+	low = blockNum;
+	high = index->numEntries-1;
+	while( low<high ) {
+		mid = low + (high-low+1)/2;
+		if( !ReadDataFileIndexEntry(index,mid,&entry) )
+			return 0;
+		if( entry.firstSample-start.firstSample==(mid-blockNum)*index->readBlockSize )
+			low = mid;
+		else
+			high = mid-1;
+	}
+	iter->skip = (uInt32)(*firstSample-start.firstSample);
+	available = (low-blockNum+1)*index->readBlockSize - iter->skip;
+	iter->remaining = numSamples<available ? numSamples : available;
+	iter->offset = start.byteOffset;
+	return iter->remaining>0;
+}
+
+// Sets the records of the segment of the index that hold the window of
+// each task. The window of a task is found from the times its own blocks
+// were read, in the first segment whose blocks reach its start and its
+// end, so tasks sampled at different rates cover the same time. Reading
+// starts at the first record of any window, and a record of a task is
+// trimmed to the samples of its window by their number. Returns 0 if the
+// segment holds no sample of any window.
+static int SeekDataFileRecords(DataFileBlockIterator *iter, DataFileIndex *index, uInt64 origin, RecordWindow windows[])
+{
+	DataFileInfo	*task;
+	RecordWindow	*window;
+	BlockIndexEntry	entry;
+	uInt64			entryNum,start=(uInt64)-1;
+	uInt32			t;
+
+	iter->windowEnd = 0;
+	for(t=0,task=iter->info;task;task=task->nextTask,++t) {
+		window = &windows[t];
+		window->startOffset = (uInt64)-1;
+		window->endOffset = 0;
+		if( !window->haveStart && FindDataFileSampleAtTime(index,t,task->readBlockSize,origin,rangeStartSeconds,&window->firstSample) )
+			window->haveStart = TRUE;
+		if( window->haveStart && !window->haveEnd
+		 && FindDataFileSampleAtTime(index,t,task->readBlockSize,origin,rangeStartSeconds+rangeDurationSeconds,&window->endSample) )
+			window->haveEnd = TRUE;
+		if( !window->haveStart || window->ended )
+			continue;
+		if( window->firstSample>=window->endSample ) {
+			window->ended = TRUE;
+			continue;
+		}
+		// Block of the first sample, or the first block of the task in the
+		// segment. A first sample that was dropped moves to the next block.
+		if( !FindTaskIndexEntry(index,t,window->firstSample,&entryNum,&entry) ) {
+			if( !ReadTaskIndexEntry(index,0,t,&entryNum,&entry) )
+				continue;
+			window->skip = 0;
+		}
+		else if( window->firstSample>=entry.firstSample+task->readBlockSize ) {
+			if( !ReadTaskIndexEntry(index,entryNum+1,t,&entryNum,&entry) )
+				continue;
+			window->skip = 0;
+		}
+		else
+			window->skip = (uInt32)(window->firstSample-entry.firstSample);
+		if( window->numSamples==0 )
+			window->firstSample = entry.firstSample + window->skip;
+		window->startOffset = entry.byteOffset;
+		// Block of the last sample. The window ends in this segment unless
+		// that is the last block of the task and it ends before the window.
+		if( window->haveEnd ) {
+			if( !FindTaskIndexEntry(index,t,window->endSample-1,&entryNum,&entry) || entry.byteOffset<window->startOffset ) {
+				window->startOffset = (uInt64)-1;
+				window->ended = TRUE;
+				continue;
+			}
+			window->endOffset = entry.byteOffset;
+			window->keep = window->endSample-entry.firstSample<task->readBlockSize ? (uInt32)(window->endSample-entry.firstSample) : task->readBlockSize;
+			window->ended = entry.firstSample+task->readBlockSize>=window->endSample || ReadTaskIndexEntry(index,entryNum+1,t,&entryNum,&entry);
+		}
+		else {
+			window->endOffset = (uInt64)-1;
+			window->keep = task->readBlockSize;
+		}
+		if( window->startOffset<start )
+			start = window->startOffset;
+		if( window->endOffset>iter->windowEnd )
+			iter->windowEnd = window->endOffset;
+	}
+	iter->windows = windows;
+	if( start==(uInt64)-1 )
+		return 0;
+	iter->offset = start;
+	return 1;
+}
+
+// Returns the end of the last record in the index, which is read again
+// as it grows. The writer only adds a record to the index of a file whose
+// writes are unordered once every byte up to its end is in the file.
+static uInt64 GetIndexedDataFileSize(DataFileIndex *index)
+{
+	BlockIndexEntry	entry;
+	long			size;
+
+	if( fseek(index->file,0,SEEK_END) || (size=ftell(index->file))<(long)sizeof(BlockIndexHeader) )
+		return 0;
+	index->numEntries = (size-sizeof(BlockIndexHeader))/index->entryBytes;
+	if( !ReadDataFileIndexEntry(index,index->numEntries-1,&entry) )
+		return 0;
+	return entry.byteOffset + entry.recordBytes;
+}
+
+static void CloseDataFileIndex(DataFileIndex *index)
+{
+	if( index->file )
+		fclose(index->file);
+	index->file = NULL;
+}
+
+// Segment N of a rotating stream has -N inserted before the extension of
+// the file name, as the Continuous Acquisition to File (Compacted)
+// example names them.
+static void MakeSegmentPath(char segmentPath[], const char filePath[], uInt32 number)
+{
+	const char	*dot=strrchr(filePath,'.');
+
+	if( dot==NULL || strchr(dot,'\\') || strchr(dot,'/') )
+		dot = filePath + strlen(filePath);
+	memcpy(segmentPath,filePath,dot-filePath);
+	sprintf(segmentPath+(dot-filePath),"-%05u%s",(unsigned)number,dot);
+}
+
+static int PlotScaledData(float64 *data[], uInt32 numChannels, uInt32 numSamples, float64 totals[])
+{
+	uInt32	iChan=0,iSamp=0;
+
+	if( numChannels<=0 || numSamples<=0 )
+		return 0;
+	// Plot your data here
+	for(;iChan<numChannels;++iChan)
+		for(iSamp=0;data[iChan]&&iSamp<numSamples;totals[iChan]+=data[iChan][iSamp++]);
+	return 1;
+}
+
+// Plots the samples of a task and counts them for its channels
+static void PlotTaskData(DataFileInfo *task, float64 *data[], uInt32 numSamples, float64 totals[], uInt64 counts[], OverviewBuilder *overview, NpyExporter *exporter)
+{
+	uInt32	iChan;
+
+	PlotScaledData(data+task->firstChannel,task->numberOfChannels,numSamples,totals+task->firstChannel);
+	if( overview )
+		AddOverviewData(overview,data,task->firstChannel,task->numberOfChannels,numSamples);
+	if( exporter )
+		ExportData(exporter,data,task->firstChannel,task->numberOfChannels,numSamples);
+	for(iChan=0;iChan<task->numberOfChannels;++iChan)
+		counts[task->firstChannel+iChan] += numSamples;
+}
+
+// Plots the min/max envelope of numSamples samples of a channel from its
+// overview points, the first of which starts skip samples before them.
+// The mean of each point weighs the samples of the plot it reduces.
+static void PlotOverviewData(const OverviewPoint points[], uInt64 numPoints, uInt32 decimation, uInt32 skip, uInt64 numSamples, float64 *total)
+{
+	uInt64	i,start,end;
+
+	// Plot your data here
+	for(i=0;i<numPoints;++i) {
+		start = i*decimation>skip ? i*decimation : skip;
+		end = (i+1)*decimation<skip+numSamples ? (i+1)*decimation : skip+numSamples;
+		if( end>start )
+			*total += (float64)points[i].mean*(end-start);
+	}
+}
+
+static bool32 IsDataPacked(DataFileInfo *info)
+{
+	return !(info->channels->compressionType==DAQmx_Val_None ||
+			(info->channels->compressionByteOrder==LittleEndian && info->channels->compressedSampleSizeInBits%8==0));
+}
+
+static int DecodeDataBlocks(DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[])
+{
+	if( info->selectedChannels )
+		return DecodeSelectedChannels(info,rawData,numBytes,data);
+	if( IsDataPacked(info) )
+		return DecodeDataWithPacking(info,rawData,numBytes,data);
+	return DecodeDataWithoutPacking(info,rawData,numBytes,data);
+}
+
+// Decodes a block that holds fewer samples than the blocks of its task as
+// the only block of a task of its size, so every decoder stops at its
+// last sample
+static int DecodeShortBlock(DataFileInfo *task, const uInt8 *rawData, uInt32 numSamples, float64 *data[])
+{
+	DataFileInfo	shortTask=*task;
+
+	shortTask.readBlockSize = numSamples;
+	shortTask.readBlockSizeInBytes = GetRawBlockBytes(task,numSamples);
+	shortTask.nextTask = NULL;
+	return DecodeDataBlocks(&shortTask,rawData,shortTask.readBlockSizeInBytes,data);
+}
+
+// Rebuilds the raw block of a task from a block delta encoded by the
+// Continuous Acquisition to File (Compacted) example, so it decodes like
+// any other block. Each channel holds a width byte, its first sample in
+// 4 little-endian bytes and the zigzag encoded differences between its
+// samples, packed MSB first at that width and padded to a byte. Returns
+// 0 if the block is corrupt.
+static int DecodeDeltaBlock(DataFileInfo *task, const uInt8 *src, uInt32 srcBytes, uInt32 numSamples, uInt32 *codes, uInt8 *raw)
+{
+	bool32		packed=IsDataPacked(task);
+	uInt32		bits=packed?task->channels->compressedSampleSizeInBits:task->channels->rawSampleSizeInBits;
+	uInt32		numChannels=task->numberOfChannels,numValues=numChannels*numSamples;
+	uInt32		mask=bits<32?(1u<<bits)-1:0xFFFFFFFF,iChan,iSamp,i,width,code,zigzag,accBits;
+	const uInt8	*end=src+srcBytes;
+	uInt64		acc;
+
+	if( bits<1 || bits>32 || (packed?((uInt64)numValues*bits+7)/8:(uInt64)numValues*(bits/8))>task->readBlockSizeInBytes )
+		return 0;
+	for(iChan=0;iChan<numChannels;++iChan) {
+		if( end-src<5 || (width=*src)>32 || (uInt64)(end-src)<5+((uInt64)(numSamples-1)*width+7)/8 )
+			return 0;
+		code = (src[1] | (uInt32)src[2]<<8 | (uInt32)src[3]<<16 | (uInt32)src[4]<<24) & mask;
+		src += 5;
+		codes[iChan] = code;
+		for(acc=0,accBits=0,iSamp=1;iSamp<numSamples;++iSamp) {
+			zigzag = 0;
+			if( width ) {
+				while( accBits<width ) {
+					acc = acc<<8 | *src++;
+					accBits += 8;
+				}
+				accBits -= width;
+				zigzag = (uInt32)(acc>>accBits) & (width<32?(1u<<width)-1:0xFFFFFFFF);
+			}
+			// Differences wrap at the sample width
+			code = (code + ((zigzag>>1) ^ (0u-(zigzag&1)))) & mask;
+			codes[iSamp*numChannels+iChan] = code;
+		}
+	}
+
+	// Store the codes the way the raw block does
+	memset(raw,0,task->readBlockSizeInBytes);
+	if( packed ) {
+		for(acc=0,accBits=0,i=0;i<numValues;++i) {
+			acc = acc<<bits | codes[i];
+			for(accBits+=bits;accBits>=8;accBits-=8)
+				*raw++ = (uInt8)(acc>>(accBits-8));
+		}
+		if( accBits )
+			*raw = (uInt8)(acc<<(8-accBits));
+	}
+	else
+		for(i=0;i<numValues;++i)
+			for(iSamp=0;iSamp<bits/8;++iSamp)
+				*raw++ = (uInt8)(codes[i]>>iSamp*8);
+	return 1;
+}
+
+/*********************************************/
+// Overview
+/*********************************************/
+// Starts the overview of a data file. Each channel is given room for as
+// many samples as the file would hold if all its blocks were of the task
+// of the channel, so the points of every level can be written as soon as
+// they are complete.
+static int CreateDataFileOverview(DataFileInfo *info, const char filePath[], uInt64 fileSize, OverviewBuilder *overview)
+{
+	OverviewHeader	*header=&overview->header;
+	DataFileInfo	*task;
+	uInt64			offset,*numBlocks=NULL,recordBytes;
+	uInt32			level,taskNum,i;
+	bool32			counted=FALSE;
+
+	memset(overview,0,sizeof(OverviewBuilder));
+	if( (overview->filePath=(char*)malloc(strlen(filePath)+5))==NULL )
+		return 0;
+	sprintf(overview->filePath,"%s.ovr",filePath);
+	overview->file = fopen(overview->filePath,"wb");
+	overview->numChannels = info->numberOfFileChannels;
+	overview->entries = (OverviewChannelEntry*)calloc(overview->numChannels,sizeof(OverviewChannelEntry));
+	overview->accumulators = (OverviewAccumulator*)calloc((size_t)overview->numChannels*OverviewLevels,sizeof(OverviewAccumulator));
+	if( overview->file==NULL || overview->entries==NULL || overview->accumulators==NULL )
+		goto Error;
+
+	// Encoded blocks and blocks of variable size are counted
+	if( (numBlocks=(uInt64*)calloc(info->numberOfTasks,sizeof(uInt64)))==NULL )
+		goto Error;
+	for(taskNum=0,task=info;task;task=task->nextTask,++taskNum) {
+		recordBytes = task->readBlockSizeInBytes + (info->taggedBlocks?BlockTagBytes:0) + (info->checksummedRecords?BlockChecksumBytes:0);
+		numBlocks[taskNum] = (fileSize-info->headerSize+recordBytes-1)/recordBytes;
+		counted |= task->encodedBlocks || task->variableBlocks;
+	}
+	if( counted && !CountDataFileBlocks(info,filePath,numBlocks) )
+		goto Error;
+
+	offset = sizeof(OverviewHeader) + (uInt64)overview->numChannels*sizeof(OverviewChannelEntry);
+	for(level=0;level<OverviewLevels;++level)
+		for(taskNum=0,task=info;task;task=task->nextTask,++taskNum)
+			for(i=0;i<task->numberOfChannels;++i) {
+				overview->entries[task->firstChannel+i].offset[level] = offset;
+				offset += (numBlocks[taskNum]*task->readBlockSize+overviewDecimation[level]-1)/overviewDecimation[level]*sizeof(OverviewPoint);
+			}
+	free(numBlocks);
+	numBlocks = NULL;
+
+	memcpy(header->magic,OverviewMagic,sizeof(header->magic));
+	header->version = OverviewVersion;
+	header->numLevels = OverviewLevels;
+	memcpy(header->decimation,overviewDecimation,sizeof(header->decimation));
+	header->numChannels = overview->numChannels;
+	header->dataHeaderSize = info->headerSize;
+	header->dataFileSize = fileSize;
+	return 1;
+
+Error:
+	free(numBlocks);
+	CloseDataFileOverview(overview,FALSE);
+	return 0;
+}
+
+// Counts the blocks of each task by walking the records of the file
+static int CountDataFileBlocks(DataFileInfo *info, const char filePath[], uInt64 numBlocks[])
+{
+	DataFileBlockIterator	iter;
+	DataFileInfo			*task;
+	const uInt8				*rawData,*block;
+	uInt32					numBytes,used,tag,blockBytes,blockSamples,maxRecordBytes=0;
+	int32					recordBytes=0;
+	uInt64					start;
+
+	if( !OpenDataFileBlockIterator(info,filePath,&iter) )
+		return 0;
+	memset(numBlocks,0,sizeof(uInt64)*info->numberOfTasks);
+	for(task=info;task;task=task->nextTask)
+		if( task->readBlockSizeInBytes+BlockTagBytes+BlockSampleCountBytes+BlockLengthBytes+BlockChecksumBytes>maxRecordBytes )
+			maxRecordBytes = task->readBlockSizeInBytes + BlockTagBytes + BlockSampleCountBytes + BlockLengthBytes + BlockChecksumBytes;
+	for(;;) {
+		start = iter.offset;
+		if( (rawData=MapDataFileBytes(&iter,(uInt64)blocksPerRead*maxRecordBytes,&numBytes))==NULL )
+			break;
+		for(used=0;(recordBytes=ParseBlockRecord(info,rawData+used,numBytes-used,&tag,&task,&block,&blockBytes,&blockSamples))>0;used+=recordBytes)
+			++numBlocks[tag];
+		if( recordBytes<0 || used==0 )
+			break;
+		iter.offset = start + used;
+	}
+	CloseDataFileBlockIterator(&iter);
+	// With checksums the reader searches past bytes left at the end for
+	// more records, which the counts would miss
+	return recordBytes>=0 && !(info->checksummedRecords && iter.offset<iter.fileSize);
+}
+
+// Reduces the samples of the channels into the first level. Its points are
+// reduced in turn into the coarser levels as they complete.
+static void AddOverviewData(OverviewBuilder *overview, float64 *data[], uInt32 firstChannel, uInt32 numChannels, uInt32 numSamples)
+{
+	OverviewAccumulator	*acc;
+	uInt32				iChan,iSamp,start,end;
+	float64				min,max,sum,value;
+
+	for(iChan=firstChannel;iChan<firstChannel+numChannels;++iChan) {
+		acc = &overview->accumulators[iChan*OverviewLevels];
+		for(iSamp=0;iSamp<numSamples;) {
+			// The samples up to the end of the current point
+			start = iSamp;
+			end = iSamp + overviewDecimation[0] - acc->count;
+			if( end>numSamples )
+				end = numSamples;
+			min = max = data[iChan][iSamp];
+			for(sum=0.0;iSamp<end;++iSamp) {
+				value = data[iChan][iSamp];
+				if( value<min )
+					min = value;
+				if( value>max )
+					max = value;
+				sum += value;
+			}
+			AccumulateOverviewPoint(overview,iChan,0,min,max,sum,end-start);
+		}
+		overview->entries[iChan].numSamples += numSamples;
+	}
+}
+
+static void AccumulateOverviewPoint(OverviewBuilder *overview, uInt32 iChan, uInt32 level, float64 min, float64 max, float64 sum, uInt32 count)
+{
+	OverviewAccumulator	*acc=&overview->accumulators[iChan*OverviewLevels+level];
+
+	if( acc->count==0 || min<acc->min )
+		acc->min = min;
+	if( acc->count==0 || max>acc->max )
+		acc->max = max;
+	acc->sum += sum;
+	acc->count += count;
+	if( acc->count==overviewDecimation[level] )
+		EmitOverviewPoint(overview,iChan,level);
+}
+
+// Completes the current point of a level and reduces it into the next one
+static void EmitOverviewPoint(OverviewBuilder *overview, uInt32 iChan, uInt32 level)
+{
+	OverviewAccumulator	*acc=&overview->accumulators[iChan*OverviewLevels+level];
+	OverviewPoint		*point=&acc->buffer[acc->numBuffered++];
+
+	point->min = (float32)acc->min;
+	point->max = (float32)acc->max;
+	point->mean = (float32)(acc->sum/acc->count);
+	if( acc->numBuffered==OverviewBufferPoints )
+		FlushOverviewPoints(overview,iChan,level);
+	if( level+1<OverviewLevels )
+		AccumulateOverviewPoint(overview,iChan,level+1,acc->min,acc->max,acc->sum,acc->count);
+	acc->sum = 0.0;
+	acc->count = 0;
+}
+
+static void FlushOverviewPoints(OverviewBuilder *overview, uInt32 iChan, uInt32 level)
+{
+	OverviewAccumulator	*acc=&overview->accumulators[iChan*OverviewLevels+level];
+
+	if( acc->numBuffered==0 )
+		return;
+	if( SeekFile(overview->file,overview->entries[iChan].offset[level]+acc->numWritten*sizeof(OverviewPoint))
+	 || fwrite(acc->buffer,sizeof(OverviewPoint),acc->numBuffered,overview->file)!=acc->numBuffered )
+		overview->failed = TRUE;
+	acc->numWritten += acc->numBuffered;
+	acc->numBuffered = 0;
+}
+
+// Completes the last points of every level, which reduce fewer samples,
+// and writes the channel entries and the header. An overview that is not
+// complete, or that was not entirely written, is removed instead.
+static void CloseDataFileOverview(OverviewBuilder *overview, bool32 complete)
+{
+	uInt32	iChan,level;
+
+	for(iChan=0;complete&&iChan<overview->numChannels;++iChan)
+		for(level=0;level<OverviewLevels;++level) {
+			if( overview->accumulators[iChan*OverviewLevels+level].count>0 )
+				EmitOverviewPoint(overview,iChan,level);
+			FlushOverviewPoints(overview,iChan,level);
+		}
+	if( complete && !overview->failed
+	 && (SeekFile(overview->file,sizeof(OverviewHeader))
+	  || fwrite(overview->entries,sizeof(OverviewChannelEntry),overview->numChannels,overview->file)!=overview->numChannels
+	  || SeekFile(overview->file,0)
+	  || fwrite(&overview->header,sizeof(OverviewHeader),1,overview->file)!=1) )
+		overview->failed = TRUE;
+	if( overview->file && fclose(overview->file) )
+		overview->failed = TRUE;
+	if( overview->filePath && (!complete || overview->failed) )
+		remove(overview->filePath);
+	free(overview->filePath);
+	free(overview->entries);
+	free(overview->accumulators);
+	memset(overview,0,sizeof(OverviewBuilder));
+}
+
+// Plots up to numSamples samples of every channel of the file from
+// firstSample on, from the coarsest overview level that still has
+// minPoints points over those of the first channel, without reading the
+// data file. Returns the number of samples of the first channel plotted,
+// or 0 if the overview is missing, was built from a different data file
+// or has fewer points than that even at level 0.
+static uInt64 ReadDataFileOverview(DataFileInfo *info, const char filePath[], uInt64 fileSize, uInt64 firstSample, uInt64 numSamples, uInt32 minPoints, float64 totals[], uInt64 counts[], uInt32 *decimation)
+{
+	OverviewHeader			header;
+	OverviewChannelEntry	*entries=NULL;
+	OverviewPoint			*points=NULL;
+	FILE					*file;
+	char					*overviewPath;
+	int64					size;
+	uInt64					firstPoint,numPoints,maxPoints=0,chanSamples,plotted=0;
+	uInt32					iChan,level;
+
+	if( (overviewPath=(char*)malloc(strlen(filePath)+5))==NULL )
+		return 0;
+	sprintf(overviewPath,"%s.ovr",filePath);
+	file = fopen(overviewPath,"rb");
+	free(overviewPath);
+	if( file==NULL )
+		return 0;
+	if( fread(&header,sizeof(header),1,file)!=1
+	 || memcmp(header.magic,OverviewMagic,sizeof(header.magic))
+	 || header.version!=OverviewVersion
+	 || header.numLevels!=OverviewLevels
+	 || memcmp(header.decimation,overviewDecimation,sizeof(header.decimation))
+	 || header.numChannels!=info->numberOfFileChannels
+	 || header.dataHeaderSize!=info->headerSize
+	 || header.dataFileSize!=fileSize
+	 || (entries=(OverviewChannelEntry*)malloc(sizeof(OverviewChannelEntry)*header.numChannels))==NULL
+	 || fread(entries,sizeof(OverviewChannelEntry),header.numChannels,file)!=header.numChannels
+	 || firstSample>=entries[0].numSamples
+	 || fseek(file,0,SEEK_END) || (size=TellFile(file))<0 )
+		goto Error;
+	if( numSamples>entries[0].numSamples-firstSample )
+		numSamples = entries[0].numSamples - firstSample;
+
+	// Nothing is plotted unless all the points over the samples can be read
+	for(level=OverviewLevels;level>0;--level) {
+		*decimation = overviewDecimation[level-1];
+		if( (firstSample+numSamples+*decimation-1) / *decimation - firstSample / *decimation>=minPoints )
+			break;
+	}
+	if( level--==0 )
+		goto Error;
+	// The channels of the other tasks of the file may hold fewer samples
+	firstPoint = firstSample / *decimation;
+	for(iChan=0;iChan<header.numChannels;++iChan) {
+		chanSamples = entries[iChan].numSamples>firstSample+numSamples ? numSamples : entries[iChan].numSamples>firstSample ? entries[iChan].numSamples-firstSample : 0;
+		numPoints = (firstSample+chanSamples+*decimation-1) / *decimation - firstPoint;
+		if( chanSamples>0 && entries[iChan].offset[level]+(firstPoint+numPoints)*sizeof(OverviewPoint)>(uInt64)size )
+			goto Error;
+		if( numPoints>maxPoints )
+			maxPoints = numPoints;
+	}
+	if( (points=(OverviewPoint*)malloc(sizeof(OverviewPoint)*(size_t)maxPoints))==NULL )
+		goto Error;
+	for(iChan=0;iChan<header.numChannels;++iChan) {
+		chanSamples = entries[iChan].numSamples>firstSample+numSamples ? numSamples : entries[iChan].numSamples>firstSample ? entries[iChan].numSamples-firstSample : 0;
+		if( chanSamples==0 )
+			continue;
+		numPoints = (firstSample+chanSamples+*decimation-1) / *decimation - firstPoint;
+		if( SeekFile(file,entries[iChan].offset[level]+firstPoint*sizeof(OverviewPoint))
+		 || fread(points,sizeof(OverviewPoint),(size_t)numPoints,file)!=numPoints )
+			goto Error;
+		PlotOverviewData(points,numPoints,*decimation,(uInt32)(firstSample-firstPoint * *decimation),chanSamples,&totals[iChan]);
+		counts[iChan] += chanSamples;
+	}
+	plotted = numSamples;
+
+Error:
+	fclose(file);
+	free(entries);
+	free(points);
+	return plotted;
+}
+
+/*********************************************/
+// NumPy Export
+/*********************************************/
+// Creates the .npy files of the decoded channels, whose buffers are the
+// ones allocated in data. Their shape is written when they are closed.
+static int OpenNpyExporter(NpyExporter *exporter, DataFileInfo *info, const char directory[], float64 *data[])
+{
+	char	filePath[1024];
+	uInt32	iChan;
+
+	memset(exporter,0,sizeof(NpyExporter));
+	exporter->numChannels = info->numberOfFileChannels;
+	exporter->singleArray = exportSingleArray;
+	if( strlen(directory)>=sizeof(filePath)-32
+	 || (exporter->files=(FILE**)calloc(exporter->numChannels,sizeof(FILE*)))==NULL
+	 || (exporter->numSamples=(uInt64*)calloc(exporter->numChannels,sizeof(uInt64)))==NULL
+	 || (exporter->columns=(uInt32*)malloc(sizeof(uInt32)*exporter->numChannels))==NULL )
+		goto Error;
+	for(iChan=0;iChan<exporter->numChannels;++iChan)
+		if( data[iChan] )
+			exporter->columns[exporter->numColumns++] = iChan;
+
+	if( exporter->singleArray ) {
+		sprintf(filePath,"%s/data.npy",directory);
+		if( (exporter->files[0]=fopen(filePath,"wb"))==NULL || !WriteNpyHeader(exporter->files[0],0,exporter->numColumns) )
+			goto Error;
+	}
+	else
+		for(iChan=0;iChan<exporter->numChannels;++iChan) {
+			if( data[iChan]==NULL )
+				continue;
+			sprintf(filePath,"%s/channel%u.npy",directory,(unsigned)iChan);
+			if( (exporter->files[iChan]=fopen(filePath,"wb"))==NULL || !WriteNpyHeader(exporter->files[iChan],0,0) )
+				goto Error;
+		}
+	return 1;
+
+Error:
+	exporter->failed = TRUE;
+	CloseNpyExporter(exporter);
+	return 0;
+}
+
+// Writes a version 1.0 .npy header of NpyHeaderBytes at the start of the
+// file. A numColumns of 0 makes a 1-D array.
+static int WriteNpyHeader(FILE *file, uInt64 numRows, uInt32 numColumns)
+{
+	static const uInt16	one=1;
+	char				header[NpyHeaderBytes],dict[NpyHeaderBytes];
+	char				byteOrder=*(const uInt8*)&one?'<':'>';
+	int					length;
+
+	if( numColumns )
+		length = sprintf(dict,"{'descr': '%cf%u', 'fortran_order': False, 'shape': (%llu, %u), }",byteOrder,exportFloat32?4u:8u,(unsigned long long)numRows,(unsigned)numColumns);
+	else
+		length = sprintf(dict,"{'descr': '%cf%u', 'fortran_order': False, 'shape': (%llu,), }",byteOrder,exportFloat32?4u:8u,(unsigned long long)numRows);
+	if( length>NpyHeaderBytes-11 )
+		return 0;
+	// Magic string, version 1.0, then the length of the padded dictionary
+	memcpy(header,"\x93NUMPY\x01\x00",8);
+	header[8] = (char)((NpyHeaderBytes-10)&0xFF);
+	header[9] = (char)((NpyHeaderBytes-10)>>8);
+	memset(header+10,' ',NpyHeaderBytes-10);
+	memcpy(header+10,dict,length);
+	header[NpyHeaderBytes-1] = '\n';
+	return fseek(file,0,SEEK_SET)==0 && fwrite(header,1,NpyHeaderBytes,file)==NpyHeaderBytes;
+}
+
+// Appends the samples of the channels to their files. float64 samples of
+// a file per channel are written straight from the decode buffers.
+static void ExportData(NpyExporter *exporter, float64 *data[], uInt32 firstChannel, uInt32 numChannels, uInt32 numSamples)
+{
+	uInt32	iChan,iCol,iSamp,elementBytes=exportFloat32?sizeof(float32):sizeof(float64),numValues;
+	float32	*f32=(float32*)exporter->buffer;
+	float64	*f64=(float64*)exporter->buffer;
+	FILE	*file;
+
+	if( exporter->failed || numSamples==0 )
+		return;
+	numValues = exporter->singleArray ? numSamples*exporter->numColumns : numSamples;
+	if( (exporter->singleArray || exportFloat32) && numValues>exporter->bufferSamples ) {
+		free(exporter->buffer);
+		if( (exporter->buffer=malloc((size_t)numValues*elementBytes))==NULL ) {
+			exporter->bufferSamples = 0;
+			exporter->failed = TRUE;
+			return;
+		}
+		exporter->bufferSamples = numValues;
+		f32 = (float32*)exporter->buffer;
+		f64 = (float64*)exporter->buffer;
+	}
+
+	if( exporter->singleArray ) {
+		for(iCol=0;iCol<exporter->numColumns;++iCol) {
+			const float64	*src=data[exporter->columns[iCol]];
+
+			if( exportFloat32 )
+				for(iSamp=0;iSamp<numSamples;++iSamp)
+					f32[(size_t)iSamp*exporter->numColumns+iCol] = (float32)src[iSamp];
+			else
+				for(iSamp=0;iSamp<numSamples;++iSamp)
+					f64[(size_t)iSamp*exporter->numColumns+iCol] = src[iSamp];
+		}
+		if( fwrite(exporter->buffer,elementBytes,numValues,exporter->files[0])!=numValues )
+			exporter->failed = TRUE;
+		exporter->numSamples[0] += numSamples;
+		return;
+	}
+	for(iChan=firstChannel;iChan<firstChannel+numChannels;++iChan) {
+		if( (file=exporter->files[iChan])==NULL )
+			continue;
+		if( exportFloat32 ) {
+			for(iSamp=0;iSamp<numSamples;++iSamp)
+				f32[iSamp] = (float32)data[iChan][iSamp];
+			if( fwrite(f32,sizeof(float32),numSamples,file)!=numSamples )
+				exporter->failed = TRUE;
+		}
+		else if( fwrite(data[iChan],sizeof(float64),numSamples,file)!=numSamples )
+			exporter->failed = TRUE;
+		exporter->numSamples[iChan] += numSamples;
+	}
+}
+
+// Writes the final shape of every file and closes them. Returns 0 if any
+// write failed.
+static int CloseNpyExporter(NpyExporter *exporter)
+{
+	uInt32	iChan;
+
+	for(iChan=0;exporter->files&&iChan<exporter->numChannels;++iChan) {
+		if( exporter->files[iChan]==NULL )
+			continue;
+		if( !exporter->failed
+		 && !WriteNpyHeader(exporter->files[iChan],exporter->numSamples[iChan],exporter->singleArray?exporter->numColumns:0) )
+			exporter->failed = TRUE;
+		if( fclose(exporter->files[iChan]) )
+			exporter->failed = TRUE;
+	}
+	free(exporter->files);
+	free(exporter->numSamples);
+	free(exporter->columns);
+	free(exporter->buffer);
+	exporter->files = NULL;
+	exporter->numSamples = NULL;
+	exporter->columns = NULL;
+	exporter->buffer = NULL;
+	exporter->bufferSamples = 0;
+	return !exporter->failed;
+}
+
+/*********************************************/
+// Scaling
+/*********************************************/
+// For raw codes of 16 bits or fewer, tabulates the scaled value of every
+// code of each channel. Channels with the same sample format and
+// coefficients share one table, so the tables of a file with thousands of
+// identical channels stay in the cache. They are found through a hash of
+// the format and coefficients. The tables of the file, counted in
+// tableBytes, stop at scalingTableMegabytes.
+static int BuildScalingTables(DataFileInfo *info, uInt64 *tableBytes)
+{
+	bool32		packed=IsDataPacked(info);
+	ChannelInfo	*chan,*other,*end=info->channels+info->numberOfChannels,**owners;
+	uInt32		codeBits,code,numSlots,slot;
+
+	// Open addressing over the channels that own a table
+	for(numSlots=1;numSlots<2*info->numberOfChannels;numSlots<<=1);
+	if( (owners=(ChannelInfo**)calloc(numSlots,sizeof(ChannelInfo*)))==NULL )
+		return 0;
+	for(chan=info->channels;chan<end;++chan) {
+		codeBits = packed ? chan->compressedSampleSizeInBits : chan->rawSampleSizeInBits;
+		if( codeBits<1 || codeBits>16 )
+			continue;
+		for(slot=HashChannelScaling(chan)&(numSlots-1);(other=owners[slot])!=NULL&&!IsSameChannelScaling(chan,other);slot=(slot+1)&(numSlots-1));
+		if( other ) {
+			chan->scalingTable = other->scalingTable;
+			continue;
+		}
+		if( *tableBytes+(sizeof(float64)<<codeBits)>(uInt64)scalingTableMegabytes*1048576 )
+			continue;
+		if( (chan->scalingTable=(float64*)malloc(sizeof(float64)<<codeBits))==NULL ) {
+			free(owners);
+			return 0;
+		}
+		chan->ownsScalingTable = TRUE;
+		*tableBytes += sizeof(float64)<<codeBits;
+		owners[slot] = chan;
+		for(code=0;code<1u<<codeBits;++code)
+			chan->scalingTable[code] = EvaluateScalingPolynomial(chan,ExpandRawCode(chan,code,packed));
+	}
+	free(owners);
+	return 1;
+}
+
+static uInt32 HashChannelScaling(const ChannelInfo *chan)
+{
+	uInt32	format[6];
+
+	format[0] = chan->rawSampleResolution;
+	format[1] = chan->rawSampleSizeInBits;
+	format[2] = chan->rawSampleJustification;
+	format[3] = (uInt32)chan->signedNumber;
+	format[4] = chan->compressedSampleSizeInBits;
+	format[5] = chan->numScalingCoeffs;
+	return ComputeCrc32c(ComputeCrc32c(0,(const uInt8*)format,sizeof(format)),(const uInt8*)chan->scalingCoeffs,sizeof(float64)*chan->numScalingCoeffs);
+}
+
+static bool32 IsSameChannelScaling(const ChannelInfo *chan, const ChannelInfo *other)
+{
+	return other->rawSampleResolution==chan->rawSampleResolution
+		&& other->rawSampleSizeInBits==chan->rawSampleSizeInBits
+		&& other->rawSampleJustification==chan->rawSampleJustification
+		&& other->signedNumber==chan->signedNumber
+		&& other->compressedSampleSizeInBits==chan->compressedSampleSizeInBits
+		&& other->numScalingCoeffs==chan->numScalingCoeffs
+		&& memcmp(other->scalingCoeffs,chan->scalingCoeffs,sizeof(float64)*chan->numScalingCoeffs)==0;
+}
+
+// Turns a code read from the file into the raw sample value. Packed codes
+// get their removed low bits back before the sign is extended.
+static int32 ExpandRawCode(ChannelInfo *chan, uInt32 code, bool32 packed)
+{
+	uInt32	size=chan->rawSampleSizeInBits,lsb=0;
+	int32	val;
+
+	if( packed ) {
+		lsb = (chan->rawSampleJustification==DAQmx_Val_LeftJustified?chan->rawSampleSizeInBits:chan->rawSampleResolution) - chan->compressedSampleSizeInBits;
+		size = chan->compressedSampleSizeInBits + lsb;
+	}
+	val = (int32)(code << lsb);
+	// Extend sign if needed
+	if( chan->signedNumber && size<32 && val&(1u<<(size-1)) )
+		val |= 0xFFFFFFFF << size;
+	return val;
+}
+
+// Horner evaluation of the flattened scaling polynomial
+static float64 EvaluateScalingPolynomial(ChannelInfo *chan, int32 val)
+{
+	const float64	*coeff=chan->scalingCoeffs+chan->numScalingCoeffs;
+	float64			scaled=0.0;
+
+	while( coeff>chan->scalingCoeffs )
+		scaled = scaled*val + *--coeff;
+	return scaled;
+}
+
+/*********************************************/
+// Parallel Block Decoding
+/*********************************************/
+static DecodeThreadPool *CreateDecodeThreadPool(uInt32 numThreads)
+{
+	DecodeThreadPool	*pool;
+	uInt32				i;
+
+	if( numThreads==0 ) {
+#ifdef _WIN32
+		SYSTEM_INFO	sysInfo;
+
+		GetSystemInfo(&sysInfo);
+		numThreads = sysInfo.dwNumberOfProcessors;
+#else
+		long		numProcessors=sysconf(_SC_NPROCESSORS_ONLN);
+
+		numThreads = numProcessors>0 ? (uInt32)numProcessors : 1;
+#endif
+	}
+	if( numThreads<2 || (pool=(DecodeThreadPool*)calloc(1,sizeof(DecodeThreadPool)))==NULL )
+		return NULL;
+	if( (pool->jobs=(DecodeJob*)calloc(numThreads,sizeof(DecodeJob)))==NULL
+	 || (pool->threads=(DecodeThread*)calloc(numThreads,sizeof(DecodeThread)))==NULL ) {
+		free(pool->jobs);
+		free(pool);
+		return NULL;
+	}
+	DecodeMutexInit(&pool->lock);
+	DecodeCondInit(&pool->start);
+	DecodeCondInit(&pool->done);
+	for(i=0;i<numThreads;++i) {
+		pool->jobs[i].pool = pool;
+		if( !DecodeThreadCreate(&pool->threads[i],DecodeWorkerThread,&pool->jobs[i]) )
+			break;
+		++pool->numThreads;
+	}
+	if( pool->numThreads<2 ) {
+		DestroyDecodeThreadPool(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+static void DestroyDecodeThreadPool(DecodeThreadPool *pool)
+{
+	uInt32	i;
+
+	if( pool==NULL )
+		return;
+	DecodeMutexLock(&pool->lock);
+	pool->quit = 1;
+	DecodeCondBroadcast(&pool->start);
+	DecodeMutexUnlock(&pool->lock);
+	for(i=0;i<pool->numThreads;++i)
+		DecodeThreadJoin(pool->threads[i]);
+	for(i=0;pool->jobs&&i<pool->numThreads;++i)
+		free(pool->jobs[i].data);
+	DecodeCondDestroy(&pool->start);
+	DecodeCondDestroy(&pool->done);
+	DecodeMutexDestroy(&pool->lock);
+	free(pool->threads);
+	free(pool->jobs);
+	free(pool);
+}
+
+static DecodeThreadResult DecodeThreadCall DecodeWorkerThread(void *arg)
+{
+	DecodeJob			*job=(DecodeJob*)arg;
+	DecodeThreadPool	*pool=job->pool;
+	uInt32				generation=0;
+
+	DecodeMutexLock(&pool->lock);
+	for(;;) {
+		while( pool->generation==generation && !pool->quit )
+			DecodeCondWait(&pool->start,&pool->lock);
+		if( pool->quit )
+			break;
+		generation = pool->generation;
+		DecodeMutexUnlock(&pool->lock);
+
+		job->numSamples = job->numBytes ? DecodeDataBlocks(job->info,job->rawData,job->numBytes,job->data) : 0;
+
+		DecodeMutexLock(&pool->lock);
+		if( --pool->pending==0 )
+			DecodeCondSignal(&pool->done);
+	}
+	DecodeMutexUnlock(&pool->lock);
+	return 0;
+}
+
+// Blocks are self-contained, so each worker decodes a contiguous run of
+// them straight into the output at the offset of its first block.
+static int DecodeDataBlocksParallel(DecodeThreadPool *pool, DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[])
+{
+	uInt32		numBlocks=(numBytes+info->readBlockSizeInBytes-1)/info->readBlockSizeInBytes;
+	uInt32		blocksPerThread=(numBlocks+pool->numThreads-1)/pool->numThreads,firstBlock,iThread,iChan;
+	int			numSamples=0;
+	DecodeJob	*job;
+
+	for(iThread=0;iThread<pool->numThreads;++iThread) {
+		job = &pool->jobs[iThread];
+		job->info = info;
+		job->numBytes = 0;
+		job->firstBlock = firstBlock = iThread*blocksPerThread;
+		if( firstBlock>=numBlocks )
+			continue;
+		job->rawData = rawData + (size_t)firstBlock*info->readBlockSizeInBytes;
+		job->numBytes = numBytes - firstBlock*info->readBlockSizeInBytes;
+		if( job->numBytes>blocksPerThread*info->readBlockSizeInBytes )
+			job->numBytes = blocksPerThread*info->readBlockSizeInBytes;
+		if( job->dataCapacity<info->numberOfChannels ) {
+			free(job->data);
+			if( (job->data=(float64**)malloc(sizeof(float64*)*info->numberOfChannels))==NULL ) {
+				job->dataCapacity = 0;
+				job->numBytes = 0;
+				continue;
+			}
+			job->dataCapacity = info->numberOfChannels;
+		}
+		for(iChan=0;iChan<info->numberOfChannels;++iChan)
+			job->data[iChan] = data[iChan] ? data[iChan]+(size_t)firstBlock*info->readBlockSize : NULL;
+	}
+
+	DecodeMutexLock(&pool->lock);
+	pool->pending = pool->numThreads;
+	++pool->generation;
+	DecodeCondBroadcast(&pool->start);
+	while( pool->pending )
+		DecodeCondWait(&pool->done,&pool->lock);
+	DecodeMutexUnlock(&pool->lock);
+
+	// Samples are contiguous up to the first run that came up short
+	for(iThread=0;iThread<pool->numThreads&&pool->jobs[iThread].numBytes;++iThread) {
+		job = &pool->jobs[iThread];
+		numSamples = job->firstBlock*info->readBlockSize + job->numSamples;
+		if( (uInt32)job->numSamples<blocksPerThread*info->readBlockSize )
+			break;
+	}
+	return numSamples;
+}
+
+// Decodes the blocks a channel at a time, each with the kernel chosen for
+// its sample format when the header was parsed
+static int DecodeDataWithoutPacking(DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[])
+{
+	uInt32		numSamples=0,iChan,blockBytes,blockSamples,sampleBytes=info->sampleBits/8,offset;
+	ChannelInfo	*chan;
+
+	if( sampleBytes==0 )
+		return 0;
+	// For each block of data
+	while( numBytes ) {
+		blockBytes = numBytes<info->readBlockSizeInBytes?numBytes:info->readBlockSizeInBytes;
+		blockSamples = blockBytes/sampleBytes;
+		if( blockSamples>info->readBlockSize )
+			blockSamples = info->readBlockSize;
+
+		// For each channel
+		for(chan=info->channels,offset=0,iChan=0;iChan<info->numberOfChannels;offset+=chan->rawSampleSizeInBits/8,++chan,++iChan)
+			chan->decode(chan,rawData+offset,sampleBytes,blockSamples,data[iChan]+numSamples);
+		numSamples += blockSamples;
+		rawData += blockBytes;
+		numBytes -= blockBytes;
+		if( blockBytes<info->readBlockSizeInBytes )
+			break;
+	}
+
+	return numSamples;
+}
+
+// Reference decoder that reads and scales one sample of one channel at a
+// time, whatever its format. Used as the benchmark baseline.
+static int DecodeDataWithoutPackingPerSample(DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[])
+{
+	uInt32	numSamples=0,iSamp,iChan,iByte;
+
+	// For each block of data
+	while( numBytes ) {
+		// For each sample
+		for(iSamp=0;iSamp<info->readBlockSize;++iSamp) {
+			ChannelInfo	*chan=info->channels;
+
+			// For each channel
+			for(iChan=0;iChan<info->numberOfChannels;++iChan,++chan) {
+				uInt32			bytes,code=0;
+
+				bytes = chan->rawSampleSizeInBits / 8;
+
+				// Read the bytes
+				if( chan->compressionByteOrder==LittleEndian )
+					for(iByte=0;iByte<bytes&&numBytes;++iByte,--numBytes)
+						code |= (uInt32)*rawData++ << iByte * 8;
+				else
+					for(iByte=0;iByte<bytes&&numBytes;++iByte,--numBytes)
+						code = (code<<8) | *rawData++;
+
+				// Scale
+				if( chan->scalingTable )
+					data[iChan][numSamples] = chan->scalingTable[code];
+				else
+					data[iChan][numSamples] = EvaluateScalingPolynomial(chan,ExpandRawCode(chan,code,FALSE));
+			}
+			++numSamples;
+		}
+	}
+
+	return numSamples;
+}
+
+// Decodes only the selected channels of the blocks. Each sample of a
+// selected channel is read at the bit offset of the channel in the sample
+// of all channels, so the other channels are neither unpacked nor scaled.
+static int DecodeSelectedChannels(DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[])
+{
+	bool32		packed=IsDataPacked(info);
+	uInt32		numSamples=0,iSamp,iSel,iChan,iByte,blockBytes,blockSamples,size,spanBytes,code;
+	uInt64		bitPos,acc;
+	const uInt8	*src;
+	ChannelInfo	*chan;
+
+	if( info->sampleBits==0 )
+		return 0;
+	// For each block of data
+	while( numBytes ) {
+		blockBytes = numBytes<info->readBlockSizeInBytes?numBytes:info->readBlockSizeInBytes;
+		blockSamples = (uInt32)((uInt64)blockBytes*8/info->sampleBits);
+		if( blockSamples>info->readBlockSize )
+			blockSamples = info->readBlockSize;
+
+		// For each selected channel
+		for(iSel=0;iSel<info->numSelectedChannels;++iSel) {
+			iChan = info->selectedChannels[iSel];
+			chan = &info->channels[iChan];
+			size = packed ? chan->compressedSampleSizeInBits : chan->rawSampleSizeInBits;
+			bitPos = info->channelBitOffsets[iChan];
+
+			// For each sample
+			for(iSamp=0;iSamp<blockSamples;++iSamp,bitPos+=info->sampleBits) {
+				src = rawData + bitPos/8;
+				code = 0;
+				if( packed ) {
+					// Read the bytes the sample spans MSB first
+					spanBytes = (uInt32)(bitPos%8+size+7) / 8;
+					for(acc=0,iByte=0;iByte<spanBytes;++iByte)
+						acc = acc<<8 | src[iByte];
+					code = (uInt32)(acc>>(spanBytes*8-bitPos%8-size)) & (size<32?(1u<<size)-1:0xFFFFFFFF);
+				}
+				else if( chan->compressionByteOrder==LittleEndian )
+					for(iByte=0;iByte<size/8;++iByte)
+						code |= (uInt32)src[iByte] << iByte*8;
+				else
+					for(iByte=0;iByte<size/8;++iByte)
+						code = (code<<8) | src[iByte];
+
+				// Scale
+				if( chan->scalingTable )
+					data[iChan][numSamples+iSamp] = chan->scalingTable[code];
+				else
+					data[iChan][numSamples+iSamp] = EvaluateScalingPolynomial(chan,ExpandRawCode(chan,code,packed));
+			}
+		}
+		numSamples += blockSamples;
+		rawData += blockBytes;
+		numBytes -= blockBytes;
+		if( blockBytes<info->readBlockSizeInBytes )
+			break;
+	}
+
+	return numSamples;
+}
+
+static int DecodeDataWithPacking(DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[])
+{
+	uInt32			numSamples=0,iSamp,iChan,bits,blockValues,blockBytes,numValues,*codes=NULL,*code;
+	UnpackBitsFunc	unpack;
+	ChannelInfo		*chan;
+
+	// The block kernels need every channel packed on the same stride
+	bits = info->channels->compressedSampleSizeInBits;
+	for(iChan=1;iChan<info->numberOfChannels;++iChan)
+		if( info->channels[iChan].compressedSampleSizeInBits!=bits )
+			return DecodeDataWithPackingBitSerial(info,rawData,numBytes,data);
+	if( bits<1 || bits>32 )
+		return 0;
+	blockValues = info->readBlockSize*info->numberOfChannels;
+	if( (codes=(uInt32*)malloc(sizeof(uInt32)*blockValues))==NULL )
+		return 0;
+	unpack = SelectUnpackKernel(bits,NULL);
+
+	// For each block of data
+	while( numBytes ) {
+		blockBytes = numBytes<info->readBlockSizeInBytes?numBytes:info->readBlockSizeInBytes;
+		numValues = (uInt32)((uInt64)blockBytes*8/bits);
+		if( numValues>blockValues )
+			numValues = blockValues;
+		// Only keep whole samples of a truncated block
+		numValues -= numValues%info->numberOfChannels;
+		unpack(rawData,blockBytes,bits,numValues,codes);
+		rawData += blockBytes;
+		numBytes -= blockBytes;
+
+		// For each sample
+		for(code=codes,iSamp=0;iSamp<numValues/info->numberOfChannels;++iSamp) {
+			chan = info->channels;
+
+			// For each channel
+			for(iChan=0;iChan<info->numberOfChannels;++iChan,++chan,++code) {
+				// Scale
+				if( chan->scalingTable )
+					data[iChan][numSamples] = chan->scalingTable[*code];
+				else
+					data[iChan][numSamples] = EvaluateScalingPolynomial(chan,ExpandRawCode(chan,*code,TRUE));
+			}
+			++numSamples;
+		}
+		if( blockBytes<info->readBlockSizeInBytes )
+			break;
+	}
+
+	free(codes);
+	return numSamples;
+}
+
+// Reference decoder that pulls one bit at a time. Used for channels
+// with mixed compressed sample sizes and as the benchmark baseline.
+static int DecodeDataWithPackingBitSerial(DataFileInfo *info, const uInt8 *rawData, uInt32 numBytes, float64 *data[])
+{
+	uInt32	numSamples=0,iSamp,iChan;
+	int32	val;
+
+	// For each block of data
+	while( numBytes ) {
+		int		bitPos=0;
+		uInt32	ch=*rawData++,byteCount=1;
+
+		--numBytes;
+		// For each sample
+		for(iSamp=0;iSamp<info->readBlockSize;++iSamp) {
+			ChannelInfo	*chan=info->channels;
+
+			// For each channel
+			for(iChan=0;iChan<info->numberOfChannels;++iChan,++chan) {
+				uInt32			size,lsb,realsize,signmask,extendmask,bitCount=0,iCoeff;
+				double			polynom=1.0;
+
+				size = chan->compressedSampleSizeInBits;
+				lsb = (chan->rawSampleJustification==DAQmx_Val_LeftJustified?chan->rawSampleSizeInBits:chan->rawSampleResolution) - size;
+				realsize = size + lsb;
+				signmask = 1u << (realsize-1);
+				extendmask = realsize<32 ? 0xFFFFFFFF << realsize : 0;
+				val = 0;
+
+				while( bitCount<size ) {
+					// Shift left
+					val <<= 1;
+
+					// Add in the next bit
+					val += (ch >> (8-bitPos-1)) & 1;
+					// Get next byte if necessary
+					++bitCount;
+					++bitPos;
+					if( bitPos==8 && byteCount<info->readBlockSizeInBytes ) {
+						bitPos = 0;
+						if( numBytes==0 )
+							goto Error;
+						else {
+							ch = *rawData++;
+							--numBytes;
+							++byteCount;
+						}
+					}
+				}
+
+				// Scale back in the lost bits
+				val <<= lsb;
+
+				// Extend sign if needed
+				if( chan->signedNumber && realsize<32 && val&signmask )
+					val |= extendmask;
+
+				// Scale
+				for(data[iChan][numSamples]=0.0,iCoeff=0;iCoeff<chan->numScalingCoeffs;++iCoeff,polynom*=val)
+					data[iChan][numSamples] += chan->scalingCoeffs[iCoeff] * polynom;
+			}
+			++numSamples;
+		}
+	}
+
+Error:
+	return numSamples;
+}
+
+/*********************************************/
+// Channel Decode Kernels
+/*********************************************/
+// The bytes of each sample are read with the size and byte order fixed at
+// compile time, so the loops unroll and lose their branches
+#define LOAD_UNPACKED_CODE(src,bytes,bigEndian,code) \
+	for(code=0,iByte=0;iByte<(bytes);++iByte) \
+		code |= (uInt32)(src)[iByte] << ((bigEndian)?(bytes)-1-iByte:iByte)*8;
+
+// Codes of 16 bits or fewer look their scaled value up in the table
+#define DEFINE_DECODE_CHANNEL_TABLE(name,bytes,bigEndian) \
+	static void DecodeChannel##name(ChannelInfo *chan, const uInt8 *src, uInt32 stride, uInt32 numSamples, float64 *dst) \
+	{ \
+		const float64	*table=chan->scalingTable; \
+		uInt32			iSamp,iByte,code; \
+		for(iSamp=0;iSamp<numSamples;++iSamp,src+=stride) { \
+			LOAD_UNPACKED_CODE(src,bytes,bigEndian,code) \
+			dst[iSamp] = table[code]; \
+		} \
+	}
+
+// Wider codes are sign extended by shifting their sign bit to bit 31 and back
+#define DEFINE_DECODE_CHANNEL_POLYNOMIAL(name,bytes,bigEndian,signShift) \
+	static void DecodeChannel##name(ChannelInfo *chan, const uInt8 *src, uInt32 stride, uInt32 numSamples, float64 *dst) \
+	{ \
+		uInt32	iSamp,iByte,code; \
+		for(iSamp=0;iSamp<numSamples;++iSamp,src+=stride) { \
+			LOAD_UNPACKED_CODE(src,bytes,bigEndian,code) \
+			dst[iSamp] = EvaluateScalingPolynomial(chan,(int32)(code<<(signShift))>>(signShift)); \
+		} \
+	}
+
+DEFINE_DECODE_CHANNEL_TABLE(Table8,1,FALSE)
+DEFINE_DECODE_CHANNEL_TABLE(Table16LE,2,FALSE)
+DEFINE_DECODE_CHANNEL_TABLE(Table16BE,2,TRUE)
+DEFINE_DECODE_CHANNEL_POLYNOMIAL(Signed24LE,3,FALSE,8)
+DEFINE_DECODE_CHANNEL_POLYNOMIAL(Signed24BE,3,TRUE,8)
+DEFINE_DECODE_CHANNEL_POLYNOMIAL(Unsigned24LE,3,FALSE,0)
+DEFINE_DECODE_CHANNEL_POLYNOMIAL(Unsigned24BE,3,TRUE,0)
+DEFINE_DECODE_CHANNEL_POLYNOMIAL(Word32LE,4,FALSE,0)
+DEFINE_DECODE_CHANNEL_POLYNOMIAL(Word32BE,4,TRUE,0)
+
+static void DecodeChannelGeneric(ChannelInfo *chan, const uInt8 *src, uInt32 stride, uInt32 numSamples, float64 *dst)
+{
+	uInt32	iSamp,iByte,code,bytes=chan->rawSampleSizeInBits/8;
+
+	for(iSamp=0;iSamp<numSamples;++iSamp,src+=stride) {
+		LOAD_UNPACKED_CODE(src,bytes,chan->compressionByteOrder==BigEndian,code)
+		if( chan->scalingTable )
+			dst[iSamp] = chan->scalingTable[code];
+		else
+			dst[iSamp] = EvaluateScalingPolynomial(chan,ExpandRawCode(chan,code,FALSE));
+	}
+}
+
+#ifdef HAVE_X86_UNPACK_KERNELS
+// Signed 16-bit samples are widened to doubles 4 at a time and scaled by
+// the polynomial in every lane, rather than looked up one by one in a
+// table of 512 KB. The multiply and add are kept apart so every lane
+// rounds like EvaluateScalingPolynomial.
+__attribute__((target("avx2")))
+static void DecodeChannelSigned16LEAVX2(ChannelInfo *chan, const uInt8 *src, uInt32 stride, uInt32 numSamples, float64 *dst)
+{
+	const float64	*coeff,*first=chan->scalingCoeffs,*last=chan->scalingCoeffs+chan->numScalingCoeffs;
+	__m128i			codes;
+	__m256d			val,scaled;
+	uInt32			iSamp=0;
+
+	for(;iSamp+4<=numSamples;iSamp+=4,src+=4*stride) {
+		// Channels of a task with one channel are contiguous
+		if( stride==2 )
+			codes = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)src));
+		else
+			codes = _mm_setr_epi32((int16)(src[0]|src[1]<<8),(int16)(src[stride]|src[stride+1]<<8),
+								   (int16)(src[2*stride]|src[2*stride+1]<<8),(int16)(src[3*stride]|src[3*stride+1]<<8));
+		val = _mm256_cvtepi32_pd(codes);
+		for(scaled=_mm256_setzero_pd(),coeff=last;coeff>first;)
+			scaled = _mm256_add_pd(_mm256_mul_pd(scaled,val),_mm256_broadcast_sd(--coeff));
+		_mm256_storeu_pd(dst+iSamp,scaled);
+	}
+	for(;iSamp<numSamples;++iSamp,src+=stride)
+		dst[iSamp] = EvaluateScalingPolynomial(chan,(int16)(src[0]|src[1]<<8));
+}
+#endif
+
+static DecodeChannelFunc SelectDecodeChannelKernel(ChannelInfo *chan, const char **name)
+{
+	const char			*kernelName="Scalar";
+	DecodeChannelFunc	kernel=DecodeChannelGeneric;
+	bool32				bigEndian=chan->compressionByteOrder==BigEndian;
+
+	switch( chan->rawSampleSizeInBits ) {
+		case 8:
+			if( chan->scalingTable )
+				kernel = DecodeChannelTable8;
+			break;
+		case 16:
+			if( chan->scalingTable )
+				kernel = bigEndian ? DecodeChannelTable16BE : DecodeChannelTable16LE;
+			break;
+		case 24:
+			if( chan->signedNumber )
+				kernel = bigEndian ? DecodeChannelSigned24BE : DecodeChannelSigned24LE;
+			else
+				kernel = bigEndian ? DecodeChannelUnsigned24BE : DecodeChannelUnsigned24LE;
+			break;
+		case 32:
+			kernel = bigEndian ? DecodeChannelWord32BE : DecodeChannelWord32LE;
+			break;
+	}
+#ifdef HAVE_X86_UNPACK_KERNELS
+	__builtin_cpu_init();
+	if( chan->rawSampleSizeInBits==16 && !bigEndian && chan->signedNumber && __builtin_cpu_supports("avx2") ) {
+		kernel = DecodeChannelSigned16LEAVX2;
+		kernelName = "AVX2";
+	}
+#endif
+	if( name )
+		*name = kernelName;
+	return kernel;
+}
+
+/*********************************************/
+// Unpack Kernels
+/*********************************************/
+// Big-endian load of the 8 bytes at src, zero filled past the end of the block
+static uInt64 LoadBitWindow(const uInt8 *src, uInt64 avail)
+{
+	uInt64	window=0;
+	uInt32	i;
+
+	if( avail>=8 )
+		return (uInt64)src[0]<<56 | (uInt64)src[1]<<48 | (uInt64)src[2]<<40 | (uInt64)src[3]<<32
+			 | (uInt64)src[4]<<24 | (uInt64)src[5]<<16 | (uInt64)src[6]<<8 | (uInt64)src[7];
+	for(i=0;i<8;++i)
+		window = window<<8 | (i<avail?src[i]:0);
+	return window;
+}
+
+// Every value of up to 32 bits lies within the 64-bit window starting at its first byte
+#define UNPACK_BITS_SCALAR_BODY(width,first) \
+	uInt32	iVal=(first),mask=0xFFFFFFFF>>(32-(width)); \
+	uInt64	pos=(uInt64)iVal*(width); \
+	for(;iVal<numValues;++iVal,pos+=(width)) \
+		dst[iVal] = (uInt32)(LoadBitWindow(src+(pos>>3),srcBytes-(pos>>3))>>(64-(width)-(pos&7))) & mask;
+
+// The width of these kernels is fixed, so bits is the same as width
+#define DEFINE_UNPACK_BITS_SCALAR(width) \
+	static void UnpackBitsScalar##width(const uInt8 *src, uInt32 srcBytes, uInt32 bits, uInt32 numValues, uInt32 *dst) \
+	{ \
+		(void)bits; \
+		UNPACK_BITS_SCALAR_BODY(width,0) \
+	}
+
+DEFINE_UNPACK_BITS_SCALAR(8)
+DEFINE_UNPACK_BITS_SCALAR(12)
+DEFINE_UNPACK_BITS_SCALAR(14)
+DEFINE_UNPACK_BITS_SCALAR(16)
+DEFINE_UNPACK_BITS_SCALAR(18)
+DEFINE_UNPACK_BITS_SCALAR(20)
+DEFINE_UNPACK_BITS_SCALAR(24)
+DEFINE_UNPACK_BITS_SCALAR(32)
+
+static void UnpackBitsScalarGeneric(const uInt8 *src, uInt32 srcBytes, uInt32 bits, uInt32 numValues, uInt32 *dst)
+{
+	UNPACK_BITS_SCALAR_BODY(bits,0)
+}
+
+#ifdef HAVE_X86_UNPACK_KERNELS
+// Eight consecutive values always start on a byte boundary, so the byte
+// shuffle and the shift of each lane only depend on the bit width. Each
+// 128-bit lane gathers 4 values as big-endian 32-bit words from a 16 byte
+// load; the second lane starts at the byte holding the fifth value.
+typedef struct {
+	uInt8	shuffle[2][16];
+	uInt32	multiplier[8];
+	uInt32	shift[8];
+	uInt32	laneOffset;
+} UnpackGroupLayout;
+
+static void BuildUnpackGroupLayout(uInt32 bits, UnpackGroupLayout *layout)
+{
+	uInt32	i,j,pos,rel;
+
+	layout->laneOffset = 4*bits/8;
+	for(i=0;i<8;++i) {
+		pos = i*bits;
+		rel = pos/8 - (i<4?0:layout->laneOffset);
+		for(j=0;j<4;++j)
+			layout->shuffle[i/4][(i%4)*4+j] = (uInt8)(rel+3-j);
+		layout->multiplier[i] = 1u << (pos%8);
+		layout->shift[i] = pos%8;
+	}
+}
+
+__attribute__((target("sse4.1")))
+static void UnpackBitsSSE41(const uInt8 *src, uInt32 srcBytes, uInt32 bits, uInt32 numValues, uInt32 *dst)
+{
+	UnpackGroupLayout	layout;
+	__m128i				shuffle0,shuffle1,mult0,mult1,count;
+	uInt32				i=0;
+
+	BuildUnpackGroupLayout(bits,&layout);
+	shuffle0 = _mm_loadu_si128((const __m128i*)layout.shuffle[0]);
+	shuffle1 = _mm_loadu_si128((const __m128i*)layout.shuffle[1]);
+	mult0 = _mm_loadu_si128((const __m128i*)&layout.multiplier[0]);
+	mult1 = _mm_loadu_si128((const __m128i*)&layout.multiplier[4]);
+	count = _mm_cvtsi32_si128(32-bits);
+	// Left align each value with a multiply, then shift its top bits down
+	for(;i+8<=numValues && (uInt64)i*bits/8+layout.laneOffset+16<=srcBytes;i+=8) {
+		const uInt8	*group=src+(uInt64)i*bits/8;
+		__m128i		lo=_mm_loadu_si128((const __m128i*)group);
+		__m128i		hi=_mm_loadu_si128((const __m128i*)(group+layout.laneOffset));
+
+		lo = _mm_srl_epi32(_mm_mullo_epi32(_mm_shuffle_epi8(lo,shuffle0),mult0),count);
+		hi = _mm_srl_epi32(_mm_mullo_epi32(_mm_shuffle_epi8(hi,shuffle1),mult1),count);
+		_mm_storeu_si128((__m128i*)(dst+i),lo);
+		_mm_storeu_si128((__m128i*)(dst+i+4),hi);
+	}
+	{
+		UNPACK_BITS_SCALAR_BODY(bits,i)
+	}
+}
+
+__attribute__((target("avx2")))
+static void UnpackBitsAVX2(const uInt8 *src, uInt32 srcBytes, uInt32 bits, uInt32 numValues, uInt32 *dst)
+{
+	UnpackGroupLayout	layout;
+	__m256i				shuffle,shift;
+	__m128i				count;
+	uInt32				i=0;
+
+	BuildUnpackGroupLayout(bits,&layout);
+	shuffle = _mm256_loadu_si256((const __m256i*)layout.shuffle);
+	shift = _mm256_loadu_si256((const __m256i*)layout.shift);
+	count = _mm_cvtsi32_si128(32-bits);
+	for(;i+8<=numValues && (uInt64)i*bits/8+layout.laneOffset+16<=srcBytes;i+=8) {
+		const uInt8	*group=src+(uInt64)i*bits/8;
+		__m256i		words=_mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)group)),
+													_mm_loadu_si128((const __m128i*)(group+layout.laneOffset)),1);
+
+		words = _mm256_srl_epi32(_mm256_sllv_epi32(_mm256_shuffle_epi8(words,shuffle),shift),count);
+		_mm256_storeu_si256((__m256i*)(dst+i),words);
+	}
+	{
+		UNPACK_BITS_SCALAR_BODY(bits,i)
+	}
+}
+#endif
+
+static UnpackBitsFunc SelectUnpackKernel(uInt32 bits, const char **name)
+{
+	const char		*kernelName="Scalar";
+	UnpackBitsFunc	kernel=UnpackBitsScalarGeneric;
+
+	switch( bits ) {
+		case 8:  kernel = UnpackBitsScalar8;  break;
+		case 12: kernel = UnpackBitsScalar12; break;
+		case 14: kernel = UnpackBitsScalar14; break;
+		case 16: kernel = UnpackBitsScalar16; break;
+		case 18: kernel = UnpackBitsScalar18; break;
+		case 20: kernel = UnpackBitsScalar20; break;
+		case 24: kernel = UnpackBitsScalar24; break;
+		case 32: kernel = UnpackBitsScalar32; break;
+	}
+#ifdef HAVE_X86_UNPACK_KERNELS
+	// A value plus its bit offset within its first byte must fit a 32-bit lane
+	__builtin_cpu_init();
+	if( bits<=25 && __builtin_cpu_supports("avx2") ) {
+		kernel = UnpackBitsAVX2;
+		kernelName = "AVX2";
+	}
+	else if( bits<=25 && __builtin_cpu_supports("sse4.1") ) {
+		kernel = UnpackBitsSSE41;
+		kernelName = "SSE4.1";
+	}
+#endif
+	if( name )
+		*name = kernelName;
+	return kernel;
+}
+
+// Times both packed decoders on each mapped run of blocks of the file
+static void BenchmarkPackedDecode(DataFileInfo *info, const char filePath[], float64 *data[], uInt32 maxSamples, DecodeThreadPool *pool)
+{
+	DataFileBlockIterator	iter;
+	const uInt8				*rawData;
+	uInt32					run,numBytes,numValues,bits=info->channels->compressedSampleSizeInBits;
+	uInt32					*codes;
+	uInt64					numSamples=0,totalValues=0;
+	const char				*kernelName;
+	UnpackBitsFunc			unpack=SelectUnpackKernel(bits,&kernelName);
+	double					start,bitSerial=0.0,kernel=0.0,unpackOnly=0.0,parallel=0.0;
+
+	if( bits<1 || bits>32 || (codes=(uInt32*)malloc(sizeof(uInt32)*maxSamples*info->numberOfChannels))==NULL )
+		return;
+	if( !OpenDataFileBlockIterator(info,filePath,&iter) ) {
+		free(codes);
+		return;
+	}
+	while( (rawData=MapNextDataFileBlocks(&iter,maxSamples,&numBytes))!=NULL ) {
+		start = GetTimeInSeconds();
+		for(run=0;run<benchmarkIterations;++run)
+			DecodeDataWithPackingBitSerial(info,rawData,numBytes,data);
+		bitSerial += GetTimeInSeconds()-start;
+		start = GetTimeInSeconds();
+		for(run=0;run<benchmarkIterations;++run)
+			numSamples += DecodeDataWithPacking(info,rawData,numBytes,data);
+		kernel += GetTimeInSeconds()-start;
+		if( pool ) {
+			start = GetTimeInSeconds();
+			for(run=0;run<benchmarkIterations;++run)
+				DecodeDataBlocksParallel(pool,info,rawData,numBytes,data);
+			parallel += GetTimeInSeconds()-start;
+		}
+
+		// Time the unpack step alone on the mapped blocks
+		numValues = (uInt32)((uInt64)numBytes*8/bits);
+		if( numValues>maxSamples*info->numberOfChannels )
+			numValues = maxSamples*info->numberOfChannels;
+		start = GetTimeInSeconds();
+		for(run=0;run<benchmarkIterations;++run)
+			unpack(rawData,numBytes,bits,numValues,codes);
+		unpackOnly += GetTimeInSeconds()-start;
+		totalValues += (uInt64)numValues*benchmarkIterations;
+	}
+	CloseDataFileBlockIterator(&iter);
+	free(codes);
+
+	numSamples *= info->numberOfChannels;
+	printf("Benchmark (%u-bit, %u iterations):\n",(unsigned)bits,(unsigned)benchmarkIterations);
+	printf("  Bit-serial decode:\t%.3e samples/s\n",numSamples/bitSerial);
+	printf("  %s kernel decode:\t%.3e samples/s (%.1fx)\n",kernelName,numSamples/kernel,bitSerial/kernel);
+	printf("  %s kernel unpack:\t%.3e samples/s\n",kernelName,totalValues/unpackOnly);
+	if( pool )
+		printf("  %s kernel decode, %u threads:\t%.3e samples/s (%.1fx)\n",kernelName,(unsigned)pool->numThreads,numSamples/parallel,bitSerial/parallel);
+}
+
+// Times the per-sample reference decoder against the kernels of the
+// channels on each mapped run of blocks of the file
+static void BenchmarkUnpackedDecode(DataFileInfo *info, const char filePath[], float64 *data[], uInt32 maxSamples, DecodeThreadPool *pool)
+{
+	DataFileBlockIterator	iter;
+	const uInt8				*rawData;
+	uInt32					run,numBytes;
+	uInt64					numSamples=0;
+	const char				*kernelName;
+	double					start,perSample=0.0,kernel=0.0,parallel=0.0;
+
+	SelectDecodeChannelKernel(info->channels,&kernelName);
+	if( !OpenDataFileBlockIterator(info,filePath,&iter) )
+		return;
+	while( (rawData=MapNextDataFileBlocks(&iter,maxSamples,&numBytes))!=NULL ) {
+		start = GetTimeInSeconds();
+		for(run=0;run<benchmarkIterations;++run)
+			DecodeDataWithoutPackingPerSample(info,rawData,numBytes,data);
+		perSample += GetTimeInSeconds()-start;
+		start = GetTimeInSeconds();
+		for(run=0;run<benchmarkIterations;++run)
+			numSamples += DecodeDataWithoutPacking(info,rawData,numBytes,data);
+		kernel += GetTimeInSeconds()-start;
+		if( pool ) {
+			start = GetTimeInSeconds();
+			for(run=0;run<benchmarkIterations;++run)
+				DecodeDataBlocksParallel(pool,info,rawData,numBytes,data);
+			parallel += GetTimeInSeconds()-start;
+		}
+	}
+	CloseDataFileBlockIterator(&iter);
+
+	numSamples *= info->numberOfChannels;
+	printf("Benchmark (%u-bit unpacked, %u channels, %u iterations):\n",(unsigned)info->channels->rawSampleSizeInBits,(unsigned)info->numberOfChannels,(unsigned)benchmarkIterations);
+	printf("  Per-sample decode:\t%.3e samples/s\n",numSamples/perSample);
+	printf("  %s kernel decode:\t%.3e samples/s (%.1fx)\n",kernelName,numSamples/kernel,perSample/kernel);
+	if( pool )
+		printf("  %s kernel decode, %u threads:\t%.3e samples/s (%.1fx)\n",kernelName,(unsigned)pool->numThreads,numSamples/parallel,perSample/parallel);
+}
+
+// Times the scaling step alone on the codes of the first channel: the
+// power series of the bit-serial decoder against the table or the Horner
+// polynomial.
+static void BenchmarkScaling(DataFileInfo *info, uInt32 numSamples)
+{
+	ChannelInfo	*chan=info->channels;
+	bool32		packed=IsDataPacked(info);
+	uInt32		run,iSamp,iCoeff,*codes,codeBits=packed?chan->compressedSampleSizeInBits:chan->rawSampleSizeInBits,seed=1;
+	float64		*scaled,start,powerSeries,flattened;
+
+	if( codeBits<1 || codeBits>32 || (codes=(uInt32*)malloc(sizeof(uInt32)*numSamples))==NULL )
+		return;
+	if( (scaled=(float64*)malloc(sizeof(float64)*numSamples))==NULL ) {
+		free(codes);
+		return;
+	}
+	for(iSamp=0;iSamp<numSamples;++iSamp)
+		codes[iSamp] = (seed=seed*1664525+1013904223) >> (32-codeBits);
+
+	start = GetTimeInSeconds();
+	for(run=0;run<benchmarkIterations;++run)
+		for(iSamp=0;iSamp<numSamples;++iSamp) {
+			int32	val=ExpandRawCode(chan,codes[iSamp],packed);
+			double	polynom=1.0;
+
+			for(scaled[iSamp]=0.0,iCoeff=0;iCoeff<chan->numScalingCoeffs;++iCoeff,polynom*=val)
+				scaled[iSamp] += chan->scalingCoeffs[iCoeff] * polynom;
+		}
+	powerSeries = GetTimeInSeconds()-start;
+	start = GetTimeInSeconds();
+	for(run=0;run<benchmarkIterations;++run)
+		for(iSamp=0;iSamp<numSamples;++iSamp)
+			if( chan->scalingTable )
+				scaled[iSamp] = chan->scalingTable[codes[iSamp]];
+			else
+				scaled[iSamp] = EvaluateScalingPolynomial(chan,ExpandRawCode(chan,codes[iSamp],packed));
+	flattened = GetTimeInSeconds()-start;
+	free(scaled);
+	free(codes);
+
+	printf("Scaling benchmark (%u-bit codes, %u coefficients):\n",(unsigned)codeBits,(unsigned)chan->numScalingCoeffs);
+	printf("  Power series:\t%.3e samples/s\n",(double)numSamples*benchmarkIterations/powerSeries);
+	printf("  %s:\t%.3e samples/s (%.1fx)\n",chan->scalingTable?"Scaling table":"Horner",(double)numSamples*benchmarkIterations/flattened,powerSeries/flattened);
+}
+
+/*********************************************/
+// Benchmark Suite
+/*********************************************/
+// Writes a synthetic data file for each compression type, compressed
+// sample size from 8 to 32 bits, byte order, justification and number of
+// channels, one at a time, and times the decoders on it. Each decoder run
+// is written to benchmark.json as one JSON object, so successive runs of
+// the suite can be compared.
+static int RunBenchmarkSuite(const char directory[])
+{
+	static const uInt32	compressionTypes[]={DAQmx_Val_None,DAQmx_Val_LosslessPacking,DAQmx_Val_LossyLSBRemoval};
+	BenchmarkFormat		format;
+	DecodeThreadPool	*pool=NULL;
+	FILE				*results;
+	char				filePath[1024],resultsPath[1024];
+	uInt32				iType,bits,order,justification,iCount,numRuns=0;
+	int					success=0;
+
+	if( strlen(directory)>=sizeof(filePath)-16 )
+		return 0;
+	sprintf(filePath,"%s/benchmark.cfg",directory);
+	sprintf(resultsPath,"%s/benchmark.json",directory);
+	if( (results=fopen(resultsPath,"w"))==NULL )
+		return 0;
+	if( numDecodeThreads!=1 )
+		pool = CreateDecodeThreadPool(numDecodeThreads);
+	fputs("[",results);
+	for(iType=0;iType<sizeof(compressionTypes)/sizeof(compressionTypes[0]);++iType)
+		for(bits=8;bits<=32;++bits)
+			for(order=0;order<2;++order)
+				for(justification=0;justification<2;++justification) {
+					if( !MakeBenchmarkFormat(compressionTypes[iType],bits,order?BigEndian:LittleEndian,justification?DAQmx_Val_LeftJustified:DAQmx_Val_RightJustified,&format) )
+						continue;
+					// Packed samples are stored MSB first and whole samples ignore
+					// the justification, so those variants would repeat a file
+					if( IsBenchmarkFormatPacked(&format) ? order && bits%8 : justification )
+						continue;
+					for(iCount=0;iCount<sizeof(benchmarkSuiteChannels)/sizeof(benchmarkSuiteChannels[0]);++iCount)
+						if( !WriteBenchmarkFile(filePath,&format,benchmarkSuiteChannels[iCount])
+						 || !BenchmarkDecodeFile(filePath,&format,pool,results,&numRuns) )
+							goto Error;
+				}
+	success = 1;
+
+Error:
+	fputs("\n]\n",results);
+	fclose(results);
+	remove(filePath);
+	DestroyDecodeThreadPool(pool);
+	if( success )
+		printf("Benchmark suite: %u decoder runs written to %s\n",(unsigned)numRuns,resultsPath);
+	return success;
+}
+
+// Picks the raw format a device with that compression and compressed
+// sample size would have. Returns FALSE if there is none.
+static bool32 MakeBenchmarkFormat(uInt32 compressionType, uInt32 bits, ByteOrder byteOrder, uInt32 justification, BenchmarkFormat *format)
+{
+	format->compressionType = compressionType;
+	format->compressedSampleSizeInBits = bits;
+	format->byteOrder = byteOrder;
+	format->justification = justification;
+	switch( compressionType ) {
+		case DAQmx_Val_LosslessPacking:
+			format->resolution = bits;
+			format->rawSampleSizeInBits = bits<=8 ? 8 : bits<=16 ? 16 : 32;
+			// Whole-byte codes narrower than the raw sample are always packed
+			if( byteOrder==LittleEndian && bits%8==0 && bits!=format->rawSampleSizeInBits )
+				return FALSE;
+			break;
+		case DAQmx_Val_LossyLSBRemoval:
+			// At least one bit of the resolution is removed
+			if( bits>=32 )
+				return FALSE;
+			format->resolution = format->rawSampleSizeInBits = bits<16 ? 16 : 32;
+			break;
+		default:
+			if( bits%8 )
+				return FALSE;
+			format->resolution = format->rawSampleSizeInBits = bits;
+			break;
+	}
+	return TRUE;
+}
+
+// Same rule as IsDataPacked
+static bool32 IsBenchmarkFormatPacked(const BenchmarkFormat *format)
+{
+	return !(format->compressionType==DAQmx_Val_None ||
+			(format->byteOrder==LittleEndian && format->compressedSampleSizeInBits%8==0));
+}
+
+// Writes a version 1.0.0 data file of benchmarkSuiteBlocks blocks of
+// random codes, laid out the way the decoders expect them.
+static int WriteBenchmarkFile(const char filePath[], const BenchmarkFormat *format, uInt32 numChannels)
+{
+	FILE	*f;
+	bool32	packed=IsBenchmarkFormatPacked(format);
+	uInt32	readBlockSize,numValues,blockBytes,codeBits,mask,code,seed=1,iBlock,iVal,iByte,iChan,accBits;
+	uInt64	acc;
+	uInt8	*block,*dst;
+	long	headerSize,sizeOffset;
+
+	readBlockSize = benchmarkSuiteBlockValues/numChannels;
+	if( readBlockSize==0 )
+		readBlockSize = 1;
+	numValues = readBlockSize*numChannels;
+	codeBits = packed ? format->compressedSampleSizeInBits : format->rawSampleSizeInBits;
+	mask = codeBits<32 ? (1u<<codeBits)-1 : 0xFFFFFFFF;
+	blockBytes = (uInt32)(((uInt64)numValues*codeBits+7)/8);
+	if( (block=(uInt8*)malloc(blockBytes))==NULL )
+		return 0;
+	if( (f=fopen(filePath,"wb"))==NULL ) {
+		free(block);
+		return 0;
+	}
+
+	// The header size is patched in once the header is written
+	fputs("[DAQCompressedBinaryFile]\nVersion=1.0.0\nHeaderSize=",f);
+	sizeOffset = ftell(f);
+	fprintf(f,"%010d\nNumberOfTasks=1\n",0);
+	fprintf(f,"[Task0]\nName=BenchmarkTask\nNumberOfChannels=%u\nReadBlockSize=%u\nReadBlockSizeInBytes=%u\n",(unsigned)numChannels,(unsigned)readBlockSize,(unsigned)blockBytes);
+	for(iChan=0;iChan<numChannels;++iChan) {
+		fprintf(f,"[Task0Channel%u]\nName=Benchmark/ai%u\n",(unsigned)iChan,(unsigned)iChan);
+		fprintf(f,"RawSampleResolution=%u\nRawSampleSizeInBits=%u\n",(unsigned)format->resolution,(unsigned)format->rawSampleSizeInBits);
+		fprintf(f,"RawSampleJustification=%s\nSignedNumber=TRUE\n",format->justification==DAQmx_Val_LeftJustified?"Left":"Right");
+		fprintf(f,"CompressionType=%s\n",format->compressionType==DAQmx_Val_LosslessPacking?"LosslessPacking":format->compressionType==DAQmx_Val_LossyLSBRemoval?"LossyLSBRemoval":"None");
+		fprintf(f,"CompressedSampleSizeInBits=%u\n",(unsigned)format->compressedSampleSizeInBits);
+		fprintf(f,"CompressionByteOrder=%s\n",format->byteOrder==LittleEndian?"LittleEndian":"BigEndian");
+		// Four coefficients like the device scaling, for a +/-10 V range
+		fprintf(f,"PolynomialScalingCoeffs=%0.15lE;%0.15lE;%0.15lE;%0.15lE;\n",0.0,10.0/(2.0*(1u<<(format->resolution-2))),0.0,0.0);
+	}
+	fputs("[BinaryData]\nBegin=Here\n",f);
+	headerSize = ftell(f);
+	fseek(f,sizeOffset,SEEK_SET);
+	fprintf(f,"%010d",(int)headerSize);
+	fseek(f,headerSize,SEEK_SET);
+
+	for(iBlock=0;iBlock<benchmarkSuiteBlocks;++iBlock) {
+		// Packed codes are stored MSB first, whole samples in their byte order
+		for(dst=block,acc=0,accBits=0,iVal=0;iVal<numValues;++iVal) {
+			seed = seed*1664525 + 1013904223;
+			code = seed & mask;
+			if( packed ) {
+				acc = acc<<codeBits | code;
+				for(accBits+=codeBits;accBits>=8;accBits-=8)
+					*dst++ = (uInt8)(acc>>(accBits-8));
+			}
+			else if( format->byteOrder==LittleEndian )
+				for(iByte=0;iByte<codeBits/8;++iByte)
+					*dst++ = (uInt8)(code>>iByte*8);
+			else
+				for(iByte=codeBits/8;iByte>0;--iByte)
+					*dst++ = (uInt8)(code>>(iByte-1)*8);
+		}
+		if( accBits )
+			*dst = (uInt8)(acc<<(8-accBits));
+		if( fwrite(block,1,blockBytes,f)!=blockBytes )
+			break;
+	}
+	free(block);
+	if( fclose(f) || iBlock<benchmarkSuiteBlocks )
+		return 0;
+	return 1;
+}
+
+// Decodes the file with the decoder it selects on the main thread, then
+// on the decode threads, keeping the fastest of benchmarkIterations
+// passes of each.
+static int BenchmarkDecodeFile(const char filePath[], const BenchmarkFormat *format, DecodeThreadPool *pool, FILE *results, uInt32 *numRuns)
+{
+	DataFileInfo			*info;
+	DataFileBlockIterator	iter;
+	float64					**data=NULL;
+	uInt32					maxSamples,iChan=0,pass,numPasses=benchmarkIterations?benchmarkIterations:1,path;
+	uInt64					numSamples=0,dataBytes=0;
+	int						numRead,success=0;
+	double					start,seconds,best=0.0;
+	const char				*decoder;
+
+	if( (info=ParseDataFileHeader(filePath))==NULL )
+		return 0;
+	maxSamples = info->readBlockSize*blocksPerRead;
+	if( (data=(float64**)calloc(info->numberOfChannels,sizeof(float64*)))==NULL )
+		goto Error;
+	for(;iChan<info->numberOfChannels;++iChan)
+		if( (data[iChan]=(float64*)malloc(sizeof(float64)*maxSamples))==NULL )
+			goto Error;
+	if( IsDataPacked(info) )
+		SelectUnpackKernel(info->channels->compressedSampleSizeInBits,&decoder);
+	else
+		SelectDecodeChannelKernel(info->channels,&decoder);
+
+	for(path=0;path<(pool?2u:1u);++path) {
+		ResetPeakMemoryUsage();
+		for(pass=0;pass<numPasses;++pass) {
+			if( !OpenDataFileBlockIterator(info,filePath,&iter) )
+				goto Error;
+			iter.pool = path ? pool : NULL;
+			dataBytes = iter.fileSize - info->headerSize;
+			numSamples = 0;
+			start = GetTimeInSeconds();
+			while( (numRead=ReadNextDataFileBlocks(&iter,data,maxSamples))>0 )
+				numSamples += numRead;
+			seconds = GetTimeInSeconds() - start;
+			CloseDataFileBlockIterator(&iter);
+			if( pass==0 || seconds<best )
+				best = seconds;
+		}
+		if( numSamples!=(uInt64)info->readBlockSize*benchmarkSuiteBlocks )
+			goto Error;
+		numSamples *= info->numberOfChannels;
+		if( best<=0.0 )
+			best = 1e-9;
+		fprintf(results,"%s\n\t{\"compressionType\":\"%s\",\"resolution\":%u,\"rawSampleSizeInBits\":%u,\"compressedSampleSizeInBits\":%u,\"byteOrder\":\"%s\",\"justification\":\"%s\","
+				 "\"channels\":%u,\"decoder\":\"%s%s\",\"threads\":%u,\"samples\":%lu,\"bytes\":%lu,\"seconds\":%.6f,\"samplesPerSecond\":%.0f,\"megabytesPerSecond\":%.1f,\"peakRssBytes\":%.0f}",
+				*numRuns?",":"",
+				format->compressionType==DAQmx_Val_LosslessPacking?"LosslessPacking":format->compressionType==DAQmx_Val_LossyLSBRemoval?"LossyLSBRemoval":"None",
+				(unsigned)format->resolution,(unsigned)format->rawSampleSizeInBits,(unsigned)format->compressedSampleSizeInBits,
+				format->byteOrder==LittleEndian?"LittleEndian":"BigEndian",format->justification==DAQmx_Val_LeftJustified?"Left":"Right",
+				(unsigned)info->numberOfChannels,IsDataPacked(info)?"Packed ":"Unpacked ",decoder,(unsigned)(path?pool->numThreads:1),
+				(unsigned long)numSamples,(unsigned long)dataBytes,best,numSamples/best,dataBytes/best/1e6,(double)GetPeakMemoryUsage());
+		++*numRuns;
+	}
+	success = 1;
+
+Error:
+	for(iChan=0;data&&iChan<info->numberOfChannels;++iChan)
+		free(data[iChan]);
+	free(data);
+	FreeDataFileInfoContent(info);
+	return success;
+}
+
+static double GetTimeInSeconds(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER	frequency,counter;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart/frequency.QuadPart;
+#else
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return now.tv_sec + now.tv_nsec*1e-9;
+#endif
+}
+
+// Lets GetPeakMemoryUsage measure from now on, where the system allows it
+static void ResetPeakMemoryUsage(void)
+{
+#ifdef __linux__
+	FILE	*f;
+
+	if( (f=fopen("/proc/self/clear_refs","w"))!=NULL ) {
+		fputs("5",f);
+		fclose(f);
+	}
+#endif
+}
+
+// Peak resident memory of the process in bytes
+static uInt64 GetPeakMemoryUsage(void)
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS	counters;
+
+	if( !GetProcessMemoryInfo(GetCurrentProcess(),&counters,sizeof(counters)) )
+		return 0;
+	return counters.PeakWorkingSetSize;
+#elif defined(__linux__)
+	FILE			*f;
+	char			line[256];
+	unsigned long	kiloBytes=0;
+
+	// VmHWM follows the resets of ResetPeakMemoryUsage, ru_maxrss does not
+	if( (f=fopen("/proc/self/status","r"))==NULL )
+		return 0;
+	while( fgets(line,sizeof(line),f) )
+		if( sscanf(line,"VmHWM: %lu kB",&kiloBytes)==1 )
+			break;
+	fclose(f);
+	return (uInt64)kiloBytes*1024;
+#else
+	struct rusage	usage;
+
+	if( getrusage(RUSAGE_SELF,&usage) )
+		return 0;
+#ifdef __APPLE__
+	return (uInt64)usage.ru_maxrss;
+#else
+	return (uInt64)usage.ru_maxrss*1024;
+#endif
+#endif
+}
+
+static void FreeDataFileInfoContent(DataFileInfo *info)
+{
+	DataFileInfo	*task=info->nextTask,*nextTask;
+	uInt32			iChan;
+
+	for(iChan=0;info->channels&&iChan<info->numberOfChannels;++iChan) {
+		free(info->channels[iChan].scalingCoeffs);
+		if( info->channels[iChan].ownsScalingTable )
+			free(info->channels[iChan].scalingTable);
+	}
+	free(info->channels);
+	info->channels = NULL;
+	free(info->channelMap);
+	info->channelMap = NULL;
+	free(info->selectedChannels);
+	info->selectedChannels = NULL;
+	free(info->channelBitOffsets);
+	info->channelBitOffsets = NULL;
+	info->nextTask = NULL;
+	// The first task is static, the others are allocated
+	while( task ) {
+		nextTask = task->nextTask;
+		task->nextTask = NULL;
+		FreeDataFileInfoContent(task);
+		free(task);
+		task = nextTask;
 	}
-	return size;
 }
@@ -25,6 +25,12 @@
 *    4. Set the number of samples to acquire per channel.
 *    5. Choose which type of devices you are trying to synchronize.
 *       This will select the correct synchronization method to use.
+*    6. Set latencyLogPath to record how close the acquisition comes
+*       to overflowing the buffers. Every latencyIntervalSeconds, the
+*       median, 99th and 99.9th percentile and maximum of the time
+*       between callbacks, the read time of each device and the
+*       samples left in each buffer after a read are written to the
+*       file.
 *
 * Steps:
 *    1. Create a task.
@@ -48,7 +54,10 @@
 *    7. Read all of the data continuously. The 'Samples per Channel'
 *       control will specify how many samples per channel are read
 *       each time. If either device reports an error or the user
-*       presses the 'Stop' button, the acquisition will stop.
+*       presses the 'Stop' button, the acquisition will stop. With
+*       latencyLogPath, the callback also records its timing in
+*       histograms, and main writes them out while it waits for the
+*       user, and right away once an error stops the tasks.
 *    8. Call the Clear Task function to clear the task.
 *    9. Display an error if any.
 *
@@ -66,14 +75,58 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 #include <NIDAQmx.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <conio.h>
+#else
+#include <sys/select.h>
+#endif
+
+// Latency histograms of 32 buckets per power of two, each within 1/32 of the
+// values it holds. EveryNCallback records into them, main writes them out.
+#define LatencySubBuckets	32
+#define LatencyNumBuckets	(28*LatencySubBuckets)	// Up to the largest uInt32
+
+#ifdef _WIN32
+#define LatencyLoadAcquire(ptr)			(MemoryBarrier(),*(ptr))
+#define LatencyStoreRelease(ptr,val)	(MemoryBarrier(),*(ptr)=(val))
+#else
+#define LatencyLoadAcquire(ptr)			__atomic_load_n((ptr),__ATOMIC_ACQUIRE)
+#define LatencyStoreRelease(ptr,val)	__atomic_store_n((ptr),(val),__ATOMIC_RELEASE)
+#endif
+
+typedef struct {
+	const char	*name;
+	uInt32		limit;			// Where the buffer overflows, in the units of the values
+	uInt32		counts[LatencyNumBuckets];
+	uInt32		reported[LatencyNumBuckets];	// The counts at the last summary
+} LatencyHistogram;
 
 static TaskHandle masterTaskHandle=0,slaveTaskHandle=0;
 
+static LatencyHistogram interval,masterReadTime,slaveReadTime,masterBacklog,slaveBacklog;
+static FILE *latencyLog=NULL;
+static int stopped=0;	// Set when an error stops the tasks, cleared once main writes the histograms
+static float64 startTime;
+
+/*********************************************/
+// Latency Histogram Options
+/*********************************************/
+const char *latencyLogPath = ""; // The CSV file the latency percentiles of both devices go to, against the limit of each. Leave it empty to record nothing.
+const float64 latencyIntervalSeconds = 10.0; // How often the percentiles are written. Each line covers the callbacks since the line before.
 
 #define DAQmxErrChk(functionCall) if( DAQmxFailed(error=(functionCall)) ) goto Error; else
 
 static int32 GetTerminalNameWithDevPrefix(TaskHandle taskHandle, const char terminalName[], char triggerName[]);
+static int32 SetLatencyLimits(TaskHandle taskHandle, LatencyHistogram *readTime, LatencyHistogram *backlog);
+static void RecordLatency(LatencyHistogram *histogram, uInt32 value);
+static uInt32 LatencyBucketValue(uInt32 bucket);
+static void WriteLatencySummary(FILE *file, float64 time, LatencyHistogram *histogram);
+static void WriteLatencySummaries(void);
+static int WaitForEnter(float64 seconds);
+static double GetTimeInSeconds(void);
 
 int32 CVICALLBACK EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData);
 int32 CVICALLBACK DoneCallback(TaskHandle taskHandle, int32 status, void *callbackData);
@@ -83,7 +136,7 @@ int main(void)
 	int32       error=0;
 	char        errBuff[2048]={'\0'};
 	char	    str1[256],str2[256],trigName[256];
-	float64     clkRate;
+	float64     clkRate,nextSummary;
 	// synchType indicates what device family the devices you are synching belong to:
 	// 0 : E series
 	// 1 : M series (PCI)
@@ -150,6 +203,23 @@ int main(void)
 	DAQmxErrChk (DAQmxRegisterEveryNSamplesEvent(masterTaskHandle,DAQmx_Val_Acquired_Into_Buffer,1000,0,EveryNCallback,NULL));
 	DAQmxErrChk (DAQmxRegisterDoneEvent(masterTaskHandle,0,DoneCallback,NULL));
 
+	if( *latencyLogPath ) {
+		interval.name = "CallbackIntervalMicroseconds";
+		masterReadTime.name = "MasterReadMicroseconds";
+		slaveReadTime.name = "SlaveReadMicroseconds";
+		masterBacklog.name = "MasterBacklogSamples";
+		slaveBacklog.name = "SlaveBacklogSamples";
+		DAQmxErrChk (SetLatencyLimits(masterTaskHandle,&masterReadTime,&masterBacklog));
+		DAQmxErrChk (SetLatencyLimits(slaveTaskHandle,&slaveReadTime,&slaveBacklog));
+		interval.limit = masterReadTime.limit<slaveReadTime.limit ? masterReadTime.limit : slaveReadTime.limit;
+		if( (latencyLog=fopen(latencyLogPath,"w"))==NULL ) {
+			printf("Error: Could not create the latency log %s.\n",latencyLogPath);
+			goto Error;
+		}
+		fprintf(latencyLog,"Seconds,Histogram,Count,P50,P99,P99.9,Max,Limit\n");
+		startTime = GetTimeInSeconds();
+	}
+
 	/*********************************************/
 	// DAQmx Start Code
 	/*********************************************/
@@ -160,7 +230,20 @@ int main(void)
 	
 	printf("Acquiring samples continuously. Press Enter to interrupt\n");
 	printf("\nRead:\tMaster\tSlave\tTotal:\tMaster\tSlave\n");
-	getchar();
+	if( latencyLog ) {
+		nextSummary = startTime + latencyIntervalSeconds;
+		while( !WaitForEnter(0.1) ) {
+			// A stopped task is summarized right away, so the file shows the callbacks that led up to the error
+			if( GetTimeInSeconds()>=nextSummary || LatencyLoadAcquire(&stopped) ) {
+				WriteLatencySummaries();
+				LatencyStoreRelease(&stopped,0);
+				while( nextSummary<=GetTimeInSeconds() )
+					nextSummary += latencyIntervalSeconds;
+			}
+		}
+	}
+	else
+		getchar();
 
 Error:
 	if( DAQmxFailed(error) )
@@ -179,6 +262,11 @@ Error:
 		DAQmxClearTask(slaveTaskHandle);
 		slaveTaskHandle = 0;
 	}
+	if( latencyLog ) {
+		WriteLatencySummaries();
+		fclose(latencyLog);
+		latencyLog = NULL;
+	}
 
 	if( DAQmxFailed(error) )
 		printf("DAQmx Error: %s\n",errBuff);
@@ -214,14 +302,35 @@ int32 CVICALLBACK EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEvent
 	int32           error=0;
 	char            errBuff[2048]={'\0'};
 	static int32    masterTotal=0,slaveTotal=0;
+	static float64  lastCallback=0.0;
 	int32           masterRead,slaveRead;
 	float64         masterData[1000],slaveData[1000];
+	float64         start,end;
+	uInt32          avail;
+
+	start = GetTimeInSeconds();
+	if( latencyLog && lastCallback>0.0 )
+		RecordLatency(&interval,(uInt32)(1e6*(start-lastCallback)));
+	lastCallback = start;
 
 	/*********************************************/
 	// DAQmx Read Code
 	/*********************************************/
 	DAQmxErrChk (DAQmxReadAnalogF64(masterTaskHandle,1000,10.0,DAQmx_Val_GroupByChannel,masterData,1000,&masterRead,NULL));
+	end = GetTimeInSeconds();
+	if( latencyLog ) {
+		RecordLatency(&masterReadTime,(uInt32)(1e6*(end-start)));
+		DAQmxErrChk (DAQmxGetReadAvailSampPerChan(masterTaskHandle,&avail));
+		RecordLatency(&masterBacklog,avail);
+		start = GetTimeInSeconds();
+	}
 	DAQmxErrChk (DAQmxReadAnalogF64(slaveTaskHandle,1000,10.0,DAQmx_Val_GroupByChannel,slaveData,1000,&slaveRead,NULL));
+	if( latencyLog ) {
+		end = GetTimeInSeconds();
+		RecordLatency(&slaveReadTime,(uInt32)(1e6*(end-start)));
+		DAQmxErrChk (DAQmxGetReadAvailSampPerChan(slaveTaskHandle,&avail));
+		RecordLatency(&slaveBacklog,avail);
+	}
 	
 	if( masterRead>0 )
 		masterTotal += masterRead;
@@ -244,11 +353,14 @@ Error:
 			DAQmxStopTask(slaveTaskHandle);
 			DAQmxClearTask(slaveTaskHandle);
 		}
+		if( latencyLog )
+			LatencyStoreRelease(&stopped,1);
 		printf("DAQmx Error: %s\n",errBuff);
 	}
 	return 0;
 }
 
+// Records that an error stopped the tasks, for main to write the histograms
 int32 CVICALLBACK DoneCallback(TaskHandle taskHandle, int32 status, void *callbackData)
 {
 	int32   error=0;
@@ -266,7 +378,132 @@ Error:
 			DAQmxClearTask(slaveTaskHandle);
 			slaveTaskHandle = 0;
 		}
+		if( latencyLog )
+			LatencyStoreRelease(&stopped,1);
 		printf("DAQmx Error: %s\n",errBuff);
 	}
 	return 0;
 }
+
+// The read time may take up to the time the buffer lasts, and the backlog up
+// to the buffer size, before the buffer overflows.
+static int32 SetLatencyLimits(TaskHandle taskHandle, LatencyHistogram *readTime, LatencyHistogram *backlog)
+{
+	int32	error=0;
+	uInt32	bufferSize;
+	float64	rate;
+
+	DAQmxErrChk (DAQmxGetBufInputBufSize(taskHandle,&bufferSize));
+	DAQmxErrChk (DAQmxGetSampClkRate(taskHandle,&rate));
+	readTime->limit = (uInt32)(1e6*bufferSize/rate);
+	backlog->limit = bufferSize;
+
+Error:
+	return error;
+}
+
+// Called by the callback thread only. main sees each count either before
+// or after the increment.
+static void RecordLatency(LatencyHistogram *histogram, uInt32 value)
+{
+	uInt32	shift=0,bucket;
+
+	while( (value>>shift)>=2*LatencySubBuckets )
+		++shift;
+	bucket = shift*LatencySubBuckets + (value>>shift);
+	LatencyStoreRelease(&histogram->counts[bucket],histogram->counts[bucket]+1);
+}
+
+// The largest value that falls into the bucket
+static uInt32 LatencyBucketValue(uInt32 bucket)
+{
+	uInt32	shift=bucket<2*LatencySubBuckets ? 0 : bucket/LatencySubBuckets-1;
+
+	return (uInt32)(((uInt64)(bucket-shift*LatencySubBuckets+1)<<shift)-1);
+}
+
+// One line per histogram with new values since the last summary. Each
+// percentile is the top of its bucket.
+static void WriteLatencySummary(FILE *file, float64 time, LatencyHistogram *histogram)
+{
+	static const uInt32	perMille[3]={500,990,999};
+	uInt32				delta[LatencyNumBuckets],bucket,i=0,maxBucket=0;
+	uInt32				values[3]={0};
+	uInt64				total=0,count=0;
+
+	for(bucket=0;bucket<LatencyNumBuckets;++bucket) {
+		delta[bucket] = LatencyLoadAcquire(&histogram->counts[bucket]) - histogram->reported[bucket];
+		histogram->reported[bucket] += delta[bucket];
+		if( delta[bucket] ) {
+			total += delta[bucket];
+			maxBucket = bucket;
+		}
+	}
+	if( total==0 )
+		return;
+	for(bucket=0;bucket<=maxBucket && i<3;++bucket) {
+		count += delta[bucket];
+		while( i<3 && count*1000>=total*perMille[i] )
+			values[i++] = LatencyBucketValue(bucket);
+	}
+	fprintf(file,"%.3f,%s,%lu,%lu,%lu,%lu,%lu,%lu\n",time,histogram->name,(unsigned long)total,(unsigned long)values[0],(unsigned long)values[1],(unsigned long)values[2],(unsigned long)LatencyBucketValue(maxBucket),(unsigned long)histogram->limit);
+}
+
+static void WriteLatencySummaries(void)
+{
+	float64	time=GetTimeInSeconds()-startTime;
+
+	WriteLatencySummary(latencyLog,time,&interval);
+	WriteLatencySummary(latencyLog,time,&masterReadTime);
+	WriteLatencySummary(latencyLog,time,&masterBacklog);
+	WriteLatencySummary(latencyLog,time,&slaveReadTime);
+	WriteLatencySummary(latencyLog,time,&slaveBacklog);
+	fflush(latencyLog);
+}
+
+// Waits up to the given time for the user to press Enter. Returns 1 once
+// the line is read, and 0 when the time is up first.
+static int WaitForEnter(float64 seconds)
+{
+#ifdef _WIN32
+	float64			end=GetTimeInSeconds()+seconds;
+
+	while( GetTimeInSeconds()<end ) {
+		if( _kbhit() ) {
+			getchar();
+			return 1;
+		}
+		Sleep(10);
+	}
+	return 0;
+#else
+	fd_set			readSet;
+	struct timeval	wait;
+
+	FD_ZERO(&readSet);
+	FD_SET(0,&readSet);
+	wait.tv_sec = (long)seconds;
+	wait.tv_usec = (long)(1e6*(seconds-wait.tv_sec));
+	if( select(1,&readSet,NULL,NULL,&wait)>0 ) {
+		getchar();
+		return 1;
+	}
+	return 0;
+#endif
+}
+
+static double GetTimeInSeconds(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER	frequency,counter;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart/frequency.QuadPart;
+#else
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return now.tv_sec + now.tv_nsec*1e-9;
+#endif
+}
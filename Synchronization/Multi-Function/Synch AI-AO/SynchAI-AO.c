@@ -23,6 +23,11 @@
 *          frequency component of the signal being acquired.
 *    4. Select the rate for the generation.
 *    5. Select what type of signal to generate and the amplitude.
+*    6. Set latencyLogPath to record how close the acquisition comes
+*       to overflowing the buffer. Every latencyIntervalSeconds, the
+*       median, 99th and 99.9th percentile and maximum of the time
+*       between callbacks, the read time and the samples left in the
+*       buffer after a read are written to the file.
 *    Note: This example requires two DMA channels to run. If your
 *          hardware does not support two DMA channels, you need to
 *          set the Data Transfer Mechanism attribute for the Analog
@@ -51,7 +56,10 @@
 *       analog output is armed before the analog input. This will
 *       ensure both will start at the same time.
 *    7. Read the waveform data continuously until the user hits the
-*       stop button or an error occurs.
+*       stop button or an error occurs. With latencyLogPath, the
+*       callback also records its timing in histograms, and main
+*       writes them out while it waits for the user, and right away
+*       once an error stops the tasks.
 *    8. Call the Stop function to stop the acquisition.
 *    9. Call the Clear Task function to clear the task.
 *    10. Display an error if any.
@@ -65,10 +73,47 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <time.h>
 #include <NIDAQmx.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <conio.h>
+#else
+#include <sys/select.h>
+#endif
+
+// Bucketed as in HdrHistogram: exact below 64, then 32 buckets per power of
+// two. The callback records without locks and main reads the counts.
+#define LatencySubBuckets	32
+#define LatencyNumBuckets	(28*LatencySubBuckets)	// Up to the largest uInt32
+
+#ifdef _WIN32
+#define LatencyLoadAcquire(ptr)			(MemoryBarrier(),*(ptr))
+#define LatencyStoreRelease(ptr,val)	(MemoryBarrier(),*(ptr)=(val))
+#else
+#define LatencyLoadAcquire(ptr)			__atomic_load_n((ptr),__ATOMIC_ACQUIRE)
+#define LatencyStoreRelease(ptr,val)	__atomic_store_n((ptr),(val),__ATOMIC_RELEASE)
+#endif
+
+typedef struct {
+	const char	*name;
+	uInt32		limit;			// Where the buffer overflows, in the units of the values
+	uInt32		counts[LatencyNumBuckets];
+	uInt32		reported[LatencyNumBuckets];	// The counts at the last summary
+} LatencyHistogram;
 
 static TaskHandle  AItaskHandle=0,AOtaskHandle=0;
 
+static LatencyHistogram interval,readTime,backlog;
+static FILE *latencyLog=NULL;
+static int stopped=0;	// Set when an error stops the AI task, cleared once main writes the histograms
+static float64 startTime;
+
+/*********************************************/
+// Latency Histogram Options
+/*********************************************/
+const char *latencyLogPath = ""; // Where the AI latency percentiles are written as CSV. Leave it empty to record nothing.
+const float64 latencyIntervalSeconds = 10.0; // How often the percentiles are written. Each line covers the callbacks since the line before.
 
 #define PI	3.1415926535
 
@@ -77,6 +122,12 @@ static TaskHandle  AItaskHandle=0,AOtaskHandle=0;
 int GenSineWave(int numElements, double amplitude, double frequency, double *phase, double sineWave[]);
 
 static int32 GetTerminalNameWithDevPrefix(TaskHandle taskHandle, const char terminalName[], char triggerName[]);
+static void RecordLatency(LatencyHistogram *histogram, uInt32 value);
+static uInt32 LatencyBucketValue(uInt32 bucket);
+static void WriteLatencySummary(FILE *file, float64 time, LatencyHistogram *histogram);
+static void WriteLatencySummaries(void);
+static int WaitForEnter(float64 seconds);
+static double GetTimeInSeconds(void);
 
 int32 CVICALLBACK EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEventType, uInt32 nSamples, void *callbackData);
 int32 CVICALLBACK DoneCallback(TaskHandle taskHandle, int32 status, void *callbackData);
@@ -88,6 +139,8 @@ int main(void)
 	char    trigName[256];
 	float64	AOdata[1000];
 	float64	phase=0.0;
+	uInt32	bufferSize;
+	float64	rate,nextSummary;
 
 	/*********************************************/
 	// DAQmx Configure Code
@@ -105,6 +158,24 @@ int main(void)
 	DAQmxErrChk (DAQmxRegisterEveryNSamplesEvent(AItaskHandle,DAQmx_Val_Acquired_Into_Buffer,1000,0,EveryNCallback,NULL));
 	DAQmxErrChk (DAQmxRegisterDoneEvent(AItaskHandle,0,DoneCallback,NULL));
 
+	if( *latencyLogPath ) {
+		interval.name = "CallbackIntervalMicroseconds";
+		readTime.name = "ReadMicroseconds";
+		backlog.name = "BacklogSamples";
+		// The time between callbacks and the read time may reach the time the
+		// buffer lasts, and the backlog the buffer size, before it overflows.
+		DAQmxErrChk (DAQmxGetBufInputBufSize(AItaskHandle,&bufferSize));
+		DAQmxErrChk (DAQmxGetSampClkRate(AItaskHandle,&rate));
+		interval.limit = readTime.limit = (uInt32)(1e6*bufferSize/rate);
+		backlog.limit = bufferSize;
+		if( (latencyLog=fopen(latencyLogPath,"w"))==NULL ) {
+			printf("Error: Could not create the latency log %s.\n",latencyLogPath);
+			goto Error;
+		}
+		fprintf(latencyLog,"Seconds,Histogram,Count,P50,P99,P99.9,Max,Limit\n");
+		startTime = GetTimeInSeconds();
+	}
+
 	GenSineWave(1000,1.0,1.0/1000,&phase,AOdata);
 
 	DAQmxErrChk (DAQmxWriteAnalogF64(AOtaskHandle, 1000, FALSE, 10.0, DAQmx_Val_GroupByChannel, AOdata, NULL, NULL));
@@ -117,7 +188,20 @@ int main(void)
 
 	printf("Acquiring samples continuously. Press Enter to interrupt\n");
 	printf("\nRead:\tAI\tTotal:\tAI\n");
-	getchar();
+	if( latencyLog ) {
+		nextSummary = startTime + latencyIntervalSeconds;
+		while( !WaitForEnter(0.1) ) {
+			// A stopped task is summarized right away, so the file shows the callbacks that led up to the error
+			if( GetTimeInSeconds()>=nextSummary || LatencyLoadAcquire(&stopped) ) {
+				WriteLatencySummaries();
+				LatencyStoreRelease(&stopped,0);
+				while( nextSummary<=GetTimeInSeconds() )
+					nextSummary += latencyIntervalSeconds;
+			}
+		}
+	}
+	else
+		getchar();
 
 Error:
 	if( DAQmxFailed(error) )
@@ -138,6 +222,11 @@ Error:
 		DAQmxClearTask(AOtaskHandle);
 		AOtaskHandle = 0;
 	}
+	if( latencyLog ) {
+		WriteLatencySummaries();
+		fclose(latencyLog);
+		latencyLog = NULL;
+	}
 	if( DAQmxFailed(error) )
 		printf("DAQmx Error: %s\n",errBuff);
 	printf("End of program, press Enter key to quit\n");
@@ -150,13 +239,27 @@ int32 CVICALLBACK EveryNCallback(TaskHandle taskHandle, int32 everyNsamplesEvent
 	int32       error=0;
 	char        errBuff[2048]={'\0'};
 	static int  totalAI=0;
+	static float64 lastCallback=0.0;
 	int32       readAI;
 	float64     AIdata[1000];
+	float64     start,end;
+	uInt32      avail;
+
+	start = GetTimeInSeconds();
+	if( latencyLog && lastCallback>0.0 )
+		RecordLatency(&interval,(uInt32)(1e6*(start-lastCallback)));
+	lastCallback = start;
 
 	/*********************************************/
 	// DAQmx Read Code
 	/*********************************************/
 	DAQmxErrChk (DAQmxReadAnalogF64(AItaskHandle,1000,10.0,DAQmx_Val_GroupByChannel,AIdata,1000,&readAI,NULL));
+	if( latencyLog ) {
+		end = GetTimeInSeconds();
+		RecordLatency(&readTime,(uInt32)(1e6*(end-start)));
+		DAQmxErrChk (DAQmxGetReadAvailSampPerChan(AItaskHandle,&avail));
+		RecordLatency(&backlog,avail);
+	}
 
 	printf("\t%d\t\t%d\r",(int)readAI,(int)(totalAI+=readAI));
 	fflush(stdout);
@@ -177,11 +280,14 @@ Error:
 			DAQmxClearTask(AOtaskHandle);
 			AOtaskHandle = 0;
 		}
+		if( latencyLog )
+			LatencyStoreRelease(&stopped,1);
 		printf("DAQmx Error: %s\n",errBuff);
 	}
 	return 0;
 }
 
+// Records that an error stopped the tasks, for main to write the histograms
 int32 CVICALLBACK DoneCallback(TaskHandle taskHandle, int32 status, void *callbackData)
 {
 	int32   error=0;
@@ -204,6 +310,8 @@ Error:
 			DAQmxClearTask(AOtaskHandle);
 			AOtaskHandle = 0;
 		}
+		if( latencyLog )
+			LatencyStoreRelease(&stopped,1);
 		printf("DAQmx Error: %s\n",errBuff);
 	}
 	return 0;
@@ -240,3 +348,107 @@ static int32 GetTerminalNameWithDevPrefix(TaskHandle taskHandle, const char term
 Error:
 	return error;
 }
+
+// Called by the callback thread only. main sees each count either before
+// or after the increment.
+static void RecordLatency(LatencyHistogram *histogram, uInt32 value)
+{
+	uInt32	shift=0,bucket;
+
+	while( (value>>shift)>=2*LatencySubBuckets )
+		++shift;
+	bucket = shift*LatencySubBuckets + (value>>shift);
+	LatencyStoreRelease(&histogram->counts[bucket],histogram->counts[bucket]+1);
+}
+
+// The largest value that falls into the bucket
+static uInt32 LatencyBucketValue(uInt32 bucket)
+{
+	uInt32	shift=bucket<2*LatencySubBuckets ? 0 : bucket/LatencySubBuckets-1;
+
+	return (uInt32)(((uInt64)(bucket-shift*LatencySubBuckets+1)<<shift)-1);
+}
+
+// Appends the percentiles of the values new since the last call, rounded
+// up to the top of their buckets.
+static void WriteLatencySummary(FILE *file, float64 time, LatencyHistogram *histogram)
+{
+	static const uInt32	perMille[3]={500,990,999};
+	uInt32				delta[LatencyNumBuckets],bucket,i=0,maxBucket=0;
+	uInt32				values[3]={0};
+	uInt64				total=0,count=0;
+
+	for(bucket=0;bucket<LatencyNumBuckets;++bucket) {
+		delta[bucket] = LatencyLoadAcquire(&histogram->counts[bucket]) - histogram->reported[bucket];
+		histogram->reported[bucket] += delta[bucket];
+		if( delta[bucket] ) {
+			total += delta[bucket];
+			maxBucket = bucket;
+		}
+	}
+	if( total==0 )
+		return;
+	for(bucket=0;bucket<=maxBucket && i<3;++bucket) {
+		count += delta[bucket];
+		while( i<3 && count*1000>=total*perMille[i] )
+			values[i++] = LatencyBucketValue(bucket);
+	}
+	fprintf(file,"%.3f,%s,%lu,%lu,%lu,%lu,%lu,%lu\n",time,histogram->name,(unsigned long)total,(unsigned long)values[0],(unsigned long)values[1],(unsigned long)values[2],(unsigned long)LatencyBucketValue(maxBucket),(unsigned long)histogram->limit);
+}
+
+static void WriteLatencySummaries(void)
+{
+	float64	time=GetTimeInSeconds()-startTime;
+
+	WriteLatencySummary(latencyLog,time,&interval);
+	WriteLatencySummary(latencyLog,time,&readTime);
+	WriteLatencySummary(latencyLog,time,&backlog);
+	fflush(latencyLog);
+}
+
+// Waits up to the given time for the user to press Enter. Returns 1 once
+// the line is read, and 0 when the time is up first.
+static int WaitForEnter(float64 seconds)
+{
+#ifdef _WIN32
+	float64			end=GetTimeInSeconds()+seconds;
+
+	while( GetTimeInSeconds()<end ) {
+		if( _kbhit() ) {
+			getchar();
+			return 1;
+		}
+		Sleep(10);
+	}
+	return 0;
+#else
+	fd_set			readSet;
+	struct timeval	wait;
+
+	FD_ZERO(&readSet);
+	FD_SET(0,&readSet);
+	wait.tv_sec = (long)seconds;
+	wait.tv_usec = (long)(1e6*(seconds-wait.tv_sec));
+	if( select(1,&readSet,NULL,NULL,&wait)>0 ) {
+		getchar();
+		return 1;
+	}
+	return 0;
+#endif
+}
+
+static double GetTimeInSeconds(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER	frequency,counter;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart/frequency.QuadPart;
+#else
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return now.tv_sec + now.tv_nsec*1e-9;
+#endif
+}